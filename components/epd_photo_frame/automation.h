@@ -0,0 +1,28 @@
+#pragma once
+
+#include "esphome/core/automation.h"
+#include "epd_photo_frame.h"
+
+namespace esphome {
+namespace epd_photo_frame {
+
+// Fires once BUSY releases after POF; the argument is false if any phase hit the busy timeout
+class RefreshCompleteTrigger : public Trigger<bool> {
+ public:
+  explicit RefreshCompleteTrigger(EPDPhotoFrame *parent) {
+    parent->add_on_refresh_complete_callback([this](bool success) { this->trigger(success); });
+  }
+};
+
+template<typename... Ts> class ShowNextCachedAction : public Action<Ts...>, public Parented<EPDPhotoFrame> {
+ public:
+  void play(Ts... x) override { this->parent_->showNextCached(); }
+};
+
+template<typename... Ts> class RefillCacheAction : public Action<Ts...>, public Parented<EPDPhotoFrame> {
+ public:
+  void play(Ts... x) override { this->parent_->refillCache(); }
+};
+
+}  // namespace epd_photo_frame
+}  // namespace esphome
@@ -7,13 +7,17 @@ epd_photo_frame.display as a display platform.
 import esphome.codegen as cg
 import esphome.config_validation as cv
 from esphome.components import display, spi, sensor, binary_sensor, text_sensor
-from esphome import pins
+from esphome import automation, pins
 from esphome.const import (
     CONF_ID,
+    CONF_LAMBDA,
+    CONF_PAGES,
     CONF_RESET_PIN,
     CONF_DC_PIN,
     CONF_BUSY_PIN,
     CONF_UPDATE_INTERVAL,
+    CONF_DATA_RATE,
+    CONF_TRIGGER_ID,
 )
 from esphome.cpp_helpers import gpio_pin_expression
 
@@ -35,34 +39,60 @@ CONF_CS_MASTER_PIN = "cs_master_pin"
 CONF_CS_SLAVE_PIN = "cs_slave_pin"
 CONF_IMAGE_URL = "image_url"
 CONF_SPI_ID = "spi_id"
+CONF_STREAM_DISPLAY = "stream_display"
+CONF_ON_REFRESH_COMPLETE = "on_refresh_complete"
 
 epd_photo_frame_ns = cg.esphome_ns.namespace("epd_photo_frame")
 EPDPhotoFrame = epd_photo_frame_ns.class_(
     "EPDPhotoFrame", cg.PollingComponent, display.DisplayBuffer
 )
-
-CONFIG_SCHEMA = display.BASIC_DISPLAY_SCHEMA.extend(
-    {
-        cv.GenerateID(): cv.declare_id(EPDPhotoFrame),
-        cv.GenerateID(CONF_SPI_ID): cv.use_id(spi.SPIComponent),
-        cv.Required(CONF_RESET_PIN): pins.gpio_output_pin_schema,
-        cv.Required(CONF_DC_PIN): pins.gpio_output_pin_schema,
-        cv.Required(CONF_BUSY_PIN): pins.gpio_input_pin_schema,
-        cv.Required(CONF_POWER_PIN): pins.gpio_output_pin_schema,
-        cv.Required(CONF_CS_MASTER_PIN): pins.gpio_output_pin_schema,
-        cv.Required(CONF_CS_SLAVE_PIN): pins.gpio_output_pin_schema,
-        cv.Optional(
-            CONF_IMAGE_URL, default="http://10.0.0.253:8080/image.bin"
-        ): cv.string,
-        cv.Optional(CONF_UPDATE_INTERVAL, default="30min"): cv.update_interval,
-        # Optional reporting entities
-        cv.Optional("download_bytes"): sensor.sensor_schema(
-            unit_of_measurement="B", accuracy_decimals=0
-        ),
-        cv.Optional("download_success"): binary_sensor.binary_sensor_schema(),
-        cv.Optional("download_status"): text_sensor.text_sensor_schema(),
-    }
-).extend(cv.polling_component_schema("30min"))
+RefreshCompleteTrigger = epd_photo_frame_ns.class_(
+    "RefreshCompleteTrigger", automation.Trigger.template(cg.bool_)
+)
+ShowNextCachedAction = epd_photo_frame_ns.class_(
+    "ShowNextCachedAction", automation.Action
+)
+RefillCacheAction = epd_photo_frame_ns.class_("RefillCacheAction", automation.Action)
+
+# lambda/pages draw overlays (clock, battery, captions) composited onto the stored photo
+CONFIG_SCHEMA = cv.All(
+    display.FULL_DISPLAY_SCHEMA.extend(
+        {
+            cv.GenerateID(): cv.declare_id(EPDPhotoFrame),
+            cv.GenerateID(CONF_SPI_ID): cv.use_id(spi.SPIComponent),
+            cv.Required(CONF_RESET_PIN): pins.gpio_output_pin_schema,
+            cv.Required(CONF_DC_PIN): pins.gpio_output_pin_schema,
+            cv.Required(CONF_BUSY_PIN): pins.gpio_input_pin_schema,
+            cv.Required(CONF_POWER_PIN): pins.gpio_output_pin_schema,
+            cv.Required(CONF_CS_MASTER_PIN): pins.gpio_output_pin_schema,
+            cv.Required(CONF_CS_SLAVE_PIN): pins.gpio_output_pin_schema,
+            cv.Optional(
+                CONF_IMAGE_URL, default="http://10.0.0.253:8080/image.bin"
+            ): cv.string,
+            cv.Optional(CONF_UPDATE_INTERVAL, default="30min"): cv.update_interval,
+            # Feed the download straight into the panel; SPIFFS is only used as fallback
+            cv.Optional(CONF_STREAM_DISPLAY, default=False): cv.boolean,
+            cv.Optional(CONF_DATA_RATE, default="2MHz"): spi.SPI_DATA_RATE_SCHEMA,
+            # Optional reporting entities
+            cv.Optional("download_bytes"): sensor.sensor_schema(
+                unit_of_measurement="B", accuracy_decimals=0
+            ),
+            cv.Optional("download_throughput"): sensor.sensor_schema(
+                unit_of_measurement="B/s", accuracy_decimals=0
+            ),
+            cv.Optional("download_success"): binary_sensor.binary_sensor_schema(),
+            cv.Optional("download_status"): text_sensor.text_sensor_schema(),
+            cv.Optional("wake_trace"): text_sensor.text_sensor_schema(),
+            cv.Optional("cache_depth"): sensor.sensor_schema(accuracy_decimals=0),
+            cv.Optional(CONF_ON_REFRESH_COMPLETE): automation.validate_automation(
+                {
+                    cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(RefreshCompleteTrigger),
+                }
+            ),
+        }
+    ).extend(cv.polling_component_schema("30min")),
+    cv.has_at_most_one_key(CONF_PAGES, CONF_LAMBDA),
+)
 
 
 async def to_code(config):
@@ -70,9 +100,16 @@ async def to_code(config):
 
     await display.register_display(var, config)
 
+    if CONF_LAMBDA in config:
+        lambda_ = await cg.process_lambda(
+            config[CONF_LAMBDA], [(display.DisplayRef, "it")], return_type=cg.void
+        )
+        cg.add(var.set_writer(lambda_))
+
     # Set SPI parent directly without requiring cs_pin
     spi_parent = await cg.get_variable(config[CONF_SPI_ID])
     cg.add(var.assign_spi_parent(spi_parent))
+    cg.add(var.set_data_rate(config[CONF_DATA_RATE]))
 
     # Add pins
     reset_pin = await gpio_pin_expression(config[CONF_RESET_PIN])
@@ -100,13 +137,47 @@ async def to_code(config):
     if CONF_UPDATE_INTERVAL in config:
         cg.add(var.set_update_interval(config[CONF_UPDATE_INTERVAL]))
 
+    cg.add(var.set_stream_display(config[CONF_STREAM_DISPLAY]))
+
     # Optional entities
     if "download_bytes" in config:
         bytes_sensor = await sensor.new_sensor(config["download_bytes"])
         cg.add(var.set_download_bytes_sensor(bytes_sensor))
+    if "download_throughput" in config:
+        throughput_sensor = await sensor.new_sensor(config["download_throughput"])
+        cg.add(var.set_download_throughput_sensor(throughput_sensor))
     if "download_success" in config:
         success_bin = await binary_sensor.new_binary_sensor(config["download_success"])
         cg.add(var.set_download_success_binary(success_bin))
     if "download_status" in config:
         status_txt = await text_sensor.new_text_sensor(config["download_status"])
         cg.add(var.set_download_status_text(status_txt))
+    if "wake_trace" in config:
+        trace_txt = await text_sensor.new_text_sensor(config["wake_trace"])
+        cg.add(var.set_wake_trace_text(trace_txt))
+    if "cache_depth" in config:
+        depth_sensor = await sensor.new_sensor(config["cache_depth"])
+        cg.add(var.set_cache_depth_sensor(depth_sensor))
+
+    for conf in config.get(CONF_ON_REFRESH_COMPLETE, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(trigger, [(cg.bool_, "success")], conf)
+
+
+FRAME_ACTION_SCHEMA = automation.maybe_simple_id(
+    {
+        cv.GenerateID(): cv.use_id(EPDPhotoFrame),
+    }
+)
+
+
+@automation.register_action(
+    "epd_photo_frame.show_next_cached", ShowNextCachedAction, FRAME_ACTION_SCHEMA
+)
+@automation.register_action(
+    "epd_photo_frame.refill_cache", RefillCacheAction, FRAME_ACTION_SCHEMA
+)
+async def frame_action_to_code(config, action_id, template_arg, args):
+    var = cg.new_Pvariable(action_id, template_arg)
+    await cg.register_parented(var, config[CONF_ID])
+    return var
@@ -2,10 +2,16 @@
 #include "esphome/core/log.h"
 #include "esphome/core/hal.h"
 #include <string>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <strings.h>
 #include "esphome/core/application.h"
 #include "esphome/core/util.h"
+#include "esphome/components/network/util.h"
 #include <esp_http_client.h>
-#include <esp_spiffs.h>
+#include <esp_heap_caps.h>
+#include <esp_crc.h>
 
 namespace esphome {
 namespace epd_photo_frame {
@@ -17,13 +23,37 @@ static inline void cs_all(esphome::GPIOPin *cs_m, esphome::GPIOPin *cs_s, bool l
   cs_s->digital_write(level_high);
 }
 
-static bool read_exact(FILE *fp, uint8_t *buf, size_t len) {
-  size_t off = 0; while (off < len) { size_t r = fread(buf + off, 1, len - off, fp); if (r == 0) return false; off += r; }
-  return true;
+static const uint8_t ZERO_PARAM[] = {0x00};
+
+// Response headers the ranged download cares about, filled in by the HTTP event handler
+struct HttpResponseMeta {
+  int total{0};      // size after the '/' in Content-Range
+  bool rle{false};   // Content-Encoding: x-epd-rle
+  char etag[ETAG_MAX_LEN]{};
+};
+
+static esp_err_t http_event_handler(esp_http_client_event_t *evt) {
+  auto *meta = reinterpret_cast<HttpResponseMeta *>(evt->user_data);
+  if (evt->event_id == HTTP_EVENT_ON_HEADER && meta != nullptr && strcasecmp(evt->header_key, "Content-Range") == 0) {
+    const char *slash = strrchr(evt->header_value, '/');
+    if (slash != nullptr && slash[1] != '*') meta->total = atoi(slash + 1);
+  } else if (evt->event_id == HTTP_EVENT_ON_HEADER && meta != nullptr &&
+             strcasecmp(evt->header_key, "Content-Encoding") == 0) {
+    meta->rle = strcasecmp(evt->header_value, RLE_ENCODING) == 0;
+  } else if (evt->event_id == HTTP_EVENT_ON_HEADER && meta != nullptr && strcasecmp(evt->header_key, "ETag") == 0) {
+    if (strlen(evt->header_value) < sizeof(meta->etag)) strcpy(meta->etag, evt->header_value);
+  }
+  return ESP_OK;
 }
 
 void EPDPhotoFrame::setup() {
   ESP_LOGCONFIG(TAG, "Setting up EPD Photo Frame...");
+  this->trace_.begin();
+  if (const WakeTrace::Record *last = this->trace_.nextUnpublished()) {
+    char json[256];
+    WakeTrace::toJson(*last, json, sizeof(json));
+    ESP_LOGI(TAG, "Previous wake: %s", json);
+  }
   
   // Initialize pins
   this->reset_pin_->setup();
@@ -47,166 +77,951 @@ void EPDPhotoFrame::setup() {
   // Initialize display
   this->initDisplay();
   
-  // SPIFFS will be mounted on first use
-  spiffs_mounted_ = false;
+  if (this->store_.begin()) {
+    ESP_LOGCONFIG(TAG, "Frame store: %d slot(s), active %d", this->store_.slotCount(), this->store_.activeSlot());
+  }
+
+  this->etag_pref_ = global_preferences->make_preference<StoredEtag>(fnv1_hash("epd_photo_frame_etag"), true);
+  if (!this->etag_pref_.load(&this->displayed_etag_)) this->displayed_etag_.value[0] = '\0';
+  this->displayed_etag_.value[ETAG_MAX_LEN - 1] = '\0';
+  this->resume_pref_ = global_preferences->make_preference<ResumeState>(fnv1_hash("epd_photo_frame_resume"), true);
+  if (!this->resume_pref_.load(&this->resume_)) this->resume_ = ResumeState{};
+  this->resume_.etag[ETAG_MAX_LEN - 1] = '\0';
+  this->cache_pref_ = global_preferences->make_preference<CacheState>(fnv1_hash("epd_photo_frame_cache"), true);
+  if (!this->cache_pref_.load(&this->cache_)) this->cache_ = CacheState{};
+  this->publishCacheDepth();
 
   // No web upload handlers anymore; downloads are performed from backend via HTTP client
 
   ESP_LOGCONFIG(TAG, "EPD Photo Frame setup complete");
 }
-bool EPDPhotoFrame::mountSpiffs() {
-  if (spiffs_mounted_) return true;
-  esp_vfs_spiffs_conf_t conf = {
-      .base_path = "/spiffs",
-      .partition_label = nullptr,
-      .max_files = 4,
-      .format_if_mount_failed = true,
-  };
-  esp_err_t ret = esp_vfs_spiffs_register(&conf);
-  if (ret != ESP_OK) {
-    ESP_LOGE(TAG, "SPIFFS mount failed: %d", (int) ret);
+void EPDPhotoFrame::startDownload() {
+  if (this->transfer_active_ || this->download_active_) {
+    ESP_LOGW(TAG, "Download or frame transfer in progress; ignoring download request");
+    return;
+  }
+  // The refill writes the same slots and frame_etag_
+  if (this->cache_refill_active_) {
+    ESP_LOGW(TAG, "Cache refill in progress; ignoring download request");
+    return;
+  }
+  // A streamed frame would write DTM while the controllers run DRF
+  if (this->refresh_state_ != REFRESH_IDLE || this->stream_refresh_pending_) {
+    ESP_LOGW(TAG, "Refresh in progress; ignoring download request");
+    return;
+  }
+  ESP_LOGI(TAG, "Start %s (background) from %s", stream_display_ ? "stream" : "download", image_url_.c_str());
+  this->frame_streamed_ = false;
+  this->frame_unchanged_ = false;
+  this->download_active_ = true;
+  xTaskCreatePinnedToCore(&EPDPhotoFrame::download_task_trampoline, "epd_dl", 6144, this, 5, nullptr, 0);
+}
+
+void EPDPhotoFrame::displayFromFile() {
+  if (this->transfer_active_) {
+    ESP_LOGW(TAG, "Frame transfer in progress; ignoring display request");
+    return;
+  }
+  if (this->frame_streamed_) {
+    // The last download already went straight to the panel
+    ESP_LOGI(TAG, "Frame already streamed to panel; skipping stored frame");
+    this->frame_streamed_ = false;
+    return;
+  }
+  if (this->frame_unchanged_) {
+    ESP_LOGI(TAG, "Image unchanged; keeping the panel as is");
+    this->frame_unchanged_ = false;
+    return;
+  }
+  const int slot = this->store_.activeSlot();
+  if (slot < 0) {
+    // A partial download never has a committed slot, so it cannot end up on the panel
+    ESP_LOGW(TAG, "No complete frame stored; not displaying");
+    return;
+  }
+  ESP_LOGI(TAG, "Display from flash slot %d", slot);
+  if (this->refresh_state_ != REFRESH_IDLE) {
+    ESP_LOGW(TAG, "Refresh in progress; ignoring display request");
+    return;
+  }
+  if (this->sendImageDataFromStore(slot)) {
+    memcpy(this->panel_etag_, this->store_.record(slot)->etag, ETAG_MAX_LEN);
+    this->panel_sequence_ = this->store_.record(slot)->sequence;
+    this->startRefresh();
+  } else {
+    ESP_LOGE(TAG, "Display from flash failed");
+  }
+}
+
+bool EPDPhotoFrame::showNextCached() {
+  if (this->transfer_active_) {
+    ESP_LOGW(TAG, "Frame transfer in progress; ignoring cached display request");
     return false;
   }
-  size_t total = 0, used = 0;
-  if (esp_spiffs_info(nullptr, &total, &used) == ESP_OK) {
-    ESP_LOGI(TAG, "SPIFFS total=%u used=%u", (unsigned) total, (unsigned) used);
+  if (this->refresh_state_ != REFRESH_IDLE) {
+    ESP_LOGW(TAG, "Refresh in progress; ignoring cached display request");
+    return false;
   }
-  spiffs_mounted_ = true;
-  return true;
+  const int slot = this->store_.nextSlotAfter(this->cache_.shown_sequence);
+  if (slot < 0) {
+    ESP_LOGI(TAG, "Frame cache empty");
+    return false;
+  }
+  ESP_LOGI(TAG, "Display cached frame from slot %d (%d queued)", slot, this->cacheDepth());
+  if (!this->sendImageDataFromStore(slot)) {
+    ESP_LOGE(TAG, "Display from cache failed");
+    return false;
+  }
+  // The queue advances once the refresh completes, so a reset before then shows it again
+  memcpy(this->panel_etag_, this->store_.record(slot)->etag, ETAG_MAX_LEN);
+  this->panel_sequence_ = this->store_.record(slot)->sequence;
+  return this->startRefresh();
 }
 
-void EPDPhotoFrame::startDownload() {
-  ESP_LOGI(TAG, "Start download (background) from %s", image_url_.c_str());
-  xTaskCreatePinnedToCore(&EPDPhotoFrame::download_task_trampoline, "epd_dl", 4096, this, 5, nullptr, 0);
+void EPDPhotoFrame::refillCache() {
+  if (this->transfer_active_) {
+    ESP_LOGW(TAG, "Frame transfer in progress; ignoring cache refill");
+    return;
+  }
+  if (this->cache_refill_active_) {
+    ESP_LOGW(TAG, "Cache refill already running");
+    return;
+  }
+  if (this->download_active_) {
+    ESP_LOGW(TAG, "Download in progress; ignoring cache refill");
+    return;
+  }
+  ESP_LOGI(TAG, "Refill frame cache (background)");
+  this->cache_refill_active_ = true;
+  xTaskCreatePinnedToCore(&EPDPhotoFrame::refill_task_trampoline, "epd_cache", 6144, this, 5, nullptr, 0);
 }
 
-void EPDPhotoFrame::displayFromFile() {
-  ESP_LOGI(TAG, "Display from /spiffs/image.bin");
-  if (this->sendImageDataFromFile("/spiffs/image.bin")) {
-    this->turnOnDisplay();
-  } else {
-    ESP_LOGE(TAG, "Display from file failed");
+void EPDPhotoFrame::refill_task_trampoline(void *param) {
+  auto *self = reinterpret_cast<EPDPhotoFrame *>(param);
+  const uint32_t start_ms = millis();
+  self->run_refill_task();
+  self->trace_.add(WAKE_PHASE_DOWNLOAD, millis() - start_ms);
+  self->cache_refill_active_ = false;
+  vTaskDelete(nullptr);
+}
+
+void EPDPhotoFrame::run_refill_task() {
+  if (!this->store_.ready()) {
+    if (download_success_binary_) download_success_binary_->publish_state(false);
+    if (download_status_text_) download_status_text_->publish_state("no_frame_store");
+    return;
+  }
+  const int room = this->store_.freeCount(this->cache_.shown_sequence);
+  if (room == 0) {
+    ESP_LOGI(TAG, "Frame cache full (%d queued)", this->cacheDepth());
+    if (download_success_binary_) download_success_binary_->publish_state(true);
+    if (download_status_text_) download_status_text_->publish_state("cache_full");
+    return;
   }
+  // The batch list lives next to the image: /images/next?x -> /images/batch?x&count=N
+  std::string url = this->image_url_;
+  const size_t query = url.find('?');
+  const size_t next = url.rfind("/next", query);
+  if (next == std::string::npos) {
+    ESP_LOGW(TAG, "image_url has no /next path; cannot derive the batch URL");
+    if (download_success_binary_) download_success_binary_->publish_state(false);
+    if (download_status_text_) download_status_text_->publish_state("no_batch_endpoint");
+    return;
+  }
+  url.replace(next, 5, "/batch");
+  url += (query == std::string::npos ? "?count=" : "&count=") + std::to_string(room);
+
+  HttpResponseMeta meta;
+  esp_http_client_handle_t client = this->createClient(url.c_str(), &meta);
+  if (client == nullptr) return;
+  std::unique_ptr<char[]> list(new char[BATCH_LIST_SIZE]);
+  int list_len = 0;
+  int status = 0;
+  if (this->openRange(client, &meta, -1, -1, false, false)) {
+    status = esp_http_client_get_status_code(client);
+    int r;
+    while (status == 200 && list_len < BATCH_LIST_SIZE - 1 &&
+           (r = esp_http_client_read(client, list.get() + list_len, BATCH_LIST_SIZE - 1 - list_len)) > 0)
+      list_len += r;
+  }
+  esp_http_client_cleanup(client);
+  list[list_len] = '\0';
+  if (status != 200) {
+    ESP_LOGW(TAG, "Batch request failed (HTTP %d)", status);
+    if (download_success_binary_) download_success_binary_->publish_state(false);
+    if (download_status_text_) download_status_text_->publish_state("batch_failed");
+    return;
+  }
+
+  int listed = 0, cached = 0, wire_bytes = 0;
+  char *save = nullptr;
+  for (char *line = strtok_r(list.get(), "\r\n", &save); line != nullptr; line = strtok_r(nullptr, "\r\n", &save)) {
+    const int slot = this->store_.freeSlot(this->cache_.shown_sequence);
+    if (slot < 0) break;
+    listed++;
+    // A partial download kept for resume must not be mixed with this frame
+    if (this->resume_.etag[0] != '\0' && this->resume_.slot == slot) this->clearResume();
+    ESP_LOGI(TAG, "Cache frame %d: %s -> slot %d", listed, line, slot);
+    const SlotFetch fetched = this->fetchToSlot(line, slot, false);
+    wire_bytes += fetched.wire_bytes;
+    if (fetched.write_failed || fetched.expected == 0 || fetched.wire_bytes != fetched.expected ||
+        fetched.written != (fetched.has_header ? (int) FRAME_HEADER_SIZE + FRAME_DATA_SIZE : FRAME_DATA_SIZE) ||
+        !this->store_.commit(slot, fetched.written, this->frame_etag_)) {
+      ESP_LOGW(TAG, "Cache frame %d failed (%d/%d bytes)", listed, fetched.wire_bytes, fetched.expected);
+      break;
+    }
+    cached++;
+  }
+  ESP_LOGI(TAG, "Cached %d of %d frames; %d queued", cached, listed, this->cacheDepth());
+  if (download_bytes_sensor_) download_bytes_sensor_->publish_state(wire_bytes);
+  const bool complete = listed > 0 && cached == listed;
+  if (download_success_binary_) download_success_binary_->publish_state(complete);
+  if (download_status_text_) download_status_text_->publish_state(complete ? "cache_refilled" : "cache_partial");
+  this->publishCacheDepth();
+}
+
+void EPDPhotoFrame::publishCacheDepth() {
+  if (cache_depth_sensor_) cache_depth_sensor_->publish_state(this->cacheDepth());
 }
 
 void EPDPhotoFrame::download_task_trampoline(void *param) {
   auto *self = reinterpret_cast<EPDPhotoFrame *>(param);
+  const uint32_t start_ms = millis();
   self->run_download_task();
+  self->trace_.add(WAKE_PHASE_DOWNLOAD, millis() - start_ms);
+  self->download_active_ = false;
   vTaskDelete(nullptr);
 }
 
 void EPDPhotoFrame::run_download_task() {
-  if (!this->mountSpiffs()) return;
-  const char *path = "/spiffs/image.bin";
-  ESP_LOGI(TAG, "DL task: %s -> %s", this->image_url_.c_str(), path);
-  // Ensure previous file is removed and enough space exists
-  unlink(path);
-  size_t total_bytes = 0, used_bytes = 0;
-  if (esp_spiffs_info(nullptr, &total_bytes, &used_bytes) == ESP_OK) {
-    int expected = (SCREEN_WIDTH * SCREEN_HEIGHT) / 2; // 960000
-    size_t free_bytes = (total_bytes > used_bytes) ? (total_bytes - used_bytes) : 0;
-    if (free_bytes < (size_t) expected + 4096) {
-      ESP_LOGW(TAG, "Not enough SPIFFS space: total=%u used=%u free=%u need~%u", (unsigned) total_bytes, (unsigned) used_bytes, (unsigned) free_bytes, (unsigned) (expected + 4096));
-      ESP_LOGW(TAG, "Formatting SPIFFS to reclaim space (task)...");
-      esp_vfs_spiffs_unregister(nullptr);
-      if (esp_spiffs_format(nullptr) == ESP_OK) {
-        spiffs_mounted_ = false;
-        if (!this->mountSpiffs()) {
-          ESP_LOGE(TAG, "SPIFFS re-mount failed after format (task)");
-          if (download_success_binary_) download_success_binary_->publish_state(false);
-          if (download_status_text_) download_status_text_->publish_state("spiffs_remount_failed");
-          return;
+  if (this->stream_display_) {
+    if (this->streamToDisplay()) return;
+    ESP_LOGW(TAG, "Streaming failed; falling back to stored download");
+    if (download_status_text_) download_status_text_->publish_state("stream_failed");
+  }
+  if (!this->store_.ready()) {
+    if (download_success_binary_) download_success_binary_->publish_state(false);
+    if (download_status_text_) download_status_text_->publish_state("no_frame_store");
+    return;
+  }
+  if (this->resumeDownload()) return;
+  if (this->patchFromManifest()) return;
+  // The slot is only touched once the server sends data, so a 304 keeps the current frame.
+  // With two or more slots the active frame stays intact until the new one is committed, and
+  // like a refill a download never overwrites a cached frame that has not been shown yet.
+  const int slot = this->store_.freeSlot(this->cache_.shown_sequence);
+  if (slot < 0) {
+    ESP_LOGW(TAG, "Every slot holds an unshown frame (%d queued); not downloading", this->cacheDepth());
+    if (download_success_binary_) download_success_binary_->publish_state(false);
+    if (download_status_text_) download_status_text_->publish_state("cache_full");
+    return;
+  }
+  if (this->resume_.etag[0] != '\0' && this->resume_.slot == slot) this->clearResume();
+  ESP_LOGI(TAG, "DL task: %s -> slot %d", this->image_url_.c_str(), slot);
+  const SlotFetch fetched = this->fetchToSlot(this->image_url_.c_str(), slot, true);
+  const int downloaded_total = fetched.wire_bytes;
+  const int expected = fetched.expected;
+  const int written = fetched.written;
+  if (fetched.write_failed) {
+    if (download_success_binary_) download_success_binary_->publish_state(false);
+    if (download_status_text_) download_status_text_->publish_state("store_write_failed");
+    return;
+  }
+  if (expected == 0) {
+    this->reportUnchanged();
+    return;
+  }
+  // download_bytes reports wire bytes; the slot holds the decoded frame
+  ESP_LOGI(TAG, "DL task done (ranged): %d/%d bytes, frame %d bytes", downloaded_total, expected, written);
+  if (download_bytes_sensor_) download_bytes_sensor_->publish_state(downloaded_total);
+  if (downloaded_total != expected) {
+    // Keep what arrived so the next attempt, possibly after deep sleep, only fetches the rest
+    this->saveResume(slot, fetched.has_header ? FRAME_HEADER_SIZE + FRAME_DATA_SIZE : FRAME_DATA_SIZE, written);
+    if (download_success_binary_) download_success_binary_->publish_state(false);
+    if (download_status_text_) download_status_text_->publish_state("chunk_failed");
+  } else if (written != FRAME_DATA_SIZE && written != (int) FRAME_HEADER_SIZE + FRAME_DATA_SIZE) {
+    ESP_LOGE(TAG, "Unexpected frame size %d", written);
+    if (download_success_binary_) download_success_binary_->publish_state(false);
+    if (download_status_text_) download_status_text_->publish_state("bad_size");
+  } else if (!this->store_.commit(slot, written, this->frame_etag_)) {
+    if (download_success_binary_) download_success_binary_->publish_state(false);
+    if (download_status_text_) download_status_text_->publish_state("store_write_failed");
+  } else {
+    this->clearResume();
+    if (download_success_binary_) download_success_binary_->publish_state(true);
+    if (download_status_text_) download_status_text_->publish_state("ok");
+  }
+}
+
+EPDPhotoFrame::SlotFetch EPDPhotoFrame::fetchToSlot(const char *url, int slot, bool conditional) {
+  // Ask for the split layout; the real size (legacy frames have no header) comes from Content-Range
+  SlotFetch result;
+  result.expected = FRAME_HEADER_SIZE + FRAME_DATA_SIZE;
+  bool writing = false;
+  uint8_t magic[sizeof(FRAME_MAGIC)];
+  result.wire_bytes = this->fetchRanges(url, result.expected, conditional, [&](const uint8_t *data, size_t len) {
+    if (!writing) {
+      writing = true;
+      if (!this->store_.invalidate(slot) || !this->store_.beginWrite(slot, 0)) {
+        result.write_failed = true;
+        return false;
+      }
+    }
+    for (size_t i = 0; i < len && result.written + i < sizeof(magic); i++) magic[result.written + i] = data[i];
+    result.written += len;
+    if (!this->store_.write(data, len)) {
+      result.write_failed = true;
+      return false;
+    }
+    return true;
+  });
+  result.has_header = result.written >= (int) sizeof(magic) && memcmp(magic, FRAME_MAGIC, sizeof(magic)) == 0;
+  return result;
+}
+
+void EPDPhotoFrame::saveResume(int slot, int size, int written) {
+  // Without an ETag a later response cannot be matched to these bytes
+  if (this->frame_etag_[0] == '\0' || written < RESUME_CHUNK_SIZE) {
+    this->clearResume();
+    return;
+  }
+  ResumeState state{};
+  memcpy(state.etag, this->frame_etag_, ETAG_MAX_LEN);
+  state.slot = slot;
+  state.size = size;
+  const int complete = std::min(written / RESUME_CHUNK_SIZE, (int) RESUME_MAX_CHUNKS);
+  for (int i = 0; i < complete; i++) state.done |= 1u << i;
+  ESP_LOGI(TAG, "Keeping %d complete chunks of %s in slot %d for resume", complete, state.etag, slot);
+  this->resume_ = state;
+  this->resume_pref_.save(&this->resume_);
+}
+
+void EPDPhotoFrame::clearResume() {
+  if (this->resume_.etag[0] == '\0') return;
+  this->resume_ = ResumeState{};
+  this->resume_pref_.save(&this->resume_);
+}
+
+bool EPDPhotoFrame::resumeDownload() {
+  if (this->resume_.etag[0] == '\0') return false;
+  const int slot = this->resume_.slot;
+  const int size = this->resume_.size;
+  const int chunks = (size + RESUME_CHUNK_SIZE - 1) / RESUME_CHUNK_SIZE;
+  // The partial slot must not have been committed or reused since
+  if (size <= 0 || size > (int) FrameStore::MAX_FRAME_SIZE || chunks > RESUME_MAX_CHUNKS || slot < 0 ||
+      slot >= this->store_.slotCount() || this->store_.record(slot) != nullptr) {
+    this->clearResume();
+    return false;
+  }
+  HttpResponseMeta meta;
+  esp_http_client_handle_t client = this->createClient(this->image_url_.c_str(), &meta);
+  if (client == nullptr) return false;
+  // Bytes kept across a reset are only trusted once they match the manifest's CRCs
+  FrameManifest manifest;
+  if (this->fetchManifest(client, &meta, false, &manifest) != 200 || strcmp(manifest.etag, this->resume_.etag) != 0 ||
+      manifest.size != size) {
+    esp_http_client_cleanup(client);
+    ESP_LOGI(TAG, "Partial frame %s cannot be verified against the server; starting over", this->resume_.etag);
+    this->clearResume();
+    return false;
+  }
+  ESP_LOGI(TAG, "Resuming %s in slot %d: %d of %d chunks present", this->resume_.etag, slot,
+           __builtin_popcount(this->resume_.done), chunks);
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[HTTP_BUFFER_SIZE]);
+  int fetched = 0, requests = 1;
+  bool stale = false, failed = false, verified = false;
+  const uint32_t start_ms = millis();
+  // A chunk failing verification is fetched again once
+  for (int round = 1; round <= 2 && !stale && !failed && !verified; round++) {
+    for (int i = 0; i < chunks && !stale && !failed; i++) {
+      if (this->resume_.done & (1u << i)) continue;
+      const int start = i * RESUME_CHUNK_SIZE;
+      const int len = std::min((int) RESUME_CHUNK_SIZE, size - start);
+      failed = true;
+      for (int attempt = 1; attempt <= 3 && failed && !stale; attempt++) {
+        if (attempt > 1) {
+          vTaskDelay(pdMS_TO_TICKS(std::min(200 << (attempt - 2), 2000)));
+          this->trace_.countRetry();
+        }
+        requests++;
+        // Identity encoding: ranges must address the stored bytes, not the run-length stream
+        if (!this->openRange(client, &meta, start, start + len - 1, false, false)) continue;
+        if (strcmp(meta.etag, this->resume_.etag) != 0) {
+          stale = true;
+          break;
+        }
+        // Chunks start on a sector boundary and the erase stops at the chunk end, so a retry
+        // rewrites exactly this chunk and the chunks after it stay intact
+        int got = 0;
+        bool stored = this->store_.beginWrite(slot, start, len);
+        while (stored && esp_http_client_get_status_code(client) == 206 && got < len) {
+          const int r = esp_http_client_read(client, (char *) buf.get(), std::min(len - got, (int) HTTP_BUFFER_SIZE));
+          if (r <= 0) break;
+          stored = this->store_.write(buf.get(), r);
+          got += r;
+        }
+        if (got < len) esp_http_client_close(client);
+        fetched += got;
+        if (stored && got == len) {
+          failed = false;
+          this->resume_.done |= 1u << i;
+          this->resume_pref_.save(&this->resume_);
+        } else {
+          ESP_LOGW(TAG, "Resume chunk %d incomplete: %d/%d bytes (attempt %d)", i, got, len, attempt);
         }
-      } else {
-        ESP_LOGE(TAG, "SPIFFS format failed (task)");
-        if (download_success_binary_) download_success_binary_->publish_state(false);
-        if (download_status_text_) download_status_text_->publish_state("spiffs_format_failed");
-        return;
       }
     }
+    if (stale || failed) break;
+    // Manifest chunks and resume chunks may differ in size; a bad one drops every resume
+    // chunk it overlaps
+    verified = true;
+    for (int i = 0; i < manifest.chunks; i++) {
+      const int start = i * manifest.chunk;
+      const int len = std::min(manifest.chunk, size - start);
+      uint32_t crc = 0;
+      if (this->store_.checksum(slot, start, len, &crc) && crc == manifest.crcs[i]) continue;
+      ESP_LOGW(TAG, "Resumed chunk at %d does not match the manifest (round %d)", start, round);
+      verified = false;
+      for (int j = start / RESUME_CHUNK_SIZE; j <= (start + len - 1) / RESUME_CHUNK_SIZE; j++)
+        this->resume_.done &= ~(1u << j);
+    }
+    if (!verified) this->resume_pref_.save(&this->resume_);
+  }
+  esp_http_client_cleanup(client);
+  if (stale) {
+    ESP_LOGI(TAG, "Frame changed since the partial download; starting over");
+    this->clearResume();
+    return false;
   }
-  // Ranged download in 100KB chunks with up to 3 retries per chunk
-  const int expected = (SCREEN_WIDTH * SCREEN_HEIGHT) / 2; // 960000
-  const int chunk_size = 100 * 1024;
-  int downloaded_total = 0;
-  // Create/truncate file
-  FILE *fp = fopen(path, "wb");
-  if (fp) fclose(fp);
-  fp = fopen(path, "rb+");
-  if (!fp) {
-    ESP_LOGE(TAG, "open %s failed", path);
+  this->reportThroughput(fetched, millis() - start_ms, requests);
+  if (download_bytes_sensor_) download_bytes_sensor_->publish_state(fetched);
+  // Every chunk arrived under the same ETag and matches the manifest; only the commit makes it
+  // displayable
+  if (!verified || !this->store_.commit(slot, size, this->resume_.etag)) {
     if (download_success_binary_) download_success_binary_->publish_state(false);
-    if (download_status_text_) download_status_text_->publish_state("file_open_failed");
-    return;
+    if (download_status_text_) download_status_text_->publish_state("chunk_failed");
+    return true;
+  }
+  memcpy(this->frame_etag_, this->resume_.etag, ETAG_MAX_LEN);
+  this->clearResume();
+  if (download_success_binary_) download_success_binary_->publish_state(true);
+  if (download_status_text_) download_status_text_->publish_state("ok");
+  return true;
+}
+
+int EPDPhotoFrame::fetchManifest(esp_http_client_handle_t client, HttpResponseMeta *meta, bool conditional,
+                                 FrameManifest *out) {
+  // The manifest lives next to the image: /images/next?x -> /images/next/manifest?x
+  std::string url = this->image_url_;
+  const size_t query = url.find('?');
+  url.insert(query == std::string::npos ? url.size() : query, "/manifest");
+  esp_http_client_set_url(client, url.c_str());
+  const bool opened = this->openRange(client, meta, -1, -1, false, conditional);
+  const int status = opened ? esp_http_client_get_status_code(client) : 0;
+  char text[512];
+  int text_len = 0;
+  if (status == 200) {
+    int r;
+    while (text_len < (int) sizeof(text) - 1 &&
+           (r = esp_http_client_read(client, text + text_len, sizeof(text) - 1 - text_len)) > 0)
+      text_len += r;
+  }
+  // The chunk ranges reuse the manifest's connection
+  if (opened && !esp_http_client_is_complete_data_received(client)) esp_http_client_close(client);
+  esp_http_client_set_url(client, this->image_url_.c_str());
+  if (status != 200) {
+    if (status != 304) ESP_LOGD(TAG, "No manifest (HTTP %d)", status);
+    return status;
+  }
+  text[text_len] = '\0';
+  memcpy(out->etag, meta->etag, ETAG_MAX_LEN);
+
+  // "size <bytes>\nchunk <bytes>\n" followed by one hex CRC32 per chunk
+  int consumed = 0;
+  if (sscanf(text, "size %d chunk %d%n", &out->size, &out->chunk, &consumed) != 2 || out->size <= 0 ||
+      out->chunk <= 0 || out->chunk % FrameStore::SECTOR_SIZE != 0) {
+    ESP_LOGW(TAG, "Malformed manifest");
+    return -1;
+  }
+  out->chunks = (out->size + out->chunk - 1) / out->chunk;
+  if (out->chunks > MANIFEST_MAX_CHUNKS) return -1;
+  char *cursor = text + consumed;
+  for (int i = 0; i < out->chunks; i++) {
+    char *next;
+    out->crcs[i] = strtoul(cursor, &next, 16);
+    if (next == cursor) {
+      ESP_LOGW(TAG, "Manifest lists fewer than %d chunks", out->chunks);
+      return -1;
+    }
+    cursor = next;
+  }
+  return status;
+}
+
+bool EPDPhotoFrame::patchFromManifest() {
+  const int source = this->store_.activeSlot();
+  const FrameStore::SlotRecord *current = this->store_.record(source);
+  if (current == nullptr) return false;
+  const int size = current->size;
+  if (size != FRAME_DATA_SIZE && size != (int) FRAME_HEADER_SIZE + FRAME_DATA_SIZE) return false;
+
+  HttpResponseMeta meta;
+  esp_http_client_handle_t client = this->createClient(this->image_url_.c_str(), &meta);
+  if (client == nullptr) return false;
+  FrameManifest manifest;
+  const int status = this->fetchManifest(client, &meta, true, &manifest);
+  if (status != 200) {
+    esp_http_client_cleanup(client);
+    if (status == 304) {
+      this->reportUnchanged();
+      return true;
+    }
+    return false;
+  }
+  if (manifest.size != size) {
+    ESP_LOGI(TAG, "Frame size changed (%d -> %d); full download", size, manifest.size);
+    esp_http_client_cleanup(client);
+    return false;
   }
-  for (int start = 0; start < expected; start += chunk_size) {
+  const int chunk = manifest.chunk;
+  const int chunks = manifest.chunks;
+  const uint32_t *crcs = manifest.crcs;
+  const char *manifest_etag = manifest.etag;
+
+  const uint8_t *stored = this->store_.map(source);
+  if (stored == nullptr) {
+    esp_http_client_cleanup(client);
+    return false;
+  }
+  bool changed[MANIFEST_MAX_CHUNKS];
+  int patched = 0;
+  for (int i = 0; i < chunks; i++) {
+    changed[i] = esp_crc32_le(0, stored + i * chunk, std::min(chunk, size - i * chunk)) != crcs[i];
+    if (changed[i]) patched++;
+  }
+  // With one slot the chunks are patched in place and the frame is gone until the commit;
+  // otherwise unchanged chunks are copied from the active slot into a free one.
+  const int target = this->store_.freeSlot(this->cache_.shown_sequence);
+  const bool in_place = target == source;
+  if (target >= 0 && this->resume_.etag[0] != '\0' && this->resume_.slot == target) this->clearResume();
+  if (patched == 0 || target < 0 || !this->store_.invalidate(target)) {
+    this->store_.unmap();
+    esp_http_client_cleanup(client);
+    if (patched != 0) return false;
+    // Same pixels under a new ETag; nothing to fetch, but the slot must carry the new ETag so
+    // the refresh and the next wake's If-None-Match use it
+    if (!this->store_.retag(source, manifest_etag)) return false;
+    memcpy(this->frame_etag_, manifest_etag, ETAG_MAX_LEN);
+    if (download_success_binary_) download_success_binary_->publish_state(true);
+    if (download_status_text_) download_status_text_->publish_state("ok");
+    return true;
+  }
+  uint8_t buf[1024];
+  int fetched = 0, requests = 1;
+  const uint32_t start_ms = millis();
+  bool ok = true;
+  for (int i = 0; i < chunks && ok; i++) {
+    const int start = i * chunk;
+    const int len = std::min(chunk, size - start);
+    if (!changed[i]) {
+      if (in_place) continue;
+      // Flash can't be written from a mapped flash source; bounce through RAM
+      ok = this->store_.beginWrite(target, start, len);
+      for (int off = 0; ok && off < len; off += sizeof(buf)) {
+        const int n = std::min<int>(sizeof(buf), len - off);
+        memcpy(buf, stored + start + off, n);
+        ok = this->store_.write(buf, n);
+      }
+      continue;
+    }
+
+    // Fetch the chunk into the target; a retry erases and rewrites it from its first byte
+    ok = false;
+    for (int attempt = 1; attempt <= 3 && !ok; attempt++) {
+      if (attempt > 1) {
+        vTaskDelay(pdMS_TO_TICKS(std::min(200 << (attempt - 2), 2000)));
+        this->trace_.countRetry();
+      }
+      requests++;
+      if (!this->openRange(client, &meta, start, start + len - 1, false, false)) continue;
+      const bool same_frame = meta.etag[0] == '\0' || strcmp(meta.etag, manifest_etag) == 0;
+      int got = 0;
+      uint32_t crc = 0;
+      bool written = this->store_.beginWrite(target, start, len);
+      while (written && same_frame && esp_http_client_get_status_code(client) == 206 && got < len) {
+        const int r = esp_http_client_read(client, (char *) buf, std::min<int>(sizeof(buf), len - got));
+        if (r <= 0) break;
+        written = this->store_.write(buf, r);
+        crc = esp_crc32_le(crc, buf, r);
+        got += r;
+      }
+      if (got < len) esp_http_client_close(client);
+      fetched += got;
+      ok = written && got == len && crc == crcs[i];
+      if (!ok) ESP_LOGW(TAG, "Delta chunk %d failed (attempt %d, %d/%d bytes)", i, attempt, got, len);
+      if (!same_frame) break;
+    }
+  }
+  this->store_.unmap();
+  esp_http_client_cleanup(client);
+  // Read every chunk back before it counts: a bad erase or copy must not become the frame
+  for (int i = 0; i < chunks && ok; i++) {
+    uint32_t crc = 0;
+    const int len = std::min(chunk, size - i * chunk);
+    ok = this->store_.checksum(target, i * chunk, len, &crc) && crc == crcs[i];
+    if (!ok) ESP_LOGW(TAG, "Delta chunk %d does not match the manifest after patching", i);
+  }
+  if (!ok || !this->store_.commit(target, size, manifest_etag)) {
+    // The target slot is left uncommitted; a full download follows
+    return false;
+  }
+  this->reportThroughput(fetched, millis() - start_ms, requests);
+  memcpy(this->frame_etag_, manifest_etag, ETAG_MAX_LEN);
+  ESP_LOGI(TAG, "Delta update: %d/%d chunks patched into slot %d, %d of %d bytes fetched", patched, chunks, target,
+           fetched, size);
+  if (download_bytes_sensor_) download_bytes_sensor_->publish_state(fetched);
+  if (download_success_binary_) download_success_binary_->publish_state(true);
+  if (download_status_text_) download_status_text_->publish_state("ok");
+  return true;
+}
+
+void EPDPhotoFrame::reportUnchanged() {
+  ESP_LOGI(TAG, "Image unchanged (ETag %s); skipping download and refresh", this->displayed_etag_.value);
+  this->frame_unchanged_ = true;
+  if (download_bytes_sensor_) download_bytes_sensor_->publish_state(0);
+  if (download_success_binary_) download_success_binary_->publish_state(true);
+  if (download_status_text_) download_status_text_->publish_state("unchanged");
+}
+
+esp_http_client_handle_t EPDPhotoFrame::createClient(const char *url, HttpResponseMeta *meta) {
+  esp_http_client_config_t cfg = {};
+  cfg.url = url;
+  cfg.timeout_ms = 5000;
+  cfg.method = HTTP_METHOD_GET;
+  cfg.transport_type = HTTP_TRANSPORT_OVER_TCP;
+  cfg.event_handler = http_event_handler;
+  cfg.user_data = meta;
+  // One connection serves every range of the frame
+  cfg.keep_alive_enable = true;
+  cfg.buffer_size = HTTP_BUFFER_SIZE;
+  return esp_http_client_init(&cfg);
+}
+
+bool EPDPhotoFrame::openRange(esp_http_client_handle_t client, HttpResponseMeta *meta, int from, int to,
+                              bool accept_rle, bool conditional) {
+  *meta = HttpResponseMeta{};
+  if (from >= 0) {
+    char range[64];
+    snprintf(range, sizeof(range), "bytes=%d-%d", from, to);
+    esp_http_client_set_header(client, "Range", range);
+  } else {
+    esp_http_client_delete_header(client, "Range");
+  }
+  // Backends that know the panel-native layout send it; static files stay legacy
+  esp_http_client_set_header(client, "X-EPD-Layout", "split");
+  esp_http_client_set_header(client, "Accept-Encoding", accept_rle ? RLE_ENCODING : "identity");
+  if (conditional && this->displayed_etag_.value[0] != '\0') {
+    esp_http_client_set_header(client, "If-None-Match", this->displayed_etag_.value);
+  } else {
+    esp_http_client_delete_header(client, "If-None-Match");
+  }
+  // open() only reconnects when the previous response was not read to the end
+  if (esp_http_client_open(client, 0) != ESP_OK) return false;
+  if (esp_http_client_fetch_headers(client) < 0) {
+    esp_http_client_close(client);
+    return false;
+  }
+  return true;
+}
+
+void EPDPhotoFrame::reportThroughput(int bytes, uint32_t elapsed_ms, int requests) {
+  elapsed_ms = std::max<uint32_t>(1, elapsed_ms);
+  const uint32_t rate = (uint64_t) bytes * 1000 / elapsed_ms;
+  ESP_LOGI(TAG, "Fetched %d bytes in %u ms over %d requests (%u B/s)", bytes, (unsigned) elapsed_ms, requests,
+           (unsigned) rate);
+  if (download_throughput_sensor_) download_throughput_sensor_->publish_state(rate);
+  this->trace_.countRequests(requests, bytes);
+}
+
+int EPDPhotoFrame::fetchRanges(const char *url, int &total, bool conditional,
+                               const std::function<bool(const uint8_t *, size_t)> &on_data) {
+  // Ranged download over one keep-alive connection with up to 3 retries per range. A retry
+  // resumes at the first byte not yet delivered, so on_data always sees the frame strictly in
+  // order. Ranges address the wire bytes; an x-epd-rle response is decoded on the fly.
+  // Range size follows the measured throughput so that each one takes about RANGE_TARGET_MS.
+  int chunk_size = CHUNK_SIZE_INITIAL;
+  int delivered = 0;
+  int requests = 0;
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[HTTP_BUFFER_SIZE]);
+  RleDecoder decoder;
+  int encoded = -1;  // unknown until the first response
+  this->frame_etag_[0] = '\0';
+  HttpResponseMeta meta;
+  esp_http_client_handle_t client = this->createClient(url, &meta);
+  if (client == nullptr) {
+    ESP_LOGW(TAG, "client init failed");
+    return 0;
+  }
+  const uint32_t start_ms = millis();
+  int start = 0;
+  while (start < total) {
     int end = start + chunk_size - 1;
-    if (end >= expected) end = expected - 1;
-    const int need = end - start + 1;
+    if (end >= total) end = total - 1;
+    int pos = start;
     int attempt = 0;
-    bool chunk_ok = false;
-    while (attempt < 3 && !chunk_ok) {
+    const uint32_t range_start_ms = millis();
+    while (attempt < 3 && pos <= end) {
       attempt++;
-      esp_http_client_config_t cfg = {};
-      cfg.url = this->image_url_.c_str();
-      cfg.timeout_ms = 5000;
-      cfg.method = HTTP_METHOD_GET;
-      cfg.transport_type = HTTP_TRANSPORT_OVER_TCP;
-      esp_http_client_handle_t client = esp_http_client_init(&cfg);
-      if (!client) { ESP_LOGW(TAG, "client init failed (chunk %d)", start); break; }
-      char range[64];
-      snprintf(range, sizeof(range), "bytes=%d-%d", start, end);
-      esp_http_client_set_header(client, "Range", range);
-      if (esp_http_client_open(client, 0) != ESP_OK) {
+      if (attempt > 1) {
+        // Back off harder on every retry and keep later ranges short on a flaky link
+        vTaskDelay(pdMS_TO_TICKS(std::min(200 << (attempt - 2), 2000)));
+        chunk_size = std::max(chunk_size / 2, (int) CHUNK_SIZE_MIN);
+        this->trace_.countRetry();
+      }
+      const bool first = pos == 0;
+      requests++;
+      if (!this->openRange(client, &meta, pos, end, true, first && conditional)) {
         ESP_LOGW(TAG, "open failed (chunk %d try %d)", start, attempt);
-        esp_http_client_cleanup(client);
-        vTaskDelay(pdMS_TO_TICKS(50));
         continue;
       }
-      esp_http_client_fetch_headers(client);
-      // Position file and stream
-      fseek(fp, start, SEEK_SET);
-      int got = 0;
-      uint8_t buf[1024];
-      while (got < need) {
-        int to_read = need - got;
-        if (to_read > (int) sizeof(buf)) to_read = sizeof(buf);
-        int r = esp_http_client_read(client, (char *) buf, to_read);
+      if (first && esp_http_client_get_status_code(client) == 304) {
+        esp_http_client_cleanup(client);
+        total = 0;
+        return 0;
+      }
+      if (this->frame_etag_[0] == '\0') {
+        memcpy(this->frame_etag_, meta.etag, ETAG_MAX_LEN);
+      } else if (meta.etag[0] != '\0' && strcmp(meta.etag, this->frame_etag_) != 0) {
+        // Another frame was rendered since the first range; stitching them would mix images
+        ESP_LOGW(TAG, "ETag changed mid-frame (chunk %d)", start);
+        esp_http_client_cleanup(client);
+        return delivered;
+      }
+      if (meta.total > 0 && meta.total != total) {
+        ESP_LOGI(TAG, "Frame size from server: %d bytes", meta.total);
+        total = meta.total;
+        if (end >= total) end = total - 1;
+      }
+      if (encoded < 0) {
+        encoded = meta.rle ? 1 : 0;
+        if (meta.rle) ESP_LOGI(TAG, "Frame is %s encoded", RLE_ENCODING);
+      } else if (encoded != (meta.rle ? 1 : 0)) {
+        // Decoder state only carries over between ranges of the same representation
+        ESP_LOGW(TAG, "Content-Encoding changed mid-frame (chunk %d)", start);
+        esp_http_client_cleanup(client);
+        return delivered;
+      }
+      bool aborted = false;
+      while (pos <= end) {
+        const int to_read = std::min(end - pos + 1, (int) HTTP_BUFFER_SIZE);
+        int r = esp_http_client_read(client, (char *) buf.get(), to_read);
         if (r < 0) { ESP_LOGW(TAG, "read err %d (chunk %d)", r, start); break; }
         if (r == 0) break;
-        fwrite(buf, 1, r, fp);
-        got += r;
-        // Yield so other tasks run
-        vTaskDelay(pdMS_TO_TICKS(1));
+        const bool accepted = encoded ? decoder.feed(buf.get(), r, on_data) : on_data(buf.get(), r);
+        if (!accepted) { aborted = true; break; }
+        pos += r;
+        delivered += r;
+      }
+      if (aborted) {
+        esp_http_client_cleanup(client);
+        return delivered;
       }
-      esp_http_client_close(client);
+      if (pos <= end) {
+        ESP_LOGW(TAG, "chunk %d-%d incomplete at %d (attempt %d)", start, end, pos, attempt);
+        // Drop the connection; the next open reconnects
+        esp_http_client_close(client);
+      }
+    }
+    if (pos <= end) {
       esp_http_client_cleanup(client);
-      if (got == need) {
-        chunk_ok = true;
-        downloaded_total += got;
-      } else {
-        ESP_LOGW(TAG, "chunk %d-%d incomplete got=%d need=%d (attempt %d)", start, end, got, need, attempt);
-        vTaskDelay(pdMS_TO_TICKS(100));
+      return delivered;
+    }
+    if (attempt == 1) {
+      const uint32_t elapsed = std::max<uint32_t>(1, millis() - range_start_ms);
+      const int64_t sized = (int64_t) (end - start + 1) * RANGE_TARGET_MS / elapsed;
+      chunk_size = (int) std::min<int64_t>(std::max<int64_t>(sized, CHUNK_SIZE_MIN), CHUNK_SIZE_MAX);
+    }
+    start = end + 1;
+  }
+  esp_http_client_cleanup(client);
+  this->reportThroughput(delivered, millis() - start_ms, requests);
+  if (!decoder.idle()) ESP_LOGW(TAG, "Encoded frame ends mid-code");
+  return delivered;
+}
+
+bool EPDPhotoFrame::streamToDisplay() {
+  int expected = FRAME_HEADER_SIZE + FRAME_DATA_SIZE;
+  const uint32_t start_ms = millis();
+  ESP_LOGI(TAG, "Stream task: %s -> panel", this->image_url_.c_str());
+  if (!this->beginTransfer()) return false;
+
+  uint8_t header[FRAME_HEADER_SIZE];
+  size_t header_len = 0;
+  TransferBuffer *cur = nullptr;
+  int pos = 0;
+  // In the split layout the master block precedes the slave block, so each controller gets one
+  // DTM transfer, opened with its first pixel byte (a 304 leaves the panel untouched)
+  auto push = [this, &cur, &pos](const uint8_t *data, size_t len) {
+    while (len > 0) {
+      if (cur == nullptr) {
+        cur = this->acquireBuffer();
+        if (cur == nullptr) return false;
+        cur->cs = pos < Panel::MASTER_DATA_SIZE ? this->cs_master_pin_ : this->cs_slave_pin_;
+        cur->open_dtm = pos == 0 || pos == Panel::MASTER_DATA_SIZE;
+      }
+      size_t n = std::min(len, (size_t) (TRANSFER_BUFFER_SIZE - cur->len));
+      if (pos < Panel::MASTER_DATA_SIZE) n = std::min(n, (size_t) (Panel::MASTER_DATA_SIZE - pos));
+      memcpy(cur->data + cur->len, data, n);
+      cur->len += n;
+      pos += n;
+      data += n;
+      len -= n;
+      if (cur->len == TRANSFER_BUFFER_SIZE || pos == Panel::MASTER_DATA_SIZE) {
+        this->submitBuffer(cur);
+        cur = nullptr;
       }
     }
-    if (!chunk_ok) {
-      fclose(fp);
-      if (download_bytes_sensor_) download_bytes_sensor_->publish_state(downloaded_total);
-      if (download_success_binary_) download_success_binary_->publish_state(false);
-      if (download_status_text_) download_status_text_->publish_state("chunk_failed");
-      return;
+    return true;
+  };
+  const int got = this->fetchRanges(this->image_url_.c_str(), expected, true, [&](const uint8_t *data, size_t len) {
+    if (header_len < FRAME_HEADER_SIZE) {
+      const size_t n = std::min(len, FRAME_HEADER_SIZE - header_len);
+      memcpy(header + header_len, data, n);
+      header_len += n;
+      data += n;
+      len -= n;
+      if (header_len < FRAME_HEADER_SIZE) return true;
+      FrameHeader parsed;
+      if (!parse_frame_header(header, sizeof(header), &parsed) || parsed.layout != FRAME_LAYOUT_SPLIT) {
+        // Interleaved rows alternate between the controllers, which would switch CS in the
+        // middle of both DTM transfers; the stored path sends them one controller at a time
+        ESP_LOGW(TAG, "Frame is not in the split layout; not streaming it");
+        return false;
+      }
+      // A frame for another panel must never reach the controllers
+      if (!this->checkFrameHeader(parsed)) return false;
     }
+    return push(data, len);
+  });
+  if (cur != nullptr) this->submitBuffer(cur);
+  this->endTransfer();
+
+  if (expected == 0) {
+    this->reportUnchanged();
+    return true;
   }
-  fclose(fp);
-  ESP_LOGI(TAG, "DL task done (ranged): %d bytes", downloaded_total);
-  if (download_bytes_sensor_) download_bytes_sensor_->publish_state(downloaded_total);
-  if (downloaded_total == expected) {
-    if (download_success_binary_) download_success_binary_->publish_state(true);
-    if (download_status_text_) download_status_text_->publish_state("ok");
-  } else {
-    if (download_success_binary_) download_success_binary_->publish_state(false);
-    if (download_status_text_) download_status_text_->publish_state("incomplete");
+  // expected counts wire bytes, which an x-epd-rle body has fewer of; pos counts the decoded
+  // pixel bytes
+  if (got != expected || pos != FRAME_DATA_SIZE) {
+    ESP_LOGW(TAG, "Stream incomplete: %d/%d bytes", got, expected);
+    if (download_bytes_sensor_) download_bytes_sensor_->publish_state(got);
+    return false;
+  }
+  ESP_LOGI(TAG, "Stream done: %d bytes in %u ms", got, (unsigned) (millis() - start_ms));
+  this->streamed_bytes_ = got;
+  this->stream_refresh_pending_ = true;
+  return true;
+}
+
+bool EPDPhotoFrame::beginTransfer() {
+  for (auto &buf : this->transfer_ring_) {
+    if (buf.data == nullptr) buf.data = static_cast<uint8_t *>(heap_caps_malloc(TRANSFER_BUFFER_SIZE, MALLOC_CAP_DMA));
+    if (buf.data == nullptr) {
+      ESP_LOGE(TAG, "Could not allocate %d byte DMA transfer buffer", TRANSFER_BUFFER_SIZE);
+      // Leave no half-allocated ring behind for the next attempt
+      for (auto &other : this->transfer_ring_) {
+        heap_caps_free(other.data);
+        other.data = nullptr;
+      }
+      return false;
+    }
+  }
+  this->transfer_free_q_ = xQueueCreate(TRANSFER_BUFFER_COUNT, sizeof(TransferBuffer *));
+  this->transfer_full_q_ = xQueueCreate(TRANSFER_BUFFER_COUNT + 1, sizeof(TransferBuffer *));
+  for (auto &buf : this->transfer_ring_) {
+    TransferBuffer *b = &buf;
+    xQueueSend(this->transfer_free_q_, &b, 0);
+  }
+  this->transfer_owner_ = xTaskGetCurrentTaskHandle();
+  this->transfer_bytes_ = 0;
+  this->transfer_start_ms_ = millis();
+  this->transfer_active_ = true;
+  // SPI runs on the app core; a producer on core 0 keeps the radio busy meanwhile
+  xTaskCreatePinnedToCore(&EPDPhotoFrame::transfer_task_trampoline, "epd_tx", 4096, this, 5, nullptr, 1);
+  return true;
+}
+
+EPDPhotoFrame::TransferBuffer *EPDPhotoFrame::acquireBuffer() {
+  TransferBuffer *buf = nullptr;
+  if (xQueueReceive(this->transfer_free_q_, &buf, pdMS_TO_TICKS(10000)) != pdTRUE) {
+    ESP_LOGW(TAG, "Transfer task stalled");
+    return nullptr;
+  }
+  buf->cs = nullptr;
+  buf->len = 0;
+  buf->open_dtm = false;
+  return buf;
+}
+
+void EPDPhotoFrame::submitBuffer(TransferBuffer *buf) { xQueueSend(this->transfer_full_q_, &buf, portMAX_DELAY); }
+
+void EPDPhotoFrame::endTransfer() {
+  // nullptr tells the task to stop once everything queued ahead of it has been sent
+  TransferBuffer *stop = nullptr;
+  xQueueSend(this->transfer_full_q_, &stop, portMAX_DELAY);
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  vQueueDelete(this->transfer_free_q_);
+  vQueueDelete(this->transfer_full_q_);
+  this->transfer_free_q_ = nullptr;
+  this->transfer_full_q_ = nullptr;
+  for (auto &buf : this->transfer_ring_) {
+    heap_caps_free(buf.data);
+    buf.data = nullptr;
   }
+  const uint32_t elapsed = std::max<uint32_t>(1, millis() - this->transfer_start_ms_);
+  ESP_LOGI(TAG, "Transfer: %d bytes in %u ms (%u B/s, SPI %u Hz)", this->transfer_bytes_, (unsigned) elapsed,
+           (unsigned) ((uint64_t) this->transfer_bytes_ * 1000 / elapsed), (unsigned) this->data_rate_);
+  this->transfer_active_ = false;
+}
+
+void EPDPhotoFrame::transfer_task_trampoline(void *param) {
+  auto *self = reinterpret_cast<EPDPhotoFrame *>(param);
+  self->run_transfer_task();
+  xTaskNotifyGive(self->transfer_owner_);
+  vTaskDelete(nullptr);
+}
+
+void EPDPhotoFrame::run_transfer_task() {
+  TransferBuffer *buf = nullptr;
+  while (xQueueReceive(this->transfer_full_q_, &buf, portMAX_DELAY) == pdTRUE) {
+    if (buf == nullptr) break;
+    if (buf->open_dtm) {
+      this->selectController(buf->cs);
+      this->sendCommand(DTM);
+    }
+    if (buf->len > 0) {
+      this->selectController(buf->cs);
+      this->writeDataBlock(buf->data, buf->len);
+      this->transfer_bytes_ += buf->len;
+    }
+    xQueueSend(this->transfer_free_q_, &buf, portMAX_DELAY);
+  }
+  this->selectController(nullptr);
+}
+
+void EPDPhotoFrame::selectController(GPIOPin *cs) {
+  // CS stays asserted across consecutive blocks for the same controller
+  if (cs == this->active_cs_) return;
+  if (this->active_cs_ != nullptr) this->active_cs_->digital_write(true);
+  if (cs != nullptr) cs->digital_write(false);
+  this->active_cs_ = cs;
+}
+
+void EPDPhotoFrame::writeDataBlock(const uint8_t *data, int len) {
+  this->dc_pin_->digital_write(true);
+  this->enable();
+  this->write_array(data, len);
+  this->disable();
 }
 
 void EPDPhotoFrame::dump_config() {
@@ -219,6 +1034,14 @@ void EPDPhotoFrame::dump_config() {
   LOG_PIN("  CS Slave Pin: ", this->cs_slave_pin_);
   ESP_LOGCONFIG(TAG, "  Image URL: %s", this->image_url_.c_str());
   ESP_LOGCONFIG(TAG, "  Update Interval: %d ms", this->update_interval_);
+  ESP_LOGCONFIG(TAG, "  Stream Display: %s", YESNO(this->stream_display_));
+  ESP_LOGCONFIG(TAG, "  SPI Data Rate: %u Hz", (unsigned) this->data_rate_);
+  if (this->store_.ready()) {
+    ESP_LOGCONFIG(TAG, "  Frame Store: partition '%s', %d slot(s), active %d", this->store_.partition()->label,
+                  this->store_.slotCount(), this->store_.activeSlot());
+  }
+  ESP_LOGCONFIG(TAG, "  Cached Frames: %d", this->cacheDepth());
+  ESP_LOGCONFIG(TAG, "  Displayed ETag: %s", this->displayed_etag_.value[0] ? this->displayed_etag_.value : "(none)");
 }
 
 void EPDPhotoFrame::update() {
@@ -226,9 +1049,43 @@ void EPDPhotoFrame::update() {
 }
 
 void EPDPhotoFrame::loop() {
-  // Handle any ongoing operations
+  if (this->stream_refresh_pending_) {
+    this->stream_refresh_pending_ = false;
+    ESP_LOGI(TAG, "Streamed frame loaded %u ms after wake; refreshing", (unsigned) millis());
+    memcpy(this->panel_etag_, this->frame_etag_, ETAG_MAX_LEN);
+    this->panel_sequence_ = 0;
+    this->startRefresh();
+    this->frame_streamed_ = true;
+    if (download_bytes_sensor_) download_bytes_sensor_->publish_state(this->streamed_bytes_);
+    if (download_success_binary_) download_success_binary_->publish_state(true);
+    if (download_status_text_) download_status_text_->publish_state("streamed");
+  }
+  if (this->refresh_state_ != REFRESH_IDLE) this->advanceRefresh();
+  this->traceLoop();
+}
+
+void EPDPhotoFrame::traceLoop() {
+  const uint32_t now = millis();
+  if (!this->trace_.marked(WAKE_PHASE_WIFI) && network::is_connected()) this->trace_.mark(WAKE_PHASE_WIFI, now);
+  if (this->trace_.marked(WAKE_PHASE_API) || !api_is_connected()) return;
+  this->trace_.mark(WAKE_PHASE_API, now);
+  // Earlier wakes go out one per second now that Home Assistant is listening
+  if (this->wake_trace_text_ == nullptr) return;
+  this->set_interval("wake_trace", 1000, [this]() {
+    const WakeTrace::Record *record = this->trace_.nextUnpublished();
+    if (record == nullptr) {
+      this->cancel_interval("wake_trace");
+      return;
+    }
+    char json[256];
+    WakeTrace::toJson(*record, json, sizeof(json));
+    this->wake_trace_text_->publish_state(json);
+    this->trace_.markPublished(record);
+  });
 }
 
+void EPDPhotoFrame::on_shutdown() { this->trace_.finish(millis()); }
+
 
 void EPDPhotoFrame::initDisplay() {
   ESP_LOGI(TAG, "Initializing EPD display...");
@@ -248,95 +1105,14 @@ void EPDPhotoFrame::initDisplay() {
   // Ensure power enabled as in original
   this->power_pin_->digital_write(true);
 
-  // Data tables from original firmware
-  const uint8_t AN_TM_V[] = {0xC0, 0x1C, 0x1C, 0xCC, 0xCC, 0xCC, 0x15, 0x15, 0x55};
-  const uint8_t CMD66_V[] = {0x49, 0x55, 0x13, 0x5D, 0x05, 0x10};
-  const uint8_t PSR_V[] = {0xDF, 0x69};
-  const uint8_t CDI_VV[] = {0xF7};
-  const uint8_t TCON_VV[] = {0x03, 0x03};
-  const uint8_t AGID_VV[] = {0x10};
-  const uint8_t PWS_VV[] = {0x22};
-  const uint8_t CCSET_VV[] = {0x01};
-  const uint8_t TRES_VV[] = {0x04, 0xB0, 0x03, 0x20};
-  const uint8_t PWR_VV[] = {0x0F, 0x00, 0x28, 0x2C, 0x28, 0x38};
-  const uint8_t EN_BUF_VV[] = {0x07};
-  const uint8_t BTST_P_VV[] = {0xE8, 0x28};
-  const uint8_t BOOST_VDDP_EN_VV[] = {0x01};
-  const uint8_t BTST_N_VV[] = {0xE8, 0x28};
-  const uint8_t BUCK_BOOST_VDDN_VV[] = {0x01};
-  const uint8_t TFT_VCOM_POWER_VV[] = {0x02};
-
-  // Helper to send command + buffer under both CS or specific
-  auto send_buf = [this](uint8_t cmd, const uint8_t *buf, size_t len) {
-    this->sendCommand(cmd);
-    for (size_t i = 0; i < len; i++) this->sendData(buf[i]);
-  };
-
-  // Sequence
-  this->cs_master_pin_->digital_write(false);
-  send_buf(AN_TM, AN_TM_V, sizeof(AN_TM_V));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, false);
-  send_buf(CMD66, CMD66_V, sizeof(CMD66_V));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, false);
-  send_buf(PSR, PSR_V, sizeof(PSR_V));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, false);
-  send_buf(CDI, CDI_VV, sizeof(CDI_VV));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, false);
-  send_buf(TCON, TCON_VV, sizeof(TCON_VV));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, false);
-  send_buf(AGID, AGID_VV, sizeof(AGID_VV));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, false);
-  send_buf(PWS, PWS_VV, sizeof(PWS_VV));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, false);
-  send_buf(CCSET, CCSET_VV, sizeof(CCSET_VV));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, false);
-  send_buf(TRES, TRES_VV, sizeof(TRES_VV));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-
-  this->cs_master_pin_->digital_write(false);
-  send_buf(PWR_EPD, PWR_VV, sizeof(PWR_VV));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-
-  this->cs_master_pin_->digital_write(false);
-  send_buf(EN_BUF, EN_BUF_VV, sizeof(EN_BUF_VV));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-
-  this->cs_master_pin_->digital_write(false);
-  send_buf(BTST_P, BTST_P_VV, sizeof(BTST_P_VV));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-
-  this->cs_master_pin_->digital_write(false);
-  send_buf(BOOST_VDDP_EN, BOOST_VDDP_EN_VV, sizeof(BOOST_VDDP_EN_VV));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-
-  this->cs_master_pin_->digital_write(false);
-  send_buf(BTST_N, BTST_N_VV, sizeof(BTST_N_VV));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-
-  this->cs_master_pin_->digital_write(false);
-  send_buf(BUCK_BOOST_VDDN, BUCK_BOOST_VDDN_VV, sizeof(BUCK_BOOST_VDDN_VV));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
+  // Replay the init table: one DC switch and one parameter transaction per command
+  for (const InitCommand &entry : Panel::INIT_SEQUENCE) {
+    this->cs_master_pin_->digital_write(false);
+    if (entry.target == INIT_TARGET_BOTH) this->cs_slave_pin_->digital_write(false);
+    this->writeCommand(entry.command, entry.params, entry.len);
+    cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
+  }
 
-  this->cs_master_pin_->digital_write(false);
-  send_buf(TFT_VCOM_POWER, TFT_VCOM_POWER_VV, sizeof(TFT_VCOM_POWER_VV));
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-  
   this->display_initialized_ = true;
   ESP_LOGI(TAG, "EPD display initialized");
 }
@@ -348,41 +1124,102 @@ void EPDPhotoFrame::sendCommand(uint8_t command) {
   this->disable();
 }
 
-void EPDPhotoFrame::sendData(uint8_t data) {
+void EPDPhotoFrame::writeCommand(uint8_t command, const uint8_t *params, size_t len) {
+  this->sendCommand(command);
+  if (len == 0) return;
   this->dc_pin_->digital_write(true);
   this->enable();
-  this->write_byte(data);
+  this->write_array(params, len);
   this->disable();
 }
 
-void EPDPhotoFrame::turnOnDisplay() {
+bool EPDPhotoFrame::startRefresh() {
+  if (this->refresh_state_ != REFRESH_IDLE) {
+    ESP_LOGW(TAG, "Refresh already in progress");
+    return false;
+  }
   ESP_LOGI(TAG, "Turning on display (PON -> DRF -> POF)...");
-
-  // POWER_ON
+  this->refresh_start_ms_ = millis();
+  this->refresh_timed_out_ = false;
+  // POWER_ON; loop() advances through the remaining phases as BUSY releases
   cs_all(this->cs_master_pin_, this->cs_slave_pin_, false);
   this->sendCommand(PON);
   cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-  this->waitForBusy();
+  this->enterRefreshPhase(REFRESH_POWER_ON);
+  return true;
+}
 
-  // Display Refresh
-  delay(50);
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, false);
-  this->sendCommand(DRF);
-  // Match reference: DRF takes a single 0x00 parameter
-  this->sendData(0x00);
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-  this->waitForBusy();
+void EPDPhotoFrame::enterRefreshPhase(RefreshState state) {
+  this->refresh_state_ = state;
+  this->refresh_phase_start_ms_ = millis();
+  this->busy_idle_since_ms_ = 0;
+}
 
-  // POWER_OFF
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, false);
-  this->sendCommand(POF);
-  // Match reference: POF takes a single 0x00 parameter
-  this->sendData(0x00);
-  cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
-  // Reference waits for busy release after POF as well
-  this->waitForBusy();
+void EPDPhotoFrame::advanceRefresh() {
+  const uint32_t now = millis();
+  if (this->refresh_state_ == REFRESH_SETTLE) {
+    if (now - this->refresh_phase_start_ms_ < 50) return;
+    // Display Refresh; match reference: DRF takes a single 0x00 parameter
+    cs_all(this->cs_master_pin_, this->cs_slave_pin_, false);
+    this->writeCommand(DRF, ZERO_PARAM, sizeof(ZERO_PARAM));
+    cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
+    this->enterRefreshPhase(REFRESH_DRF);
+    return;
+  }
 
-  ESP_LOGI(TAG, "Display update complete");
+  // Original firmware: LOW = busy, HIGH = idle. Require 20 ms of idle before moving on.
+  if (!this->busy_pin_->digital_read()) {
+    this->busy_idle_since_ms_ = 0;
+    if (now - this->refresh_phase_start_ms_ <= BUSY_TIMEOUT_MS) return;
+    ESP_LOGW(TAG, "Busy wait timed out after %u ms; proceeding", (unsigned) BUSY_TIMEOUT_MS);
+    this->refresh_timed_out_ = true;
+    this->trace_.countBusyTimeout();
+  } else {
+    if (this->busy_idle_since_ms_ == 0) this->busy_idle_since_ms_ = now | 1;
+    if (now - this->busy_idle_since_ms_ < 20) return;
+  }
+  ESP_LOGD(TAG, "Refresh phase %u done after %u ms", this->refresh_state_,
+           (unsigned) (now - this->refresh_phase_start_ms_));
+  this->trace_.add(this->refresh_state_ == REFRESH_DRF         ? WAKE_PHASE_REFRESH
+                   : this->refresh_state_ == REFRESH_POWER_OFF ? WAKE_PHASE_POWER_OFF
+                                                               : WAKE_PHASE_POWER_ON,
+                   now - this->refresh_phase_start_ms_);
+
+  switch (this->refresh_state_) {
+    case REFRESH_POWER_ON:
+      this->enterRefreshPhase(REFRESH_SETTLE);
+      break;
+    case REFRESH_DRF:
+      // POWER_OFF; match reference: POF takes a single 0x00 parameter and also signals BUSY
+      cs_all(this->cs_master_pin_, this->cs_slave_pin_, false);
+      this->writeCommand(POF, ZERO_PARAM, sizeof(ZERO_PARAM));
+      cs_all(this->cs_master_pin_, this->cs_slave_pin_, true);
+      this->enterRefreshPhase(REFRESH_POWER_OFF);
+      break;
+    case REFRESH_POWER_OFF:
+    default: {
+      this->refresh_state_ = REFRESH_IDLE;
+      const bool success = !this->refresh_timed_out_;
+      ESP_LOGI(TAG, "Display update complete in %u ms%s", (unsigned) (now - this->refresh_start_ms_),
+               success ? "" : " (busy timeout)");
+      // Remember what the panel now shows; after a timeout nothing is assumed
+      StoredEtag shown{};
+      if (success) memcpy(shown.value, this->panel_etag_, ETAG_MAX_LEN);
+      if (strcmp(shown.value, this->displayed_etag_.value) != 0) {
+        this->displayed_etag_ = shown;
+        this->etag_pref_.save(&this->displayed_etag_);
+      }
+      // The frame counts as shown even after a timeout; otherwise its slot stays pinned and,
+      // with a single slot, every later download would report cache_full
+      if (this->panel_sequence_ > this->cache_.shown_sequence) {
+        this->cache_.shown_sequence = this->panel_sequence_;
+        this->cache_pref_.save(&this->cache_);
+        this->publishCacheDepth();
+      }
+      this->refresh_complete_callback_.call(success);
+      break;
+    }
+  }
 }
 
 void EPDPhotoFrame::waitForBusy() {
@@ -392,8 +1229,8 @@ void EPDPhotoFrame::waitForBusy() {
   while (!this->busy_pin_->digital_read()) {
     App.feed_wdt();
     delay(10);
-    if (millis() - start_ms > 60000) {  // 60s timeout to avoid WDT reset
-      ESP_LOGW(TAG, "Busy wait timed out after 60000 ms; proceeding");
+    if (millis() - start_ms > BUSY_TIMEOUT_MS) {  // timeout to avoid WDT reset
+      ESP_LOGW(TAG, "Busy wait timed out after %u ms; proceeding", (unsigned) BUSY_TIMEOUT_MS);
       break;
     }
   }
@@ -423,6 +1260,10 @@ void EPDPhotoFrame::powerOff() {
 // clearDisplay removed; not used in current flow
 
 void EPDPhotoFrame::sleepDisplay() {
+  if (this->refresh_state_ != REFRESH_IDLE) {
+    ESP_LOGW(TAG, "Refresh in progress; not putting display to sleep");
+    return;
+  }
   ESP_LOGI(TAG, "Putting display to sleep...");
   this->sendCommand(POF);
   this->waitForBusy();
@@ -435,95 +1276,172 @@ void EPDPhotoFrame::setImageUrl(const std::string &url) {
 }
 
 void EPDPhotoFrame::draw_absolute_pixel_internal(int x, int y, Color color) {
-  // Minimal implementation to satisfy abstract base; not used by our raw transfer
+  // Pixels outside the band being rendered are dropped; the lambda runs again for every band
+  this->overlay_.set(x, y, Panel::nearest_color(color.r, color.g, color.b));
 }
 
-display::DisplayType EPDPhotoFrame::get_display_type() {
-  return display::DISPLAY_TYPE_BINARY; // placeholder
+void EPDPhotoFrame::fill(Color color) {
+  if (color.is_on()) {
+    this->overlay_.fill(Panel::nearest_color(color.r, color.g, color.b));
+  } else {
+    this->overlay_.clear();
+  }
 }
 
+display::DisplayType EPDPhotoFrame::get_display_type() { return display::DISPLAY_TYPE_COLOR; }
+
+void EPDPhotoFrame::renderOverlayBand(int y0, int rows) {
+  this->overlay_.begin(y0, rows);
+  // Unrotated, the band is also the clipping rectangle, so primitives skip the other rows early
+  if (this->rotation_ == display::DISPLAY_ROTATION_0_DEGREES)
+    this->start_clipping(display::Rect(0, y0, SCREEN_WIDTH, rows));
+  this->do_update_();
+}
+
+
 
+bool EPDPhotoFrame::checkFrameHeader(const FrameHeader &header) {
+  if (header.width != SCREEN_WIDTH || header.height != SCREEN_HEIGHT || header.bpp != Panel::BPP ||
+      header.controllers != Panel::CONTROLLERS || header.data_size != (uint32_t) FRAME_DATA_SIZE) {
+    ESP_LOGE(TAG, "Frame header mismatch: %ux%u bpp=%u controllers=%u size=%u", header.width, header.height,
+             header.bpp, header.controllers, (unsigned) header.data_size);
+    return false;
+  }
+  return true;
+}
 
-bool esphome::epd_photo_frame::EPDPhotoFrame::sendImageDataFromFile(const char *path) {
-  FILE *fp = fopen(path, "rb");
-  if (!fp) {
-    ESP_LOGE("epd_photo_frame", "Failed to open %s", path);
+bool EPDPhotoFrame::sendImageDataFromStore(int slot) {
+  const FrameStore::SlotRecord *rec = this->store_.record(slot);
+  const uint8_t *frame = this->store_.map(slot);
+  if (frame == nullptr) {
+    ESP_LOGE(TAG, "Failed to map slot %d", slot);
     return false;
   }
-  ESP_LOGI("epd_photo_frame", "Sending image from %s", path);
+  ESP_LOGI(TAG, "Sending image from slot %d", slot);
 
-  // Master half
-  ESP_LOGI(TAG, "Master half start");
-  this->cs_master_pin_->digital_write(false);
-  this->sendCommand(DTM);
-  this->dc_pin_->digital_write(true);
-  this->enable();
-  uint8_t row_buf[BYTES_PER_ROW / 2];
-  for (int line = 0; line < SCREEN_HEIGHT; line++) {
-    // Read master half of this row
-    size_t r = fread(row_buf, 1, sizeof(row_buf), fp);
-    if (r != sizeof(row_buf)) {
-      fclose(fp);
-      this->disable();
-      this->cs_master_pin_->digital_write(true);
+  FrameHeader header;
+  int data_offset = 0;
+  bool split = false;
+  if (parse_frame_header(frame, rec->size, &header)) {
+    if (!this->checkFrameHeader(header)) {
+      this->store_.unmap();
       return false;
     }
-    this->write_array(row_buf, sizeof(row_buf));
-    // Discard slave half of this row to maintain alignment
-    if (fread(row_buf, 1, sizeof(row_buf), fp) != sizeof(row_buf)) {
-      fclose(fp);
-      this->disable();
-      this->cs_master_pin_->digital_write(true);
-      return false;
-    }
-    delay(1);
-    if ((line & 0x1F) == 0) App.feed_wdt();
-    if ((line % 100) == 0) {
-      ESP_LOGI(TAG, "Master row %d/%d", line, SCREEN_HEIGHT);
-    }
+    ESP_LOGI(TAG, "Frame v%u, %s layout", header.version,
+             header.layout == FRAME_LAYOUT_SPLIT ? "split" : "interleaved");
+    data_offset = FRAME_HEADER_SIZE;
+    split = header.layout == FRAME_LAYOUT_SPLIT;
   }
-  this->disable();
-  this->cs_master_pin_->digital_write(true);
-  delay(50);
-
-  // Slave half
-  ESP_LOGI(TAG, "Slave half start");
-  // Restart file from beginning for slave half
-  fseek(fp, 0, SEEK_SET);
-  this->cs_slave_pin_->digital_write(false);
-  this->sendCommand(DTM);
-  this->dc_pin_->digital_write(true);
-  this->enable();
-  for (int line = 0; line < SCREEN_HEIGHT; line++) {
-    // Discard master half of this row
-    if (fread(row_buf, 1, sizeof(row_buf), fp) != sizeof(row_buf)) {
-      fclose(fp);
-      this->disable();
-      this->cs_slave_pin_->digital_write(true);
-      return false;
+  if (rec->size != (uint32_t) (data_offset + FRAME_DATA_SIZE)) {
+    ESP_LOGE(TAG, "Stored frame has %u bytes", (unsigned) rec->size);
+    this->store_.unmap();
+    return false;
+  }
+  if (!this->beginTransfer()) {
+    this->store_.unmap();
+    return false;
+  }
+  // Split: the slave block follows the master block. Interleaved (legacy): each pass takes its
+  // half of every row. The SPI DMA can't read mapped flash, so rows are copied into the ring.
+  const uint8_t *data = frame + data_offset;
+  const uint8_t *slave = split ? data + Panel::MASTER_DATA_SIZE : data + Panel::MASTER_BYTES_PER_ROW;
+  bool ok = true;
+  bool overlay = this->hasOverlay();
+  if (overlay && !this->overlay_.allocate(SCREEN_WIDTH, OVERLAY_BAND_ROWS)) {
+    ESP_LOGW(TAG, "No memory for the overlay band; sending the photo alone");
+    overlay = false;
+  }
+  if (overlay) {
+    // Each controller gets one DTM transfer, so the bands are rendered twice: once for the
+    // master's columns and once more for the slave's
+    const int master_stride = split ? Panel::MASTER_BYTES_PER_ROW : BYTES_PER_ROW;
+    const int slave_stride = split ? Panel::SLAVE_BYTES_PER_ROW : BYTES_PER_ROW;
+    const uint32_t start_ms = millis();
+    for (GPIOPin *cs : {this->cs_master_pin_, this->cs_slave_pin_}) {
+      const bool master = cs == this->cs_master_pin_;
+      const uint8_t *src = master ? data : slave;
+      const int stride = master ? master_stride : slave_stride;
+      for (int y = 0; ok && y < SCREEN_HEIGHT; y += OVERLAY_BAND_ROWS) {
+        const int rows = std::min((int) OVERLAY_BAND_ROWS, SCREEN_HEIGHT - y);
+        const uint32_t band_ms = millis();
+        this->renderOverlayBand(y, rows);
+        this->trace_.add(WAKE_PHASE_OVERLAY, millis() - band_ms);
+        ok = this->queueRowsFromStore(src + y * stride, stride,
+                                      master ? Panel::MASTER_BYTES_PER_ROW : Panel::SLAVE_BYTES_PER_ROW, y, rows, cs,
+                                      master ? 0 : Panel::MASTER_BYTES_PER_ROW);
+      }
     }
-    // Read and send slave half of this row
-    size_t r = fread(row_buf, 1, sizeof(row_buf), fp);
-    if (r != sizeof(row_buf)) {
-      fclose(fp);
-      this->disable();
-      this->cs_slave_pin_->digital_write(true);
-      return false;
+    this->overlay_.release();
+    ESP_LOGI(TAG, "Overlay composited in %u ms", (unsigned) (millis() - start_ms));
+  } else {
+    const uint32_t master_ms = millis();
+    ok = this->queueHalfFromStore(data, Panel::MASTER_BYTES_PER_ROW, this->cs_master_pin_, !split, "Master");
+    this->trace_.add(WAKE_PHASE_SEND_MASTER, millis() - master_ms);
+    ok = ok && this->queueHalfFromStore(slave, Panel::SLAVE_BYTES_PER_ROW, this->cs_slave_pin_, !split, "Slave");
+  }
+  this->endTransfer();
+  this->trace_.add(WAKE_PHASE_SEND, millis() - this->transfer_start_ms_);
+  this->store_.unmap();
+  if (ok) ESP_LOGI(TAG, "Image data sent from flash");
+  return ok;
+}
+
+bool EPDPhotoFrame::queueHalfFromStore(const uint8_t *src, int half_row, GPIOPin *cs, bool interleaved,
+                                       const char *label) {
+  ESP_LOGI(TAG, "%s half start", label);
+  const int half_size = half_row * SCREEN_HEIGHT;
+  int queued = 0;
+  while (queued < half_size) {
+    TransferBuffer *buf = this->acquireBuffer();
+    if (buf == nullptr) return false;
+    buf->cs = cs;
+    buf->open_dtm = queued == 0;
+    int n = 0;
+    if (interleaved) {
+      while (n + half_row <= TRANSFER_BUFFER_SIZE && queued + n < half_size) {
+        memcpy(buf->data + n, src, half_row);
+        src += BYTES_PER_ROW;
+        n += half_row;
+      }
+    } else {
+      n = std::min((int) TRANSFER_BUFFER_SIZE, half_size - queued);
+      memcpy(buf->data, src, n);
+      src += n;
     }
-    this->write_array(row_buf, sizeof(row_buf));
-    delay(1);
-    if ((line & 0x1F) == 0) App.feed_wdt();
-    if ((line % 100) == 0) {
-      ESP_LOGI(TAG, "Slave row %d/%d", line, SCREEN_HEIGHT);
+    buf->len = n;
+    this->submitBuffer(buf);
+    const int prev_rows = queued / half_row;
+    queued += n;
+    App.feed_wdt();
+    if (prev_rows / 400 != (queued / half_row) / 400) {
+      ESP_LOGI(TAG, "%s row %d/%d", label, queued / half_row, SCREEN_HEIGHT);
     }
   }
-  this->disable();
-  this->cs_slave_pin_->digital_write(true);
-  fclose(fp);
-  ESP_LOGI("epd_photo_frame", "Image data sent from file");
   return true;
 }
 
+bool EPDPhotoFrame::queueRowsFromStore(const uint8_t *src, int stride, int half_row, int row, int rows, GPIOPin *cs,
+                                       int byte_x) {
+  int done = 0;
+  while (done < rows) {
+    TransferBuffer *buf = this->acquireBuffer();
+    if (buf == nullptr) return false;
+    buf->cs = cs;
+    buf->open_dtm = row + done == 0;
+    int n = 0;
+    while (n + half_row <= TRANSFER_BUFFER_SIZE && done < rows) {
+      memcpy(buf->data + n, src, half_row);
+      this->overlay_.composite(row + done, byte_x, buf->data + n, half_row);
+      src += stride;
+      n += half_row;
+      done++;
+    }
+    buf->len = n;
+    this->submitBuffer(buf);
+  }
+  App.feed_wdt();
+  return true;
+}
 
 }  // namespace epd_photo_frame
 }  // namespace esphome
@@ -9,19 +9,28 @@
 #include "esphome/components/text_sensor/text_sensor.h"
 #include <stdio.h>
 #include <string>
+#include <functional>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include <esp_http_client.h>
 #include "esphome/core/gpio.h"
 #include "esphome/core/helpers.h"
 #include "esphome/core/log.h"
+#include "esphome/core/preferences.h"
 #include "esphome/core/time.h"
-// Networking and HTTP client functionality is intentionally not used directly here
-// to keep the component self-contained for compilation. Image download can be
-// implemented via automations or future integrations.
+#include "frame_codec.h"
+#include "frame_format.h"
+#include "frame_overlay.h"
+#include "frame_store.h"
+#include "panel_traits.h"
+#include "wake_trace.h"
 
 namespace esphome {
 namespace epd_photo_frame {
 
+struct HttpResponseMeta;
+
 class EPDPhotoFrame : public display::DisplayBuffer, public spi::SPIDevice<spi::BIT_ORDER_MSB_FIRST, spi::CLOCK_POLARITY_LOW, spi::CLOCK_PHASE_LEADING, spi::DATA_RATE_2MHZ> {
  public:
   void set_reset_pin(GPIOPin *reset_pin) { reset_pin_ = reset_pin; }
@@ -32,28 +41,48 @@ class EPDPhotoFrame : public display::DisplayBuffer, public spi::SPIDevice<spi::
   void set_cs_slave_pin(GPIOPin *cs_slave_pin) { cs_slave_pin_ = cs_slave_pin; }
   void set_image_url(const std::string &image_url) { image_url_ = image_url; }
   void set_update_interval(uint32_t update_interval) { update_interval_ = update_interval; }
+  void set_stream_display(bool stream_display) { stream_display_ = stream_display; }
   void assign_spi_parent(spi::SPIComponent *parent) { this->set_spi_parent(parent); }
 
   // Optional HA entities for reporting download results
   void set_download_bytes_sensor(sensor::Sensor *s) { download_bytes_sensor_ = s; }
   void set_download_success_binary(binary_sensor::BinarySensor *b) { download_success_binary_ = b; }
   void set_download_status_text(text_sensor::TextSensor *t) { download_status_text_ = t; }
+  void set_download_throughput_sensor(sensor::Sensor *s) { download_throughput_sensor_ = s; }
+  void set_cache_depth_sensor(sensor::Sensor *s) { cache_depth_sensor_ = s; }
+  // JSON timing breakdown of earlier wakes, published once the API is connected
+  void set_wake_trace_text(text_sensor::TextSensor *t) { wake_trace_text_ = t; }
 
   void setup() override;
   void dump_config() override;
   void update() override;
   void loop() override;
+  void on_shutdown() override;
 
   // Display buffer interface
-  int get_width_internal() override { return 1200; }
-  int get_height_internal() override { return 1600; }
+  int get_width_internal() override { return SCREEN_WIDTH; }
+  int get_height_internal() override { return SCREEN_HEIGHT; }
   void draw_absolute_pixel_internal(int x, int y, Color color) override;
   display::DisplayType get_display_type() override;
+  // Only the current overlay band is filled; clear() (COLOR_OFF) lets the photo show through
+  void fill(Color color) override;
 
   // Custom methods
   void sleepDisplay();
   void startDownload();
   void displayFromFile();
+  // Non-blocking PON -> DRF -> POF; loop() follows BUSY and fires the callbacks when done
+  bool startRefresh();
+  bool isRefreshing() const { return refresh_state_ != REFRESH_IDLE; }
+  // Frame cache: refillCache() fetches a batch of upcoming frames into free flash slots in the
+  // background; showNextCached() puts the oldest unshown one on the panel without any network
+  bool showNextCached();
+  void refillCache();
+  int cacheDepth() const { return store_.pendingCount(cache_.shown_sequence); }
+  bool isRefillingCache() const { return cache_refill_active_; }
+  void add_on_refresh_complete_callback(std::function<void(bool)> &&callback) {
+    refresh_complete_callback_.add(std::move(callback));
+  }
   
   // Service calls
   void setImageUrl(const std::string &url);
@@ -62,17 +91,93 @@ class EPDPhotoFrame : public display::DisplayBuffer, public spi::SPIDevice<spi::
  protected:
   // EPD commands
   void sendCommand(uint8_t command);
-  void sendData(uint8_t data);
+  // Command byte followed by all of its parameters in a single data transaction
+  void writeCommand(uint8_t command, const uint8_t *params, size_t len);
   void initDisplay();
-  void turnOnDisplay();
-  
-  // Image handling
-  bool mountSpiffs();
 
+  enum RefreshState : uint8_t {
+    REFRESH_IDLE,
+    REFRESH_POWER_ON,   // PON sent, waiting for BUSY
+    REFRESH_SETTLE,     // short pause before DRF
+    REFRESH_DRF,        // DRF sent, waiting for BUSY (the long Spectra6 refresh)
+    REFRESH_POWER_OFF,  // POF sent, waiting for BUSY
+  };
+  void enterRefreshPhase(RefreshState state);
+  void advanceRefresh();
+  
   // Background download task
   static void download_task_trampoline(void *param);
   void run_download_task();
-  bool sendImageDataFromFile(const char *path);
+  bool sendImageDataFromStore(int slot);
+  // src points at the controller's first half-row (half_row bytes); interleaved rows are
+  // BYTES_PER_ROW apart
+  bool queueHalfFromStore(const uint8_t *src, int half_row, GPIOPin *cs, bool interleaved, const char *label);
+  // Overlay: the display lambda (or page) runs once per band of OVERLAY_BAND_ROWS rows and its
+  // pixels replace the stored ones as the rows are queued. src is the first half-row of `row`.
+  bool hasOverlay() const { return this->writer_.has_value() || this->page_ != nullptr; }
+  void renderOverlayBand(int y0, int rows);
+  bool queueRowsFromStore(const uint8_t *src, int stride, int half_row, int row, int rows, GPIOPin *cs, int byte_x);
+  bool checkFrameHeader(const FrameHeader &header);
+  // Fetch [0, total) with ranged requests; total is updated from Content-Range.
+  // on_data returning false aborts.
+  // When the server answers If-None-Match with 304, total is set to 0 and nothing is delivered.
+  // Only the first request of a conditional fetch carries If-None-Match.
+  int fetchRanges(const char *url, int &total, bool conditional,
+                  const std::function<bool(const uint8_t *, size_t)> &on_data);
+  // Whole frame from url into a flash slot; the slot is erased once the first byte arrives
+  struct SlotFetch {
+    int wire_bytes{0};  // bytes received over HTTP
+    int expected{0};    // wire size from Content-Range, 0 after a 304
+    int written{0};     // decoded bytes stored in the slot
+    bool has_header{false};
+    bool write_failed{false};
+  };
+  SlotFetch fetchToSlot(const char *url, int slot, bool conditional);
+  // Keep-alive client whose responses are described in meta
+  esp_http_client_handle_t createClient(const char *url, HttpResponseMeta *meta);
+  // GET with optional Range [from, to] (from < 0 for the whole body) on the client's connection;
+  // meta is the one given to createClient and headers are fetched on success
+  bool openRange(esp_http_client_handle_t client, HttpResponseMeta *meta, int from, int to, bool accept_rle,
+                 bool conditional);
+  void reportThroughput(int bytes, uint32_t elapsed_ms, int requests);
+  struct FrameManifest;
+  // GET the manifest on the client's connection and leave the client pointed at image_url_.
+  // Returns the HTTP status (200 once parsed, 304 when conditional), -1 for a malformed one.
+  int fetchManifest(esp_http_client_handle_t client, HttpResponseMeta *meta, bool conditional, FrameManifest *out);
+  // Delta update: fetch only the chunks of the stored frame whose CRC32 differs from the
+  // server's manifest. Returns false when a full download is needed instead.
+  bool patchFromManifest();
+  // Resume a partial slot left by an earlier attempt; the chunks are checked against the
+  // manifest before the commit. Returns false when there is nothing to resume, the server now
+  // serves another frame or the partial frame cannot be verified.
+  bool resumeDownload();
+  void saveResume(int slot, int size, int written);
+  void clearResume();
+  void reportUnchanged();
+  static void refill_task_trampoline(void *param);
+  void run_refill_task();
+  void publishCacheDepth();
+  void traceLoop();
+
+  // Streaming display: a split-layout download feeds the master's DTM and then the slave's, the
+  // frame store is only the fallback
+  bool streamToDisplay();
+
+  // Transfer engine: producers fill a ring of DMA-capable buffers that the epd_tx task sends
+  struct TransferBuffer {
+    GPIOPin *cs;    // controller to write to
+    int len;
+    bool open_dtm;  // start a DTM transfer on cs before the data
+    uint8_t *data;
+  };
+  bool beginTransfer();
+  TransferBuffer *acquireBuffer();
+  void submitBuffer(TransferBuffer *buf);
+  void endTransfer();
+  static void transfer_task_trampoline(void *param);
+  void run_transfer_task();
+  void selectController(GPIOPin *cs);
+  void writeDataBlock(const uint8_t *data, int len);
   
   // Helper methods
   void waitForBusy();
@@ -89,40 +194,106 @@ class EPDPhotoFrame : public display::DisplayBuffer, public spi::SPIDevice<spi::
   
   std::string image_url_;
   uint32_t update_interval_{1800000}; // 30 minutes default
-  bool spiffs_mounted_{false};
+  FrameStore store_;
+  OverlayBand overlay_;
+  WakeTrace trace_;
   
   bool display_initialized_{false};
+
+  bool stream_display_{false};
+  // Set by the download task, consumed by loop() which runs the refresh on the main task
+  volatile bool stream_refresh_pending_{false};
+  volatile bool transfer_active_{false};
+  volatile bool cache_refill_active_{false};
+  volatile bool download_active_{false};
+  bool frame_streamed_{false};
+  bool frame_unchanged_{false};
+
+  // ETag of the image on the panel, kept in NVS so an unchanged image skips download and refresh
+  struct StoredEtag {
+    char value[ETAG_MAX_LEN];
+  };
+  ESPPreferenceObject etag_pref_;
+  StoredEtag displayed_etag_{};
+  char frame_etag_[ETAG_MAX_LEN]{};  // last downloaded frame, set by the download task
+  char panel_etag_[ETAG_MAX_LEN]{};  // frame loaded into controller RAM, saved once refreshed
+
+  // Partial download kept in an uncommitted slot, persisted in NVS across resets and deep sleep
+  struct ResumeState {
+    char etag[ETAG_MAX_LEN];  // empty when no partial frame is stored
+    int32_t slot;
+    int32_t size;             // size of the complete (decoded) frame
+    uint32_t done;            // bit i: RESUME_CHUNK_SIZE chunk i is complete in the file
+  };
+  ESPPreferenceObject resume_pref_;
+  ResumeState resume_{};
+
+  // Sequence of the last stored frame refreshed onto the panel; newer slots are the cache queue
+  struct CacheState {
+    uint32_t shown_sequence;
+  };
+  ESPPreferenceObject cache_pref_;
+  CacheState cache_{};
+  uint32_t panel_sequence_{0};  // slot sequence loaded into controller RAM, 0 for a streamed frame
+
+  RefreshState refresh_state_{REFRESH_IDLE};
+  uint32_t refresh_start_ms_{0};
+  uint32_t refresh_phase_start_ms_{0};
+  uint32_t busy_idle_since_ms_{0};
+  bool refresh_timed_out_{false};
+  CallbackManager<void(bool)> refresh_complete_callback_;
+  int streamed_bytes_{0};
+
+  QueueHandle_t transfer_free_q_{nullptr};
+  QueueHandle_t transfer_full_q_{nullptr};
+  TaskHandle_t transfer_owner_{nullptr};
+  GPIOPin *active_cs_{nullptr};
+  int transfer_bytes_{0};
+  uint32_t transfer_start_ms_{0};
   
   // Optional entities
   sensor::Sensor *download_bytes_sensor_{nullptr};
   binary_sensor::BinarySensor *download_success_binary_{nullptr};
   text_sensor::TextSensor *download_status_text_{nullptr};
+  sensor::Sensor *download_throughput_sensor_{nullptr};
+  sensor::Sensor *cache_depth_sensor_{nullptr};
+  text_sensor::TextSensor *wake_trace_text_{nullptr};
   
-  static const int SCREEN_WIDTH = 1200;
-  static const int SCREEN_HEIGHT = 1600;
-  static const int BYTES_PER_ROW = 600; // 4bpp
-  
-  // EPD command constants
-  static const uint8_t PSR = 0x00;
-  static const uint8_t PWR_EPD = 0x01;
-  static const uint8_t POF = 0x02;
-  static const uint8_t PON = 0x04;
-  static const uint8_t BTST_N = 0x05;
-  static const uint8_t BTST_P = 0x06;
-  static const uint8_t DTM = 0x10;
-  static const uint8_t DRF = 0x12;
-  static const uint8_t CDI = 0x50;
-  static const uint8_t TCON = 0x60;
-  static const uint8_t TRES = 0x61;
-  static const uint8_t AN_TM = 0x74;
-  static const uint8_t AGID = 0x86;
-  static const uint8_t BUCK_BOOST_VDDN = 0xB0;
-  static const uint8_t TFT_VCOM_POWER = 0xB1;
-  static const uint8_t EN_BUF = 0xB6;
-  static const uint8_t BOOST_VDDP_EN = 0xB7;
-  static const uint8_t CCSET = 0xE0;
-  static const uint8_t PWS = 0xE3;
-  static const uint8_t CMD66 = 0xF0;
+  static const uint32_t BUSY_TIMEOUT_MS = 60000;
+  // Geometry, controller split, init table and palette of the panel; another Waveshare
+  // dual-controller panel is another traits struct in panel_traits.h
+  using Panel = PanelGeometry<Spectra6Panel13in3>;
+  static constexpr int SCREEN_WIDTH = Panel::WIDTH;
+  static constexpr int SCREEN_HEIGHT = Panel::HEIGHT;
+  static constexpr int BYTES_PER_ROW = Panel::BYTES_PER_ROW;
+  static constexpr int FRAME_DATA_SIZE = Panel::FRAME_DATA_SIZE;
+  static_assert(FRAME_HEADER_SIZE + FRAME_DATA_SIZE <= FrameStore::MAX_FRAME_SIZE, "a frame must fit one slot");
+  // One buffer is one DMA transaction (the ESP-IDF SPI master limit is 4092 bytes)
+  static const int TRANSFER_BUFFER_SIZE = 4092;
+  static const int TRANSFER_BUFFER_COUNT = 4;
+  // 32 rows of pixels plus mask is 38 KB; allocated only while a frame is sent
+  static const int OVERLAY_BAND_ROWS = 32;
+  // Range sizing for fetchRanges(): start at 100 KB, then aim for RANGE_TARGET_MS per range
+  static const int CHUNK_SIZE_INITIAL = 100 * 1024;
+  static const int CHUNK_SIZE_MIN = 32 * 1024;
+  static const int CHUNK_SIZE_MAX = 512 * 1024;
+  static const int RANGE_TARGET_MS = 2000;
+  static const int HTTP_BUFFER_SIZE = 4096;
+  static const int RESUME_CHUNK_SIZE = 100 * 1024;
+  static const int RESUME_MAX_CHUNKS = 32;
+  // Chunks a manifest may list; 960 KB in 100 KB chunks needs 10
+  static const int MANIFEST_MAX_CHUNKS = 32;
+  // Per-chunk CRC32s of the frame the server would send next
+  struct FrameManifest {
+    char etag[ETAG_MAX_LEN]{};
+    int size{0};
+    int chunk{0};
+    int chunks{0};
+    uint32_t crcs[MANIFEST_MAX_CHUNKS]{};
+  };
+  // Batch list of one frame URL per line
+  static const int BATCH_LIST_SIZE = 2048;
+  TransferBuffer transfer_ring_[TRANSFER_BUFFER_COUNT]{};
 };
 
 }  // namespace epd_photo_frame
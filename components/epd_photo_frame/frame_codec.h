@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace esphome {
+namespace epd_photo_frame {
+
+// Content-Encoding for the run-length coded wire format served by the backend
+// (server/app/frame_codec.py). Ranges address the encoded byte stream.
+static const char *const RLE_ENCODING = "x-epd-rle";
+static const size_t RLE_MAX_RUN = 130;
+
+// Incremental decoder for x-epd-rle. A control byte c < 0x80 is followed by c + 1 literal
+// bytes; c >= 0x80 is followed by one byte repeated (c & 0x7F) + 3 times. Input may be split
+// anywhere, so ranged chunks and retries can be fed as they arrive.
+class RleDecoder {
+ public:
+  void reset() {
+    this->state_ = STATE_CONTROL;
+    this->remaining_ = 0;
+  }
+  // True between codes, i.e. the input seen so far ends on a complete code
+  bool idle() const { return this->state_ == STATE_CONTROL; }
+
+  // sink(const uint8_t *, size_t) -> bool receives decoded bytes; false aborts decoding
+  template<typename Sink> bool feed(const uint8_t *data, size_t len, Sink &&sink) {
+    while (len > 0) {
+      switch (this->state_) {
+        case STATE_CONTROL: {
+          const uint8_t c = *data++;
+          len--;
+          if (c < 0x80) {
+            this->remaining_ = c + 1;
+            this->state_ = STATE_LITERAL;
+          } else {
+            this->remaining_ = (c & 0x7F) + 3;
+            this->state_ = STATE_RUN;
+          }
+          break;
+        }
+        case STATE_LITERAL: {
+          const size_t n = std::min(len, this->remaining_);
+          if (!sink(data, n))
+            return false;
+          data += n;
+          len -= n;
+          this->remaining_ -= n;
+          if (this->remaining_ == 0)
+            this->state_ = STATE_CONTROL;
+          break;
+        }
+        case STATE_RUN: {
+          uint8_t run[RLE_MAX_RUN];
+          memset(run, *data, this->remaining_);
+          if (!sink(run, this->remaining_))
+            return false;
+          data++;
+          len--;
+          this->state_ = STATE_CONTROL;
+          break;
+        }
+      }
+    }
+    return true;
+  }
+
+ protected:
+  enum State : uint8_t { STATE_CONTROL, STATE_LITERAL, STATE_RUN };
+  State state_{STATE_CONTROL};
+  size_t remaining_{0};
+};
+
+}  // namespace epd_photo_frame
+}  // namespace esphome
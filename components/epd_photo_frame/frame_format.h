@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace esphome {
+namespace epd_photo_frame {
+
+// Versioned frame header written by the backend ahead of the pixel data. Frames without it
+// are the legacy 960,000 byte row-interleaved format and are still accepted.
+static const uint8_t FRAME_MAGIC[4] = {'E', 'P', 'D', 'F'};
+static const uint8_t FRAME_VERSION = 1;
+static const size_t FRAME_HEADER_SIZE = 16;
+
+enum FrameLayout : uint8_t {
+  // Each row carries the master half followed by the slave half
+  FRAME_LAYOUT_INTERLEAVED = 0,
+  // All master half-rows, then all slave half-rows; each controller pass is one sequential read
+  FRAME_LAYOUT_SPLIT = 1,
+};
+
+struct FrameHeader {
+  uint8_t version;
+  FrameLayout layout;
+  uint8_t bpp;
+  uint8_t controllers;
+  uint16_t width;
+  uint16_t height;
+  uint32_t data_size;
+};
+
+// Layout (little endian): magic[4] version layout bpp controllers width:u16 height:u16 data_size:u32
+inline bool parse_frame_header(const uint8_t *buf, size_t len, FrameHeader *out) {
+  if (len < FRAME_HEADER_SIZE || memcmp(buf, FRAME_MAGIC, sizeof(FRAME_MAGIC)) != 0)
+    return false;
+  out->version = buf[4];
+  out->layout = static_cast<FrameLayout>(buf[5]);
+  out->bpp = buf[6];
+  out->controllers = buf[7];
+  out->width = buf[8] | (buf[9] << 8);
+  out->height = buf[10] | (buf[11] << 8);
+  out->data_size = buf[12] | (buf[13] << 8) | (buf[14] << 16) | ((uint32_t) buf[15] << 24);
+  if (out->version != FRAME_VERSION)
+    return false;
+  return out->layout == FRAME_LAYOUT_INTERLEAVED || out->layout == FRAME_LAYOUT_SPLIT;
+}
+
+}  // namespace epd_photo_frame
+}  // namespace esphome
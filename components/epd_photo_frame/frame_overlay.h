@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+
+namespace esphome {
+namespace epd_photo_frame {
+
+// A horizontal band of overlay pixels drawn by the display lambda. The band keeps two packed
+// 4bpp planes in the frame's own row format: the panel colour indices and a mask holding 0xF in every
+// drawn nibble, so compositing onto a stored row is a byte-wise select with no unpacking.
+class OverlayBand {
+ public:
+  bool allocate(int width, int rows) {
+    if (this->pixels_ != nullptr) return true;
+    this->width_ = width;
+    this->row_bytes_ = (width + 1) / 2;
+    this->capacity_ = rows;
+    const size_t size = (size_t) this->row_bytes_ * rows;
+    this->pixels_.reset(new (std::nothrow) uint8_t[size]);
+    this->mask_.reset(new (std::nothrow) uint8_t[size]);
+    if (this->pixels_ == nullptr || this->mask_ == nullptr) {
+      this->release();
+      return false;
+    }
+    return true;
+  }
+  void release() {
+    this->pixels_.reset();
+    this->mask_.reset();
+    this->capacity_ = 0;
+    this->rows_ = 0;
+  }
+
+  // Start a band covering rows [y0, y0 + rows); nothing is drawn yet
+  void begin(int y0, int rows) {
+    this->y0_ = y0;
+    this->rows_ = rows < this->capacity_ ? rows : this->capacity_;
+    this->clear();
+  }
+  bool contains(int y) const { return y >= this->y0_ && y < this->y0_ + this->rows_; }
+
+  // Drop everything drawn so far; the photo shows through again
+  void clear() {
+    if (this->mask_ != nullptr) memset(this->mask_.get(), 0, (size_t) this->row_bytes_ * this->capacity_);
+    this->drawn_ = false;
+  }
+  void fill(uint8_t index) {
+    if (this->pixels_ == nullptr) return;
+    const size_t size = (size_t) this->row_bytes_ * this->capacity_;
+    memset(this->pixels_.get(), (index & 0x0F) * 0x11, size);
+    memset(this->mask_.get(), 0xFF, size);
+    this->drawn_ = true;
+  }
+  void set(int x, int y, uint8_t index) {
+    if (this->pixels_ == nullptr || x < 0 || x >= this->width_ || !this->contains(y)) return;
+    const size_t i = (size_t) (y - this->y0_) * this->row_bytes_ + x / 2;
+    // MS nibble first, as in the frame
+    const uint8_t nibble = (x & 1) ? 0x0F : 0xF0;
+    const uint8_t value = (x & 1) ? (index & 0x0F) : (uint8_t) (index << 4);
+    this->pixels_[i] = (this->pixels_[i] & ~nibble) | value;
+    this->mask_[i] |= nibble;
+    this->drawn_ = true;
+  }
+
+  // Overwrite the drawn pixels of len packed bytes of row y, starting at byte column byte_x
+  void composite(int y, int byte_x, uint8_t *dst, int len) const {
+    if (!this->drawn_ || !this->contains(y)) return;
+    const size_t offset = (size_t) (y - this->y0_) * this->row_bytes_ + byte_x;
+    const uint8_t *pixels = this->pixels_.get() + offset;
+    const uint8_t *mask = this->mask_.get() + offset;
+    for (int i = 0; i < len; i++) dst[i] = (dst[i] & ~mask[i]) | (pixels[i] & mask[i]);
+  }
+
+ protected:
+  std::unique_ptr<uint8_t[]> pixels_;
+  std::unique_ptr<uint8_t[]> mask_;
+  int width_{0};
+  int row_bytes_{0};
+  int capacity_{0};
+  int y0_{0};
+  int rows_{0};
+  bool drawn_{false};
+};
+
+}  // namespace epd_photo_frame
+}  // namespace esphome
@@ -0,0 +1,219 @@
+#include "frame_store.h"
+#include "esphome/core/log.h"
+#include <algorithm>
+#include <cstring>
+#include <esp_crc.h>
+
+namespace esphome {
+namespace epd_photo_frame {
+
+static const char *const TAG = "epd_photo_frame.store";
+
+static const uint32_t SLOT_MAGIC = 0x53445045;  // "EPDS"
+static const uint32_t BLOCK_SIZE = 0x10000;
+
+static uint32_t record_checksum(const FrameStore::SlotRecord &rec) {
+  return esp_crc32_le(0, reinterpret_cast<const uint8_t *>(&rec), offsetof(FrameStore::SlotRecord, record_crc));
+}
+
+bool FrameStore::begin() {
+  this->partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "frames");
+  // Devices flashed with the old table keep their spiffs partition; it is used raw now
+  if (this->partition_ == nullptr)
+    this->partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, nullptr);
+  if (this->partition_ == nullptr) {
+    ESP_LOGE(TAG, "No frames partition");
+    return false;
+  }
+  this->slots_ = std::min<int>(this->partition_->size / SLOT_SIZE, (int) MAX_SLOTS);
+  if (this->slots_ == 0) {
+    ESP_LOGE(TAG, "Partition '%s' (%u bytes) is smaller than one slot", this->partition_->label,
+             (unsigned) this->partition_->size);
+    this->partition_ = nullptr;
+    return false;
+  }
+  this->active_ = -1;
+  for (int i = 0; i < this->slots_; i++) {
+    this->valid_[i] = this->readRecord(i, &this->records_[i]);
+    if (this->valid_[i] && (this->active_ < 0 || this->records_[i].sequence > this->records_[this->active_].sequence))
+      this->active_ = i;
+  }
+  return true;
+}
+
+bool FrameStore::readRecord(int slot, SlotRecord *out) {
+  if (esp_partition_read(this->partition_, this->slotBase(slot), out, sizeof(*out)) != ESP_OK) return false;
+  // A torn record write fails the checksum and the slot simply does not count
+  return out->magic == SLOT_MAGIC && out->size <= MAX_FRAME_SIZE && out->record_crc == record_checksum(*out) &&
+         out->etag[ETAG_MAX_LEN - 1] == '\0';
+}
+
+const FrameStore::SlotRecord *FrameStore::record(int slot) const {
+  if (slot < 0 || slot >= this->slots_ || !this->valid_[slot]) return nullptr;
+  return &this->records_[slot];
+}
+
+int FrameStore::pendingCount(uint32_t shown) const {
+  int count = 0;
+  for (int i = 0; i < this->slots_; i++) {
+    if (this->valid_[i] && this->records_[i].sequence > shown) count++;
+  }
+  return count;
+}
+
+int FrameStore::nextSlotAfter(uint32_t shown) const {
+  int best = -1;
+  for (int i = 0; i < this->slots_; i++) {
+    if (!this->valid_[i] || this->records_[i].sequence <= shown) continue;
+    if (best < 0 || this->records_[i].sequence < this->records_[best].sequence) best = i;
+  }
+  return best;
+}
+
+int FrameStore::freeSlot(uint32_t shown) const {
+  int best = -1;
+  for (int i = 0; i < this->slots_; i++) {
+    if (!this->valid_[i]) return i;
+    const uint32_t seq = this->records_[i].sequence;
+    // The shown frame is kept so displayFromFile() and delta updates still have it
+    if (seq > shown || (seq == shown && this->slots_ > 1)) continue;
+    if (best < 0 || seq < this->records_[best].sequence) best = i;
+  }
+  return best;
+}
+
+int FrameStore::freeCount(uint32_t shown) const {
+  int count = 0;
+  for (int i = 0; i < this->slots_; i++) {
+    if (!this->valid_[i] || this->records_[i].sequence < shown ||
+        (this->records_[i].sequence == shown && this->slots_ == 1))
+      count++;
+  }
+  return count;
+}
+
+bool FrameStore::invalidate(int slot) {
+  if (slot < 0 || slot >= this->slots_) return false;
+  this->valid_[slot] = false;
+  if (this->active_ == slot) this->active_ = -1;
+  return esp_partition_erase_range(this->partition_, this->slotBase(slot), RECORD_SIZE) == ESP_OK;
+}
+
+bool FrameStore::beginWrite(int slot, uint32_t offset, uint32_t length) {
+  if (slot < 0 || slot >= this->slots_ || offset % SECTOR_SIZE != 0 || offset > MAX_FRAME_SIZE) return false;
+  this->write_pos_ = this->slotBase(slot) + RECORD_SIZE + offset;
+  this->erased_end_ = this->write_pos_;
+  this->write_limit_ = this->slotBase(slot) + SLOT_SIZE;
+  // A chunk rewritten in place must not take the neighbouring chunk with a block erase
+  if (length > 0) {
+    const uint32_t end = this->write_pos_ + (length + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+    this->write_limit_ = std::min(this->write_limit_, end);
+  }
+  return true;
+}
+
+bool FrameStore::write(const uint8_t *data, size_t len) {
+  if (this->write_pos_ + len > this->write_limit_) {
+    ESP_LOGE(TAG, "Write of %u bytes at 0x%x runs past 0x%x", (unsigned) len, (unsigned) this->write_pos_,
+             (unsigned) this->write_limit_);
+    return false;
+  }
+  while (this->write_pos_ + len > this->erased_end_) {
+    // Whole 64 KB blocks erase much faster than 16 sectors; spread over the download
+    const uint32_t step =
+        (this->erased_end_ % BLOCK_SIZE == 0 && this->erased_end_ + BLOCK_SIZE <= this->write_limit_) ? BLOCK_SIZE
+                                                                                                       : SECTOR_SIZE;
+    if (esp_partition_erase_range(this->partition_, this->erased_end_, step) != ESP_OK) {
+      ESP_LOGE(TAG, "Erase at 0x%x failed", (unsigned) this->erased_end_);
+      return false;
+    }
+    this->erased_end_ += step;
+  }
+  if (esp_partition_write(this->partition_, this->write_pos_, data, len) != ESP_OK) {
+    ESP_LOGE(TAG, "Write at 0x%x failed", (unsigned) this->write_pos_);
+    return false;
+  }
+  this->write_pos_ += len;
+  return true;
+}
+
+bool FrameStore::checksum(int slot, uint32_t offset, uint32_t len, uint32_t *crc) {
+  if (slot < 0 || slot >= this->slots_ || offset > MAX_FRAME_SIZE || len > MAX_FRAME_SIZE - offset) return false;
+  const void *ptr = nullptr;
+  esp_partition_mmap_handle_t handle;
+  if (esp_partition_mmap(this->partition_, this->slotBase(slot) + RECORD_SIZE + offset, len, ESP_PARTITION_MMAP_DATA,
+                         &ptr, &handle) != ESP_OK)
+    return false;
+  *crc = esp_crc32_le(0, static_cast<const uint8_t *>(ptr), len);
+  esp_partition_munmap(handle);
+  return true;
+}
+
+bool FrameStore::commit(int slot, uint32_t size, const char *etag) {
+  if (slot < 0 || slot >= this->slots_ || size > MAX_FRAME_SIZE) return false;
+  const void *ptr = nullptr;
+  esp_partition_mmap_handle_t handle;
+  if (esp_partition_mmap(this->partition_, this->slotBase(slot) + RECORD_SIZE, size, ESP_PARTITION_MMAP_DATA, &ptr,
+                         &handle) != ESP_OK)
+    return false;
+  SlotRecord rec{};
+  rec.magic = SLOT_MAGIC;
+  rec.size = size;
+  rec.crc = esp_crc32_le(0, static_cast<const uint8_t *>(ptr), size);
+  esp_partition_munmap(handle);
+  rec.sequence = 1;
+  for (int i = 0; i < this->slots_; i++) {
+    if (this->valid_[i] && this->records_[i].sequence >= rec.sequence) rec.sequence = this->records_[i].sequence + 1;
+  }
+  if (etag != nullptr) strncpy(rec.etag, etag, ETAG_MAX_LEN - 1);
+  rec.record_crc = record_checksum(rec);
+  // The record sector was erased by invalidate(); a single program makes the slot count
+  if (esp_partition_write(this->partition_, this->slotBase(slot), &rec, sizeof(rec)) != ESP_OK) return false;
+  this->records_[slot] = rec;
+  this->valid_[slot] = true;
+  this->active_ = slot;
+  ESP_LOGI(TAG, "Committed slot %d: %u bytes, seq %u, crc %08x", slot, (unsigned) size, (unsigned) rec.sequence,
+           (unsigned) rec.crc);
+  return true;
+}
+
+bool FrameStore::retag(int slot, const char *etag) {
+  if (this->record(slot) == nullptr) return false;
+  SlotRecord rec = this->records_[slot];
+  memset(rec.etag, 0, sizeof(rec.etag));
+  if (etag != nullptr) strncpy(rec.etag, etag, ETAG_MAX_LEN - 1);
+  rec.record_crc = record_checksum(rec);
+  // Until the new record is written the slot does not count; a reset then costs a full download
+  this->valid_[slot] = false;
+  if (esp_partition_erase_range(this->partition_, this->slotBase(slot), RECORD_SIZE) != ESP_OK ||
+      esp_partition_write(this->partition_, this->slotBase(slot), &rec, sizeof(rec)) != ESP_OK) {
+    if (this->active_ == slot) this->active_ = -1;
+    return false;
+  }
+  this->records_[slot] = rec;
+  this->valid_[slot] = true;
+  return true;
+}
+
+const uint8_t *FrameStore::map(int slot) {
+  const SlotRecord *rec = this->record(slot);
+  if (rec == nullptr) return nullptr;
+  this->unmap();
+  const void *ptr = nullptr;
+  if (esp_partition_mmap(this->partition_, this->slotBase(slot) + RECORD_SIZE, rec->size, ESP_PARTITION_MMAP_DATA,
+                         &ptr, &this->map_handle_) != ESP_OK) {
+    ESP_LOGE(TAG, "mmap of slot %d failed", slot);
+    return nullptr;
+  }
+  this->mapped_ = true;
+  return static_cast<const uint8_t *>(ptr);
+}
+
+void FrameStore::unmap() {
+  if (!this->mapped_) return;
+  esp_partition_munmap(this->map_handle_);
+  this->mapped_ = false;
+}
+
+}  // namespace epd_photo_frame
+}  // namespace esphome
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <esp_partition.h>
+
+namespace esphome {
+namespace epd_photo_frame {
+
+// Longest ETag kept for change detection; longer ones are treated as absent
+static const size_t ETAG_MAX_LEN = 64;
+
+// Frames kept in raw flash slots of a data partition instead of a filesystem. Each slot is a
+// 4 KB record sector followed by the frame bytes. A slot only counts once its record has been
+// written (the commit), so an interrupted write never replaces the last good frame when the
+// partition has room for two slots. Frames are read back through esp_partition_mmap.
+class FrameStore {
+ public:
+  struct SlotRecord {
+    uint32_t magic;
+    uint32_t sequence;  // higher is newer
+    uint32_t size;      // frame bytes after the record sector
+    uint32_t crc;       // CRC32 of the frame bytes
+    char etag[ETAG_MAX_LEN];
+    uint32_t record_crc;  // CRC32 of the fields above
+  };
+
+  static const uint32_t SECTOR_SIZE = 4096;
+  static const uint32_t RECORD_SIZE = SECTOR_SIZE;
+  // 64 KB multiple so every slot starts on an mmap page and a block erase boundary
+  static const uint32_t SLOT_SIZE = 0xF0000;
+  static const uint32_t MAX_FRAME_SIZE = SLOT_SIZE - RECORD_SIZE;
+  static const int MAX_SLOTS = 8;
+
+  // Finds the "frames" partition (or the legacy spiffs one) and reads every slot record
+  bool begin();
+  bool ready() const { return this->partition_ != nullptr; }
+  int slotCount() const { return this->slots_; }
+  const esp_partition_t *partition() const { return this->partition_; }
+
+  // Newest committed slot, -1 if none
+  int activeSlot() const { return this->active_; }
+  const SlotRecord *record(int slot) const;
+
+  // Frame cache: committed slots newer than the shown sequence are queued, oldest first
+  int pendingCount(uint32_t shown) const;
+  // Oldest slot newer than shown, -1 if none
+  int nextSlotAfter(uint32_t shown) const;
+  // Slot a cached frame may overwrite without dropping a queued one or the frame on the panel
+  // (unless it is the only slot), -1 when the cache is full
+  int freeSlot(uint32_t shown) const;
+  // How many frames can be cached before freeSlot() runs out
+  int freeCount(uint32_t shown) const;
+
+  // Erase the record so the slot no longer counts; its data stays readable until rewritten
+  bool invalidate(int slot);
+  // Sequential write from offset (a multiple of SECTOR_SIZE); sectors are erased just ahead.
+  // A length limits the write, and the erase, to that range so the bytes after it survive
+  bool beginWrite(int slot, uint32_t offset, uint32_t length = 0);
+  bool write(const uint8_t *data, size_t len);
+  // CRC32 of written but not yet committed frame bytes
+  bool checksum(int slot, uint32_t offset, uint32_t len, uint32_t *crc);
+  // Checksum the written bytes and write the record; the slot becomes the active one
+  bool commit(int slot, uint32_t size, const char *etag);
+  // Rewrite the record of a committed slot under another ETag; the frame bytes stay as they are
+  bool retag(int slot, const char *etag);
+
+  // Map the frame bytes of a committed slot; only one mapping is held at a time
+  const uint8_t *map(int slot);
+  void unmap();
+
+ protected:
+  bool readRecord(int slot, SlotRecord *out);
+  uint32_t slotBase(int slot) const { return (uint32_t) slot * SLOT_SIZE; }
+
+  const esp_partition_t *partition_{nullptr};
+  int slots_{0};
+  int active_{-1};
+  SlotRecord records_[MAX_SLOTS]{};
+  bool valid_[MAX_SLOTS]{};
+
+  uint32_t write_pos_{0};    // partition offset of the next byte
+  uint32_t erased_end_{0};   // partition offset up to which flash is erased for this write
+  uint32_t write_limit_{0};  // end of the slot or range being written
+
+  esp_partition_mmap_handle_t map_handle_{0};
+  bool mapped_{false};
+};
+
+}  // namespace epd_photo_frame
+}  // namespace esphome
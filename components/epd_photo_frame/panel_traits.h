@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace epd_photo_frame {
+
+// Controller commands shared by the Waveshare dual-controller Spectra6 panels
+static const uint8_t PSR = 0x00;
+static const uint8_t PWR_EPD = 0x01;
+static const uint8_t POF = 0x02;
+static const uint8_t PON = 0x04;
+static const uint8_t BTST_N = 0x05;
+static const uint8_t BTST_P = 0x06;
+static const uint8_t DTM = 0x10;
+static const uint8_t DRF = 0x12;
+static const uint8_t CDI = 0x50;
+static const uint8_t TCON = 0x60;
+static const uint8_t TRES = 0x61;
+static const uint8_t AN_TM = 0x74;
+static const uint8_t AGID = 0x86;
+static const uint8_t BUCK_BOOST_VDDN = 0xB0;
+static const uint8_t TFT_VCOM_POWER = 0xB1;
+static const uint8_t EN_BUF = 0xB6;
+static const uint8_t BOOST_VDDP_EN = 0xB7;
+static const uint8_t CCSET = 0xE0;
+static const uint8_t PWS = 0xE3;
+static const uint8_t CMD66 = 0xF0;
+
+// One entry of a power-on init table, replayed by initDisplay()
+enum InitTarget : uint8_t { INIT_TARGET_MASTER, INIT_TARGET_BOTH };
+struct InitCommand {
+  InitTarget target;
+  uint8_t command;
+  uint8_t len;
+  uint8_t params[9];
+};
+
+struct PaletteEntry {
+  uint8_t r, g, b;
+  uint8_t index;  // nibble value the controller understands
+};
+
+// Native Spectra6 colour indices (one 4-bit nibble per pixel)
+enum Spectra6Color : uint8_t {
+  SPECTRA6_BLACK = 0x0,
+  SPECTRA6_WHITE = 0x1,
+  SPECTRA6_YELLOW = 0x2,
+  SPECTRA6_RED = 0x3,
+  SPECTRA6_BLUE = 0x5,
+  SPECTRA6_GREEN = 0x6,
+};
+
+// Waveshare 13.3" Spectra6 (E6), 1200x1600 portrait. The master drives the left half of every
+// row and the slave the right half; each controller sees its 600x1600 half as 1200x800 (TRES).
+struct Spectra6Panel13in3 {
+  static constexpr int WIDTH = 1200;
+  static constexpr int HEIGHT = 1600;
+  static constexpr int BPP = 4;
+  static constexpr int CONTROLLERS = 2;
+  // Columns [0, MASTER_COLUMNS) go to the master, the rest to the slave
+  static constexpr int MASTER_COLUMNS = WIDTH / 2;
+  static constexpr int CONTROLLER_HRES = 1200;
+  static constexpr int CONTROLLER_VRES = 800;
+
+  static constexpr InitCommand INIT_SEQUENCE[] = {
+      {INIT_TARGET_MASTER, AN_TM, 9, {0xC0, 0x1C, 0x1C, 0xCC, 0xCC, 0xCC, 0x15, 0x15, 0x55}},
+      {INIT_TARGET_BOTH, CMD66, 6, {0x49, 0x55, 0x13, 0x5D, 0x05, 0x10}},
+      {INIT_TARGET_BOTH, PSR, 2, {0xDF, 0x69}},
+      {INIT_TARGET_BOTH, CDI, 1, {0xF7}},
+      {INIT_TARGET_BOTH, TCON, 2, {0x03, 0x03}},
+      {INIT_TARGET_BOTH, AGID, 1, {0x10}},
+      {INIT_TARGET_BOTH, PWS, 1, {0x22}},
+      {INIT_TARGET_BOTH, CCSET, 1, {0x01}},
+      {INIT_TARGET_BOTH,
+       TRES,
+       4,
+       {CONTROLLER_HRES >> 8, CONTROLLER_HRES & 0xFF, CONTROLLER_VRES >> 8, CONTROLLER_VRES & 0xFF}},
+      {INIT_TARGET_MASTER, PWR_EPD, 6, {0x0F, 0x00, 0x28, 0x2C, 0x28, 0x38}},
+      {INIT_TARGET_MASTER, EN_BUF, 1, {0x07}},
+      {INIT_TARGET_MASTER, BTST_P, 2, {0xE8, 0x28}},
+      {INIT_TARGET_MASTER, BOOST_VDDP_EN, 1, {0x01}},
+      {INIT_TARGET_MASTER, BTST_N, 2, {0xE8, 0x28}},
+      {INIT_TARGET_MASTER, BUCK_BOOST_VDDN, 1, {0x01}},
+      {INIT_TARGET_MASTER, TFT_VCOM_POWER, 1, {0x02}},
+  };
+
+  static constexpr PaletteEntry PALETTE[] = {
+      {0, 0, 0, SPECTRA6_BLACK}, {255, 255, 255, SPECTRA6_WHITE}, {255, 255, 0, SPECTRA6_YELLOW},
+      {255, 0, 0, SPECTRA6_RED}, {0, 0, 255, SPECTRA6_BLUE},      {0, 255, 0, SPECTRA6_GREEN},
+  };
+};
+
+// Sizes derived from a panel's traits; every row loop and buffer is sized from these
+template<typename Traits> struct PanelGeometry : Traits {
+  static constexpr int BYTES_PER_ROW = Traits::WIDTH * Traits::BPP / 8;
+  static constexpr int MASTER_BYTES_PER_ROW = Traits::MASTER_COLUMNS * Traits::BPP / 8;
+  static constexpr int SLAVE_BYTES_PER_ROW = BYTES_PER_ROW - MASTER_BYTES_PER_ROW;
+  static constexpr int FRAME_DATA_SIZE = BYTES_PER_ROW * Traits::HEIGHT;
+  // Split layout: all master half-rows come first
+  static constexpr int MASTER_DATA_SIZE = MASTER_BYTES_PER_ROW * Traits::HEIGHT;
+  static constexpr size_t INIT_COMMANDS = sizeof(Traits::INIT_SEQUENCE) / sizeof(InitCommand);
+
+  static_assert(Traits::CONTROLLERS == 2, "only master/slave panels are supported");
+  static_assert(Traits::WIDTH * Traits::BPP % 8 == 0, "rows must end on a byte boundary");
+  static_assert(Traits::MASTER_COLUMNS * Traits::BPP % 8 == 0, "the controller split must fall on a byte");
+  static_assert(Traits::MASTER_COLUMNS > 0 && Traits::MASTER_COLUMNS < Traits::WIDTH,
+                "both controllers need columns");
+  static_assert(Traits::CONTROLLER_HRES * Traits::CONTROLLER_VRES == Traits::MASTER_COLUMNS * Traits::HEIGHT,
+                "TRES must cover exactly the master's pixels");
+
+  // Nearest palette colour (squared RGB distance)
+  static uint8_t nearest_color(uint8_t r, uint8_t g, uint8_t b) {
+    uint8_t best = Traits::PALETTE[0].index;
+    uint32_t best_dist = UINT32_MAX;
+    for (const PaletteEntry &p : Traits::PALETTE) {
+      const int dr = r - p.r, dg = g - p.g, db = b - p.b;
+      const uint32_t dist = dr * dr + dg * dg + db * db;
+      if (dist < best_dist) {
+        best_dist = dist;
+        best = p.index;
+      }
+    }
+    return best;
+  }
+};
+
+// Checked at every build: the sizes the frame format and the backend rely on
+using Spectra6Geometry13in3 = PanelGeometry<Spectra6Panel13in3>;
+static_assert(Spectra6Geometry13in3::BYTES_PER_ROW == 600, "13.3\" row is 600 bytes");
+static_assert(Spectra6Geometry13in3::MASTER_BYTES_PER_ROW == 300, "13.3\" half-row is 300 bytes");
+static_assert(Spectra6Geometry13in3::SLAVE_BYTES_PER_ROW == 300, "13.3\" half-row is 300 bytes");
+static_assert(Spectra6Geometry13in3::FRAME_DATA_SIZE == 960000, "13.3\" frame is 960,000 bytes");
+static_assert(Spectra6Geometry13in3::MASTER_DATA_SIZE == 480000, "13.3\" master block is 480,000 bytes");
+static_assert(Spectra6Geometry13in3::INIT_COMMANDS == 16, "13.3\" init table has 16 commands");
+
+}  // namespace epd_photo_frame
+}  // namespace esphome
@@ -0,0 +1,100 @@
+#include "wake_trace.h"
+#include <cstdio>
+#include <cstring>
+#include <esp_attr.h>
+
+namespace esphome {
+namespace epd_photo_frame {
+
+static const uint32_t TRACE_MAGIC = 0x45505457;  // "EPTW"
+
+struct TraceRing {
+  uint32_t magic;
+  uint32_t wake;       // number of the current wake
+  uint32_t published;  // highest wake already published
+  WakeTrace::Record records[WakeTrace::RECORDS];
+};
+
+// Not initialised at boot, so it also survives a crash or software reset; the magic tells a
+// power-on apart
+static RTC_NOINIT_ATTR TraceRing trace_ring;
+
+static const char *const PHASE_KEYS[WAKE_PHASE_COUNT] = {
+    "wifi", "api", "dl", "overlay", "send", "send_m", "pon", "refresh", "pof",
+};
+
+static WakeTrace::Record &current_record() { return trace_ring.records[trace_ring.wake % WakeTrace::RECORDS]; }
+
+void WakeTrace::begin() {
+  if (trace_ring.magic != TRACE_MAGIC || trace_ring.published > trace_ring.wake) {
+    memset(&trace_ring, 0, sizeof(trace_ring));
+    trace_ring.magic = TRACE_MAGIC;
+  }
+  trace_ring.wake++;
+  Record &rec = current_record();
+  memset(&rec, 0, sizeof(rec));
+  rec.wake = trace_ring.wake;
+}
+
+void WakeTrace::add(WakePhase phase, uint32_t ms) { current_record().phase_ms[phase] += ms; }
+
+void WakeTrace::mark(WakePhase phase, uint32_t now_ms) {
+  Record &rec = current_record();
+  // A milestone at 0 ms is stored as 1 so it still counts as reached
+  if (rec.phase_ms[phase] == 0) rec.phase_ms[phase] = now_ms == 0 ? 1 : now_ms;
+}
+
+bool WakeTrace::marked(WakePhase phase) const { return current_record().phase_ms[phase] != 0; }
+
+void WakeTrace::countRequests(int requests, int bytes) {
+  Record &rec = current_record();
+  rec.requests += requests;
+  rec.bytes += bytes;
+}
+
+void WakeTrace::countRetry() { current_record().retries++; }
+
+void WakeTrace::countBusyTimeout() { current_record().busy_timeouts++; }
+
+void WakeTrace::finish(uint32_t now_ms) { current_record().awake_ms = now_ms; }
+
+const WakeTrace::Record *WakeTrace::current() const { return &current_record(); }
+
+const WakeTrace::Record *WakeTrace::nextUnpublished() const {
+  // Older wakes than the ring holds are gone; the current one is still running
+  uint32_t wake = trace_ring.published + 1;
+  if (trace_ring.wake > RECORDS && wake <= trace_ring.wake - RECORDS) wake = trace_ring.wake - RECORDS + 1;
+  if (wake >= trace_ring.wake) return nullptr;
+  const Record &rec = trace_ring.records[wake % RECORDS];
+  return rec.wake == wake ? &rec : nullptr;
+}
+
+void WakeTrace::markPublished(const Record *record) {
+  if (record != nullptr && record->wake > trace_ring.published) trace_ring.published = record->wake;
+}
+
+size_t WakeTrace::toJson(const Record &record, char *out, size_t len) {
+  size_t pos = 0;
+  auto append = [&](const char *key, uint32_t value) {
+    if (pos >= len) return;
+    const int n = snprintf(out + pos, len - pos, "%s\"%s\":%u", pos == 0 ? "{" : ",", key, (unsigned) value);
+    if (n > 0) pos += n;
+  };
+  append("wake", record.wake);
+  for (int i = 0; i < WAKE_PHASE_COUNT; i++) {
+    if (record.phase_ms[i] != 0) append(PHASE_KEYS[i], record.phase_ms[i]);
+  }
+  append("req", record.requests);
+  append("retry", record.retries);
+  append("busy_to", record.busy_timeouts);
+  append("bytes", record.bytes);
+  append("awake", record.awake_ms);
+  if (pos < len) {
+    const int n = snprintf(out + pos, len - pos, "}");
+    if (n > 0) pos += n;
+  }
+  return pos < len ? pos : len - 1;
+}
+
+}  // namespace epd_photo_frame
+}  // namespace esphome
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace epd_photo_frame {
+
+enum WakePhase : uint8_t {
+  WAKE_PHASE_WIFI,        // boot until Wi-Fi is connected (a point in time, not a span)
+  WAKE_PHASE_API,         // boot until an API client is connected (a point in time)
+  WAKE_PHASE_DOWNLOAD,    // download, refill and stream tasks
+  WAKE_PHASE_OVERLAY,     // display lambda, summed over all bands
+  WAKE_PHASE_SEND,        // stored frame to both controllers
+  WAKE_PHASE_SEND_MASTER, // master half of the above (without an overlay)
+  WAKE_PHASE_POWER_ON,    // BUSY after PON
+  WAKE_PHASE_REFRESH,     // BUSY after DRF
+  WAKE_PHASE_POWER_OFF,   // BUSY after POF
+  WAKE_PHASE_COUNT,
+};
+
+// Per-wake timings kept in RTC memory, so they survive deep sleep (and soft resets) and can be
+// published once a later wake has the API connected. Recording is a millis() call and an add.
+class WakeTrace {
+ public:
+  struct Record {
+    uint32_t wake;  // wake number since power-on, 0 for an empty slot
+    uint32_t phase_ms[WAKE_PHASE_COUNT];
+    uint32_t bytes;        // HTTP body bytes
+    uint32_t awake_ms;     // boot until shutdown, 0 if the wake ended in a reset
+    uint16_t requests;     // HTTP requests
+    uint16_t retries;      // HTTP attempts after the first one of a range or chunk
+    uint8_t busy_timeouts; // refresh phases that hit BUSY_TIMEOUT_MS
+  };
+  static const int RECORDS = 8;
+
+  // Opens the record for this wake; the ring is reset after a power-on
+  void begin();
+  void add(WakePhase phase, uint32_t ms);
+  // First time only: boot-relative timestamp of a milestone
+  void mark(WakePhase phase, uint32_t now_ms);
+  bool marked(WakePhase phase) const;
+  void countRequests(int requests, int bytes);
+  void countRetry();
+  void countBusyTimeout();
+  // Called before deep sleep
+  void finish(uint32_t now_ms);
+
+  const Record *current() const;
+  // Oldest finished wake not yet published, nullptr if none; markPublished() moves past it
+  const Record *nextUnpublished() const;
+  void markPublished(const Record *record);
+  // Compact JSON (phases that took no time are left out); fits a text sensor's 255 chars
+  static size_t toJson(const Record &record, char *out, size_t len);
+};
+
+}  // namespace epd_photo_frame
+}  // namespace esphome
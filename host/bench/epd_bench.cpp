@@ -0,0 +1,160 @@
+// Timings of the component on the host models: download over links of different speeds, the
+// stored frame sent to the panel at each SPI clock, streaming vs storing, and the refresh.
+// Everything runs on the simulated clock, so the numbers only depend on the models' parameters
+// (sim/http.h Link, sim/panel.h Timing, sim/flash.h Timing) and repeat exactly.
+//
+//   epd_bench [--link=KBps,...] [--spi=MHz,...] [--rtt=ms]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "sim/rig.h"
+
+using epd_sim::Layout;
+using epd_sim::Rig;
+
+namespace {
+
+std::vector<double> parse_list(const char *arg) {
+  std::vector<double> out;
+  for (const char *p = arg; *p != '\0';) {
+    char *end;
+    out.push_back(strtod(p, &end));
+    p = *end == ',' ? end + 1 : end;
+    if (end == p && *p != '\0') break;
+  }
+  return out;
+}
+
+double ms(uint64_t us) { return us / 1000.0; }
+
+// First time the given command went out on the bus
+uint64_t command_time(const epd_sim::PanelSim &panel, uint8_t command) {
+  for (const auto &e : panel.trace) {
+    if (!e.dc && !e.head.empty() && e.head[0] == command) return e.t_us;
+  }
+  return 0;
+}
+
+void bench_download(const std::vector<double> &links_kbps, uint32_t rtt_us) {
+  printf("Download to flash (split frame, 960,016 bytes)\n");
+  printf("%10s %10s %12s %10s %9s %12s\n", "link KB/s", "encoding", "wire bytes", "requests", "ms", "frame B/s");
+  for (double kbps : links_kbps) {
+    for (bool rle : {false, true}) {
+      Rig rig;
+      rig.serve(1);
+      rig.server.rle = rle;
+      epd_sim::link().bytes_per_s = kbps * 1000;
+      epd_sim::link().rtt_us = rtt_us;
+      rig.boot();
+      const uint64_t start = epd_sim::now_us();
+      rig.download();
+      const uint64_t took = epd_sim::now_us() - start;
+      printf("%10.0f %10s %12llu %10d %9.1f %12.0f\n", kbps, rle ? "x-epd-rle" : "identity",
+             (unsigned long long) epd_sim::http_stats().body_bytes, epd_sim::http_stats().requests, ms(took),
+             rig.server.frames[0].size() * 1e6 / took);
+    }
+  }
+  printf("\n");
+}
+
+void bench_send(const std::vector<double> &spi_mhz) {
+  printf("Stored frame to both controllers (960,000 pixel bytes)\n");
+  printf("%8s %10s %12s %12s %14s\n", "SPI MHz", "send ms", "B/s", "bus busy %", "transactions");
+  for (double mhz : spi_mhz) {
+    Rig rig;
+    rig.serve(2);
+    rig.boot(false, (uint32_t) (mhz * 1e6));
+    rig.download();
+    rig.panel.stats = {};
+    const uint64_t start = epd_sim::now_us();
+    rig.frame->displayFromFile();
+    const uint64_t took = command_time(rig.panel, 0x04) - start;  // until PON
+    printf("%8.1f %10.1f %12.0f %12.1f %14llu\n", mhz, ms(took), 960000 * 1e6 / took,
+           100.0 * rig.panel.stats.spi_us / took, (unsigned long long) rig.panel.stats.transactions);
+    rig.refresh();
+  }
+  printf("\n");
+}
+
+void bench_wake(const std::vector<double> &links_kbps, uint32_t rtt_us) {
+  printf("Wake to DRF and to the end of the refresh (SPI 10 MHz)\n");
+  printf("%10s %10s %8s %12s %12s %10s\n", "link KB/s", "encoding", "mode", "DRF at ms", "done at ms", "DTM busy");
+  for (double kbps : links_kbps) {
+    for (int run = 0; run < 4; run++) {
+      const bool rle = run >= 2, stream = run % 2 == 1;
+      Rig rig;
+      rig.serve(3);
+      rig.server.rle = rle;
+      epd_sim::link().bytes_per_s = kbps * 1000;
+      epd_sim::link().rtt_us = rtt_us;
+      rig.boot(stream);
+      const bool ok = rig.wake();
+      printf("%10.0f %10s %8s %12.1f %12.1f %10llu%s\n", kbps, rle ? "x-epd-rle" : "identity", stream ? "stream" : "store",
+             ms(command_time(rig.panel, 0x12)), ms(epd_sim::now_us()),
+             (unsigned long long) rig.panel.stats.dtm_while_busy, ok ? "" : "  (failed)");
+    }
+  }
+  printf("\n");
+}
+
+void bench_delta(uint32_t rtt_us) {
+  printf("Next frame differs in one 100 KB chunk\n");
+  Rig rig;
+  rig.serve(4);
+  epd_sim::link().rtt_us = rtt_us;
+  rig.boot();
+  rig.wake();
+  std::vector<uint8_t> next = rig.server.frames[0];
+  for (size_t i = 500000; i < 500100; i++) next[i] ^= 0x11;
+  rig.server.frames.push_back(next);
+  rig.server.current = 1;
+  rig.boot();
+  epd_sim::reset_http_stats();
+  const uint64_t start = epd_sim::now_us();
+  rig.download();
+  printf("  %s: %llu body bytes in %d requests, %.1f ms\n\n", rig.download_status.state.c_str(),
+         (unsigned long long) epd_sim::http_stats().body_bytes, epd_sim::http_stats().requests,
+         ms(epd_sim::now_us() - start));
+}
+
+void bench_refresh() {
+  Rig rig;
+  rig.serve(5);
+  rig.boot();
+  rig.download();
+  rig.frame->displayFromFile();
+  const uint64_t pon = command_time(rig.panel, 0x04);
+  rig.refresh();
+  const uint64_t drf = command_time(rig.panel, 0x12);
+  const uint64_t pof = command_time(rig.panel, 0x02);
+  printf("Refresh: PON -> DRF %.1f ms, DRF -> POF %.1f ms, POF -> idle %.1f ms, total %.1f ms\n", ms(drf - pon),
+         ms(pof - drf), ms(epd_sim::now_us() - pof), ms(epd_sim::now_us() - pon));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::vector<double> links = {50, 125, 250, 500, 1000};
+  std::vector<double> spi = {2, 4, 8, 10, 20, 40};
+  uint32_t rtt_us = 20000;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--link=", 7) == 0) {
+      links = parse_list(argv[i] + 7);
+    } else if (strncmp(argv[i], "--spi=", 6) == 0) {
+      spi = parse_list(argv[i] + 6);
+    } else if (strncmp(argv[i], "--rtt=", 6) == 0) {
+      rtt_us = (uint32_t) (atof(argv[i] + 6) * 1000);
+    } else {
+      fprintf(stderr, "usage: %s [--link=KBps,...] [--spi=MHz,...] [--rtt=ms]\n", argv[0]);
+      return strcmp(argv[i], "--help") == 0 ? 0 : 2;
+    }
+  }
+  bench_download(links, rtt_us);
+  bench_send(spi);
+  bench_wake(links, rtt_us);
+  bench_delta(rtt_us);
+  bench_refresh();
+  return 0;
+}
@@ -0,0 +1,219 @@
+#include "sim/backend.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <zlib.h>
+
+namespace epd_sim {
+
+static const int WIDTH = 1200;
+static const int HEIGHT = 1600;
+static const int ROW = WIDTH / 2;
+static const int HALF = ROW / 2;
+static const uint8_t INKS[] = {0x0, 0x1, 0x2, 0x3, 0x5, 0x6};
+
+std::vector<uint8_t> test_picture(uint32_t seed) {
+  std::vector<uint8_t> out((size_t) WIDTH * HEIGHT);
+  uint32_t state = seed * 2654435761u + 1;
+  auto next = [&state] {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  };
+  for (int y = 0; y < HEIGHT; y++) {
+    const int band = y / 100;
+    const bool solid = (band + seed) % 2 == 0;
+    const uint8_t ink = INKS[(band + seed) % 6];
+    for (int x = 0; x < WIDTH; x++) {
+      out[(size_t) y * WIDTH + x] = solid ? (x < WIDTH / 2 ? ink : INKS[(band + seed + 1) % 6]) : INKS[next() % 6];
+    }
+  }
+  return out;
+}
+
+std::vector<uint8_t> pack_frame(const std::vector<uint8_t> &indices, Layout layout) {
+  std::vector<uint8_t> rows((size_t) ROW * HEIGHT);
+  for (size_t i = 0; i < rows.size(); i++) rows[i] = (uint8_t) (indices[2 * i] << 4 | indices[2 * i + 1]);
+  std::vector<uint8_t> out;
+  if (layout != Layout::LEGACY) {
+    const uint32_t size = (uint32_t) rows.size();
+    const uint8_t header[16] = {'E', 'P', 'D', 'F', 1, (uint8_t) (layout == Layout::SPLIT ? 1 : 0), 4, 2,
+                                (uint8_t) (WIDTH & 0xFF), (uint8_t) (WIDTH >> 8), (uint8_t) (HEIGHT & 0xFF),
+                                (uint8_t) (HEIGHT >> 8), (uint8_t) size, (uint8_t) (size >> 8),
+                                (uint8_t) (size >> 16), (uint8_t) (size >> 24)};
+    out.assign(header, header + sizeof(header));
+  }
+  if (layout != Layout::SPLIT) {
+    out.insert(out.end(), rows.begin(), rows.end());
+    return out;
+  }
+  for (int half = 0; half < 2; half++) {
+    for (int y = 0; y < HEIGHT; y++) {
+      const auto row = rows.begin() + (size_t) y * ROW + half * HALF;
+      out.insert(out.end(), row, row + HALF);
+    }
+  }
+  return out;
+}
+
+std::string rle_encode(const std::vector<uint8_t> &data) {
+  std::string out;
+  out.reserve(data.size());
+  auto literal = [&](size_t start, size_t end) {
+    while (start < end) {
+      const size_t n = std::min<size_t>(end - start, 0x80);
+      out.push_back((char) (n - 1));
+      out.append(reinterpret_cast<const char *>(data.data()) + start, n);
+      start += n;
+    }
+  };
+  size_t pos = 0;  // first byte not yet emitted
+  size_t i = 0;
+  while (i < data.size()) {
+    size_t j = i + 1;
+    while (j < data.size() && data[j] == data[i]) j++;
+    size_t n = j - i;
+    if (n < 3) {
+      i = j;
+      continue;
+    }
+    literal(pos, i);
+    while (n >= 3) {
+      const size_t take = std::min<size_t>(n, 0x7F + 3);
+      out.push_back((char) (0x80 | (take - 3)));
+      out.push_back((char) data[i]);
+      n -= take;
+    }
+    // A 1-2 byte tail of a long run is cheaper as part of the next literal
+    pos = j - n;
+    i = j;
+  }
+  literal(pos, data.size());
+  return out;
+}
+
+std::string FrameServer::etag(size_t index) const {
+  const std::vector<uint8_t> &frame = this->frames[index];
+  char tag[64];
+  snprintf(tag, sizeof(tag), "W/\"%08x%08zx\"", (unsigned) crc32(0, frame.data(), frame.size()), frame.size());
+  return tag;
+}
+
+static bool etag_matches(const std::string &if_none_match, const std::string &etag) {
+  if (if_none_match.empty()) return false;
+  auto opaque = [](std::string t) {
+    t.erase(0, t.find_first_not_of(' '));
+    t.erase(t.find_last_not_of(' ') + 1);
+    return t.rfind("W/", 0) == 0 ? t.substr(2) : t;
+  };
+  if (opaque(if_none_match) == "*") return true;
+  size_t pos = 0;
+  while (pos <= if_none_match.size()) {
+    size_t end = if_none_match.find(',', pos);
+    if (end == std::string::npos) end = if_none_match.size();
+    if (opaque(if_none_match.substr(pos, end - pos)) == opaque(etag)) return true;
+    pos = end + 1;
+  }
+  return false;
+}
+
+HttpResponse FrameServer::handle(const HttpRequest &request) {
+  HttpResponse response;
+  response.server_us = this->server_us;
+  if (this->frames.empty()) {
+    response.status = 404;
+    return response;
+  }
+  const std::string &path = request.path;
+  if (path == "/images/next") return this->serve_frame(request, this->current);
+  if (path == "/images/next/manifest" && this->manifest) {
+    this->manifests++;
+    const std::string tag = this->etag(this->current);
+    response.headers.emplace_back("ETag", tag);
+    if (etag_matches(request.header("if-none-match"), tag)) {
+      response.status = 304;
+      return response;
+    }
+    const std::vector<uint8_t> &frame = this->frames[this->current];
+    char line[64];
+    snprintf(line, sizeof(line), "size %zu\nchunk %d\n", frame.size(), this->manifest_chunk);
+    response.body = line;
+    for (size_t start = 0; start < frame.size(); start += this->manifest_chunk) {
+      const size_t n = std::min<size_t>(this->manifest_chunk, frame.size() - start);
+      snprintf(line, sizeof(line), "%08x\n", (unsigned) crc32(0, frame.data() + start, n));
+      response.body += line;
+    }
+    response.headers.emplace_back("Content-Type", "text/plain; charset=utf-8");
+    return response;
+  }
+  if (path == "/images/batch") {
+    const int count = std::max(1, atoi(request.param("count").c_str()));
+    for (int i = 1; i <= count; i++) {
+      response.body += "http://frame.test/images/asset/" + std::to_string((this->current + i) % this->frames.size()) +
+                       "?device_id=" + request.param("device_id") + "\n";
+    }
+    response.headers.emplace_back("Content-Type", "text/plain; charset=utf-8");
+    return response;
+  }
+  const std::string asset = "/images/asset/";
+  if (path.rfind(asset, 0) == 0) {
+    const size_t index = (size_t) atoi(path.c_str() + asset.size());
+    if (index < this->frames.size()) return this->serve_frame(request, index);
+  }
+  response.status = 404;
+  return response;
+}
+
+HttpResponse FrameServer::serve_frame(const HttpRequest &request, size_t index) {
+  HttpResponse response;
+  response.server_us = this->server_us;
+  const std::string tag = this->etag(index);
+  if (etag_matches(request.header("if-none-match"), tag)) {
+    response.status = 304;
+    response.headers.emplace_back("ETag", tag);
+    return response;
+  }
+  const std::vector<uint8_t> &frame = this->frames[index];
+  const bool encoded = this->rle && request.header("accept-encoding").find("x-epd-rle") != std::string::npos;
+  std::string body;
+  if (encoded) {
+    // Encoded once per frame, like frame_cache.variant()
+    auto it = this->encoded_.find(tag);
+    if (it == this->encoded_.end()) it = this->encoded_.emplace(tag, rle_encode(frame)).first;
+    body = it->second;
+  } else {
+    body.assign(frame.begin(), frame.end());
+  }
+  const size_t total = body.size();
+  size_t start = 0, end = total - 1;
+  response.headers.emplace_back("Accept-Ranges", "bytes");
+  response.headers.emplace_back("ETag", tag);
+  if (encoded) response.headers.emplace_back("Content-Encoding", "x-epd-rle");
+  const std::string range = request.header("range");
+  if (range.rfind("bytes=", 0) == 0) {
+    long s = -1, e = -1;
+    if (sscanf(range.c_str() + 6, "%ld-%ld", &s, &e) < 1 || s < 0 || (size_t) s >= total) {
+      response.status = 416;
+      response.headers.clear();
+      return response;
+    }
+    start = (size_t) s;
+    // A last-byte-pos past the end is clamped, as in frame_response()
+    if (e >= 0) end = std::min<size_t>((size_t) e, total - 1);
+    if (end < start) {
+      response.status = 416;
+      response.headers.clear();
+      return response;
+    }
+    response.status = 206;
+    response.headers.emplace_back("Content-Range", "bytes " + std::to_string(start) + "-" + std::to_string(end) +
+                                                       "/" + std::to_string(total));
+  }
+  response.body = body.substr(start, end - start + 1);
+  response.headers.emplace_back("Content-Length", std::to_string(response.body.size()));
+  if (request.path == "/images/next") this->next_body_bytes += response.body.size();
+  return response;
+}
+
+}  // namespace epd_sim
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "sim/http.h"
+
+namespace epd_sim {
+
+// Frame bytes as the backend serves them (server/app/image_proc.py): an optional 16 byte
+// "EPDF" header, then 4 bpp pixels either row-interleaved or split per controller
+enum class Layout { LEGACY, INTERLEAVED, SPLIT };
+
+// A test picture: one Spectra6 index per pixel, 1200x1600, different for every seed. Bands of
+// solid colour (long runs for the RLE coder) alternate with a per-pixel pattern (none).
+std::vector<uint8_t> test_picture(uint32_t seed);
+// Pack a picture as a frame in the given layout
+std::vector<uint8_t> pack_frame(const std::vector<uint8_t> &indices, Layout layout);
+// Port of server/app/frame_codec.py rle_encode()
+std::string rle_encode(const std::vector<uint8_t> &data);
+
+// Stand-in for the FastAPI backend's /images routes, serving fixed frames:
+//   /images/next           the frame at `current`, with Range, ETag/If-None-Match (weak tags,
+//                          as the server sends them) and x-epd-rle when the client accepts it
+//   /images/next/manifest  "size/chunk" and per-chunk CRC32s of that frame
+//   /images/batch?count=N  URLs of the N frames after `current`
+//   /images/asset/<i>      frame i
+class FrameServer : public HttpServer {
+ public:
+  std::vector<std::vector<uint8_t>> frames;
+  size_t current{0};
+  bool rle{true};
+  bool manifest{true};
+  int manifest_chunk{100 * 1024};
+  // Time to answer a request (the render is cached, so a lookup)
+  uint32_t server_us{2000};
+  // Bodies sent per route, for assertions on what the device fetched
+  uint64_t next_body_bytes{0};
+  int manifests{0};
+
+  std::string etag(size_t index) const;
+  HttpResponse handle(const HttpRequest &request) override;
+
+ protected:
+  HttpResponse serve_frame(const HttpRequest &request, size_t index);
+
+  std::map<std::string, std::string> encoded_;  // by ETag
+};
+
+}  // namespace epd_sim
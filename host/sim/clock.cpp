@@ -0,0 +1,24 @@
+#include "sim/clock.h"
+#include "esphome/core/hal.h"
+
+namespace epd_sim {
+
+static thread_local uint64_t thread_now_us = 0;
+
+uint64_t now_us() { return thread_now_us; }
+void advance_us(uint64_t us) { thread_now_us += us; }
+void sync_to(uint64_t t_us) {
+  if (t_us > thread_now_us) thread_now_us = t_us;
+}
+void reset_clock() { thread_now_us = 0; }
+
+}  // namespace epd_sim
+
+namespace esphome {
+
+uint32_t millis() { return epd_sim::now_ms(); }
+uint32_t micros() { return (uint32_t) epd_sim::now_us(); }
+void delay(uint32_t ms) { epd_sim::advance_us((uint64_t) ms * 1000); }
+void delayMicroseconds(uint32_t us) { epd_sim::advance_us(us); }
+
+}  // namespace esphome
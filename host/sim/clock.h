@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+namespace epd_sim {
+
+// Simulated time, in microseconds since boot, kept per thread: every task (thread) carries its
+// own clock, which only moves forward. Delays, SPI transfers, flash operations and the network
+// advance the caller's clock instead of sleeping; queues and task notifications carry the
+// sender's time so a receiver never runs ahead of what it waits for. The results are therefore
+// the same on any machine and nothing in a test actually waits.
+uint64_t now_us();
+void advance_us(uint64_t us);
+// Move the caller's clock forward to t (never backwards)
+void sync_to(uint64_t t_us);
+// Start of a fresh wake: the calling thread's clock is set back to 0
+void reset_clock();
+
+inline uint32_t now_ms() { return (uint32_t) (now_us() / 1000); }
+
+}  // namespace epd_sim
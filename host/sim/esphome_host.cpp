@@ -0,0 +1,95 @@
+#include "sim/esphome_host.h"
+#include "sim/clock.h"
+#include "esphome/core/application.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/log.h"
+#include "esphome/core/preferences.h"
+#include "esphome/core/util.h"
+#include "esphome/components/network/util.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+std::mutex prefs_lock;
+std::map<uint32_t, std::vector<uint8_t>> prefs;
+bool wifi_up = true;
+bool api_up = true;
+
+int log_level() {
+  static const int level = [] {
+    const char *env = getenv("EPD_LOG_LEVEL");
+    return env != nullptr ? atoi(env) : ESPHOME_LOG_LEVEL_WARN;
+  }();
+  return level;
+}
+
+}  // namespace
+
+namespace epd_sim {
+
+void clear_preferences() {
+  std::lock_guard<std::mutex> lock(prefs_lock);
+  prefs.clear();
+}
+
+void set_network(bool wifi_connected, bool api_connected) {
+  wifi_up = wifi_connected;
+  api_up = api_connected;
+}
+
+}  // namespace epd_sim
+
+namespace esphome {
+
+Application App;
+static ESPPreferences host_preferences;
+ESPPreferences *global_preferences = &host_preferences;
+
+bool ESPPreferenceObject::save_(const uint8_t *data) {
+  std::lock_guard<std::mutex> lock(prefs_lock);
+  prefs[this->key_].assign(data, data + this->size_);
+  return true;
+}
+
+bool ESPPreferenceObject::load_(uint8_t *data) {
+  std::lock_guard<std::mutex> lock(prefs_lock);
+  auto it = prefs.find(this->key_);
+  if (it == prefs.end() || it->second.size() != this->size_) return false;
+  memcpy(data, it->second.data(), this->size_);
+  return true;
+}
+
+uint32_t fnv1_hash(const std::string &str) {
+  uint32_t hash = 2166136261UL;
+  for (char c : str) {
+    hash *= 16777619UL;
+    hash ^= (uint8_t) c;
+  }
+  return hash;
+}
+
+bool network_is_connected() { return wifi_up; }
+bool api_is_connected() { return api_up; }
+
+namespace network {
+bool is_connected() { return wifi_up; }
+}  // namespace network
+
+void esp_log_printf_(int level, const char *tag, int line, const char *format, ...) {
+  if (level > log_level()) return;
+  static const char LETTERS[] = "?EWICDV";
+  char message[512];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+  fprintf(stderr, "[%9.3f][%c][%s:%d]: %s\n", epd_sim::now_us() / 1e6, LETTERS[level], tag, line, message);
+}
+
+}  // namespace esphome
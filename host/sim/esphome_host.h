@@ -0,0 +1,11 @@
+#pragma once
+
+namespace epd_sim {
+
+// Forget every saved preference, as on a freshly flashed device (they survive a simulated
+// deep sleep otherwise)
+void clear_preferences();
+// What network::is_connected() and api_is_connected() report
+void set_network(bool wifi_connected, bool api_connected);
+
+}  // namespace epd_sim
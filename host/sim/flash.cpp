@@ -0,0 +1,181 @@
+#include "sim/flash.h"
+#include "sim/clock.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace epd_sim {
+
+namespace {
+
+std::mutex registry_lock;
+std::vector<FlashSim *> registry;
+uint32_t next_handle = 1;
+// Mapping handle -> partition, so munmap finds its owner
+std::vector<std::pair<esp_partition_mmap_handle_t, FlashSim *>> mappings;
+
+const uint32_t BLOCK_SIZE = 0x10000;
+
+FlashSim *owner(const esp_partition_t *partition) {
+  std::lock_guard<std::mutex> lock(registry_lock);
+  for (FlashSim *flash : registry) {
+    if (flash->partition() == partition) return flash;
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+FlashSim::FlashSim(const char *label, uint32_t size, esp_partition_subtype_t subtype, const std::string &path) {
+  this->partition_.type = ESP_PARTITION_TYPE_DATA;
+  this->partition_.subtype = subtype;
+  this->partition_.size = size;
+  this->partition_.erase_size = SECTOR_SIZE;
+  strncpy(this->partition_.label, label, sizeof(this->partition_.label) - 1);
+  if (path.empty()) {
+    this->data_ = static_cast<uint8_t *>(::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (this->data_ != MAP_FAILED) memset(this->data_, 0xFF, size);
+  } else {
+    this->fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (this->fd_ < 0) throw std::runtime_error("cannot open flash image " + path);
+    const off_t existing = lseek(this->fd_, 0, SEEK_END);
+    if (ftruncate(this->fd_, size) != 0) throw std::runtime_error("cannot size flash image " + path);
+    this->data_ = static_cast<uint8_t *>(::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd_, 0));
+    // A new image (or the part that grew) starts erased, like a chip from the factory
+    if (this->data_ != MAP_FAILED && existing < (off_t) size) memset(this->data_ + existing, 0xFF, size - existing);
+  }
+  if (this->data_ == MAP_FAILED) throw std::runtime_error("cannot map flash image");
+  std::lock_guard<std::mutex> lock(registry_lock);
+  registry.push_back(this);
+}
+
+FlashSim::~FlashSim() {
+  {
+    std::lock_guard<std::mutex> lock(registry_lock);
+    registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
+  }
+  ::munmap(this->data_, this->partition_.size);
+  if (this->fd_ >= 0) ::close(this->fd_);
+}
+
+void FlashSim::spend(uint64_t us) {
+  this->stats.busy_us += us;
+  advance_us(us);
+}
+
+esp_err_t FlashSim::read(size_t offset, void *dst, size_t size) {
+  if (offset > this->partition_.size || size > this->partition_.size - offset) return ESP_ERR_INVALID_SIZE;
+  memcpy(dst, this->data_ + offset, size);
+  this->spend((size + 1023) / 1024 * this->timing.read_kb_us);
+  return ESP_OK;
+}
+
+esp_err_t FlashSim::write(size_t offset, const void *src, size_t size) {
+  if (offset > this->partition_.size || size > this->partition_.size - offset) return ESP_ERR_INVALID_SIZE;
+  if (this->power_budget_ == 0) return ESP_FAIL;
+  size_t n = size;
+  if (this->power_budget_ > 0) n = std::min<size_t>(size, this->power_budget_);
+  const uint8_t *bytes = static_cast<const uint8_t *>(src);
+  bool unerased = false;
+  for (size_t i = 0; i < n; i++) {
+    uint8_t &cell = this->data_[offset + i];
+    if ((bytes[i] & ~cell) != 0) unerased = true;
+    cell &= bytes[i];
+  }
+  if (unerased) this->stats.unerased_writes++;
+  this->stats.bytes_programmed += n;
+  this->spend((n + 255) / 256 * this->timing.page_program_us);
+  if (this->power_budget_ > 0) this->power_budget_ -= n;
+  return n == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t FlashSim::erase(size_t offset, size_t size) {
+  if (offset % SECTOR_SIZE != 0 || size % SECTOR_SIZE != 0) return ESP_ERR_INVALID_ARG;
+  if (offset > this->partition_.size || size > this->partition_.size - offset) return ESP_ERR_INVALID_SIZE;
+  if (this->power_budget_ == 0) return ESP_FAIL;
+  memset(this->data_ + offset, 0xFF, size);
+  this->erase_log.emplace_back((uint32_t) offset, (uint32_t) size);
+  // The driver erases whole blocks where the range covers them and sectors elsewhere
+  const size_t absolute = this->partition_.address + offset;
+  for (size_t pos = absolute; pos < absolute + size;) {
+    if (pos % BLOCK_SIZE == 0 && pos + BLOCK_SIZE <= absolute + size) {
+      this->stats.block_erases++;
+      this->spend(this->timing.block_erase_us);
+      pos += BLOCK_SIZE;
+    } else {
+      this->stats.sector_erases++;
+      this->spend(this->timing.sector_erase_us);
+      pos += SECTOR_SIZE;
+    }
+  }
+  return ESP_OK;
+}
+
+esp_err_t FlashSim::mmap(size_t offset, size_t size, const void **out, esp_partition_mmap_handle_t *handle) {
+  if (offset > this->partition_.size || size > this->partition_.size - offset) return ESP_ERR_INVALID_SIZE;
+  *out = this->data_ + offset;
+  std::lock_guard<std::mutex> lock(registry_lock);
+  *handle = next_handle++;
+  mappings.emplace_back(*handle, this);
+  this->open_mappings_++;
+  this->stats.mmaps++;
+  return ESP_OK;
+}
+
+}  // namespace epd_sim
+
+using epd_sim::FlashSim;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+  std::lock_guard<std::mutex> lock(epd_sim::registry_lock);
+  for (FlashSim *flash : epd_sim::registry) {
+    const esp_partition_t *p = flash->partition();
+    if (type != ESP_PARTITION_TYPE_ANY && p->type != type) continue;
+    if (subtype != ESP_PARTITION_SUBTYPE_ANY && p->subtype != subtype) continue;
+    if (label != nullptr && strcmp(p->label, label) != 0) continue;
+    return p;
+  }
+  return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+  FlashSim *flash = epd_sim::owner(partition);
+  return flash != nullptr ? flash->read(src_offset, dst, size) : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size) {
+  FlashSim *flash = epd_sim::owner(partition);
+  return flash != nullptr ? flash->write(dst_offset, src, size) : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+  FlashSim *flash = epd_sim::owner(partition);
+  return flash != nullptr ? flash->erase(offset, size) : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle) {
+  FlashSim *flash = epd_sim::owner(partition);
+  return flash != nullptr ? flash->mmap(offset, size, out_ptr, out_handle) : ESP_ERR_INVALID_ARG;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle) {
+  FlashSim *flash = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(epd_sim::registry_lock);
+    for (auto it = epd_sim::mappings.begin(); it != epd_sim::mappings.end(); ++it) {
+      if (it->first == handle) {
+        flash = it->second;
+        epd_sim::mappings.erase(it);
+        break;
+      }
+    }
+  }
+  if (flash != nullptr) flash->munmap();
+}
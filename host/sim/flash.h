@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <esp_partition.h>
+
+namespace epd_sim {
+
+// A data partition on NOR flash: erase sets whole 4 KB sectors to 0xFF and programming can only
+// clear bits, so a write over bytes that were not erased first leaves their AND behind, as on the
+// chip. Backed by a file when a path is given, so the contents survive a simulated reboot or a
+// second process; otherwise by memory. While it exists, the esp_partition_* calls find it by
+// label (or by subtype, like the legacy spiffs partition).
+class FlashSim {
+ public:
+  static const uint32_t SECTOR_SIZE = 4096;
+
+  // Typical datasheet times of a 16 MB SPI NOR chip; every operation advances the caller's clock
+  struct Timing {
+    uint32_t sector_erase_us{45000};
+    uint32_t block_erase_us{150000};  // 64 KB, when the range allows it
+    uint32_t page_program_us{700};    // per 256 bytes
+    uint32_t read_kb_us{25};          // per KB through esp_partition_read
+  };
+  struct Stats {
+    uint32_t sector_erases{0};
+    uint32_t block_erases{0};
+    uint64_t bytes_programmed{0};
+    // Programs that tried to set a bit the last erase had not set; on the chip they are lost
+    uint32_t unerased_writes{0};
+    uint32_t mmaps{0};
+    uint64_t busy_us{0};
+  };
+
+  FlashSim(const char *label, uint32_t size, esp_partition_subtype_t subtype = (esp_partition_subtype_t) 0x40,
+           const std::string &path = "");
+  ~FlashSim();
+  FlashSim(const FlashSim &) = delete;
+  FlashSim &operator=(const FlashSim &) = delete;
+
+  const esp_partition_t *partition() const { return &this->partition_; }
+  uint8_t *data() { return this->data_; }
+  uint32_t size() const { return this->partition_.size; }
+
+  // Power cut: after `bytes` more programmed bytes, the write in progress stops part way and
+  // every later erase or write fails (-1 restores power)
+  void cut_power_after(int64_t bytes) { this->power_budget_ = bytes; }
+  bool powered() const { return this->power_budget_ != 0; }
+  // Mappings not yet released with esp_partition_munmap()
+  int open_mappings() const { return this->open_mappings_; }
+
+  Timing timing;
+  Stats stats;
+  // (offset, size) of every erase, in order
+  std::vector<std::pair<uint32_t, uint32_t>> erase_log;
+
+  esp_err_t read(size_t offset, void *dst, size_t size);
+  esp_err_t write(size_t offset, const void *src, size_t size);
+  esp_err_t erase(size_t offset, size_t size);
+  esp_err_t mmap(size_t offset, size_t size, const void **out, esp_partition_mmap_handle_t *handle);
+  void munmap() { this->open_mappings_--; }
+
+ protected:
+  void spend(uint64_t us);
+
+  esp_partition_t partition_{};
+  uint8_t *data_{nullptr};
+  int fd_{-1};
+  int64_t power_budget_{-1};
+  int open_mappings_{0};
+};
+
+}  // namespace epd_sim
@@ -0,0 +1,214 @@
+#include "sim/http.h"
+#include "sim/clock.h"
+#include <esp_http_client.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <mutex>
+
+namespace epd_sim {
+
+namespace {
+
+std::mutex http_lock;
+HttpServer *server = nullptr;
+Link current_link;
+HttpStats stats;
+int64_t link_budget = -1;  // body bytes until the link drops, -1 while it stays up
+
+std::string lower(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return (char) tolower(c); });
+  return s;
+}
+
+}  // namespace
+
+std::string HttpRequest::header(const std::string &name) const {
+  auto it = this->headers.find(lower(name));
+  return it != this->headers.end() ? it->second : std::string();
+}
+
+std::string HttpRequest::param(const std::string &name) const {
+  size_t pos = 0;
+  while (pos <= this->query.size()) {
+    size_t end = this->query.find('&', pos);
+    if (end == std::string::npos) end = this->query.size();
+    const std::string pair = this->query.substr(pos, end - pos);
+    const size_t eq = pair.find('=');
+    if (pair.substr(0, eq) == name) return eq == std::string::npos ? std::string() : pair.substr(eq + 1);
+    pos = end + 1;
+  }
+  return std::string();
+}
+
+void set_http_server(HttpServer *s) {
+  std::lock_guard<std::mutex> lock(http_lock);
+  server = s;
+}
+Link &link() { return current_link; }
+HttpStats &http_stats() { return stats; }
+void reset_http_stats() {
+  std::lock_guard<std::mutex> lock(http_lock);
+  stats = HttpStats{};
+}
+void lose_link_after(int64_t bytes) {
+  std::lock_guard<std::mutex> lock(http_lock);
+  link_budget = bytes;
+}
+
+}  // namespace epd_sim
+
+struct esp_http_client {
+  esp_http_client_config_t config;
+  std::string path;
+  std::string query;
+  std::map<std::string, std::string> headers;
+  bool connected{false};
+  bool response_open{false};
+  epd_sim::HttpResponse response;
+  size_t read_pos{0};
+};
+
+using epd_sim::http_lock;
+
+static void dispatch(esp_http_client_handle_t client, esp_http_client_event_id_t id, const char *key = nullptr,
+                     const char *value = nullptr) {
+  if (client->config.event_handler == nullptr) return;
+  esp_http_client_event_t evt{};
+  evt.event_id = id;
+  evt.client = client;
+  evt.user_data = client->config.user_data;
+  evt.header_key = const_cast<char *>(key);
+  evt.header_value = const_cast<char *>(value);
+  client->config.event_handler(&evt);
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config) {
+  auto *client = new esp_http_client();
+  client->config = *config;
+  client->config.url = nullptr;
+  esp_http_client_set_url(client, config->url);
+  return client;
+}
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char *url) {
+  // http://host[:port]/path?query; only the path and query reach the server
+  std::string rest = url;
+  const size_t scheme = rest.find("://");
+  if (scheme != std::string::npos) rest = rest.substr(scheme + 3);
+  const size_t slash = rest.find('/');
+  rest = slash == std::string::npos ? "/" : rest.substr(slash);
+  const size_t q = rest.find('?');
+  client->path = rest.substr(0, q);
+  client->query = q == std::string::npos ? "" : rest.substr(q + 1);
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value) {
+  client->headers[epd_sim::lower(key)] = value;
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char *key) {
+  client->headers.erase(epd_sim::lower(key));
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len) {
+  epd_sim::Link link;
+  epd_sim::HttpServer *server;
+  {
+    std::lock_guard<std::mutex> lock(http_lock);
+    link = epd_sim::current_link;
+    server = epd_sim::server;
+    // A keep-alive connection is only reusable once the previous body was read to the end
+    if (client->response_open && client->read_pos < client->response.body.size()) client->connected = false;
+    if (client->connected && epd_sim::link_budget == 0) client->connected = false;
+    if (!client->connected) {
+      if (epd_sim::link_budget == 0) {
+        epd_sim::stats.dropped++;
+        epd_sim::advance_us(link.connect_us);
+        return ESP_FAIL;
+      }
+      epd_sim::stats.connections++;
+    }
+  }
+  if (server == nullptr) return ESP_FAIL;
+  if (!client->connected) {
+    epd_sim::advance_us(link.connect_us);
+    client->connected = true;
+    dispatch(client, HTTP_EVENT_ON_CONNECTED);
+  }
+  epd_sim::HttpRequest request;
+  request.method = client->config.method == HTTP_METHOD_HEAD ? "HEAD" : "GET";
+  request.path = client->path;
+  request.query = client->query;
+  request.headers = client->headers;
+  client->response = server->handle(request);
+  client->response_open = true;
+  client->read_pos = 0;
+  epd_sim::advance_us(link.rtt_us + client->response.server_us);
+  std::lock_guard<std::mutex> lock(http_lock);
+  epd_sim::stats.requests++;
+  std::string line = request.method + " " + request.path + (request.query.empty() ? "" : "?" + request.query);
+  if (!request.header("range").empty()) line += " [" + request.header("range") + "]";
+  epd_sim::stats.log.push_back(line + " -> " + std::to_string(client->response.status));
+  return ESP_OK;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client) {
+  if (!client->response_open) return ESP_FAIL;
+  for (const auto &h : client->response.headers) dispatch(client, HTTP_EVENT_ON_HEADER, h.first.c_str(), h.second.c_str());
+  return (int64_t) client->response.body.size();
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len) {
+  if (!client->response_open || !client->connected) return -1;
+  if (client->read_pos >= client->response.body.size()) return 0;
+  size_t n = std::min<size_t>(len, client->response.body.size() - client->read_pos);
+  double bytes_per_s;
+  {
+    std::lock_guard<std::mutex> lock(http_lock);
+    if (epd_sim::link_budget == 0) {
+      // The connection dropped part way through the body
+      client->connected = false;
+      epd_sim::stats.dropped++;
+      return -1;
+    }
+    if (epd_sim::link_budget > 0) {
+      n = std::min<size_t>(n, epd_sim::link_budget);
+      epd_sim::link_budget -= n;
+    }
+    epd_sim::stats.body_bytes += n;
+    bytes_per_s = epd_sim::current_link.bytes_per_s;
+  }
+  memcpy(buffer, client->response.body.data() + client->read_pos, n);
+  client->read_pos += n;
+  epd_sim::advance_us((uint64_t) (n * 1e6 / bytes_per_s));
+  return (int) n;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) {
+  return client->response_open ? client->response.status : -1;
+}
+
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client) {
+  return client->response_open ? (int64_t) client->response.body.size() : -1;
+}
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client) {
+  return client->response_open && client->read_pos >= client->response.body.size();
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client) {
+  if (client->connected) dispatch(client, HTTP_EVENT_DISCONNECTED);
+  client->connected = false;
+  client->response_open = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client) {
+  esp_http_client_close(client);
+  delete client;
+  return ESP_OK;
+}
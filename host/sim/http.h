@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace epd_sim {
+
+struct HttpRequest {
+  std::string method;
+  std::string path;
+  std::string query;
+  std::map<std::string, std::string> headers;  // names in lower case
+
+  // Empty when absent
+  std::string header(const std::string &name) const;
+  std::string param(const std::string &name) const;
+};
+
+struct HttpResponse {
+  int status{200};
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string body;
+  uint32_t server_us{0};  // time the server takes before the first byte
+};
+
+// The in-process backend esp_http_client talks to
+class HttpServer {
+ public:
+  virtual ~HttpServer() = default;
+  virtual HttpResponse handle(const HttpRequest &request) = 0;
+};
+
+// The Wi-Fi link and the path to the server. Bodies arrive at bytes_per_s; every request costs
+// a round trip, and a new connection a handshake on top.
+struct Link {
+  double bytes_per_s{250000};
+  uint32_t rtt_us{20000};
+  uint32_t connect_us{30000};
+};
+
+struct HttpStats {
+  int requests{0};
+  int connections{0};
+  uint64_t body_bytes{0};  // bytes the client read
+  int dropped{0};          // reads and connects that failed because the link was down
+  // "GET /path?query [Range] -> status", one per request
+  std::vector<std::string> log;
+};
+
+void set_http_server(HttpServer *server);
+Link &link();
+HttpStats &http_stats();
+void reset_http_stats();
+// The link goes down once the client has read `bytes` more body bytes: the read in progress
+// stops there, the connection drops and new ones fail until lose_link_after(-1) restores it
+void lose_link_after(int64_t bytes);
+
+}  // namespace epd_sim
@@ -0,0 +1,159 @@
+#include "sim/panel.h"
+#include "sim/clock.h"
+#include "sim/png.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <zlib.h>
+
+namespace epd_sim {
+
+// Controller commands the model reacts to (see panel_traits.h)
+static const uint8_t CMD_POF = 0x02;
+static const uint8_t CMD_PON = 0x04;
+static const uint8_t CMD_DTM = 0x10;
+static const uint8_t CMD_DRF = 0x12;
+
+void SimPin::digital_write(bool value) {
+  this->level_ = value;
+  if (this->on_write_) this->on_write_(value);
+}
+
+PanelSim::PanelSim() {
+  this->cs_master.digital_write(true);
+  this->cs_slave.digital_write(true);
+  // The line reads low while a controller is busy, at the reader's own time
+  this->busy.set_reader([this] { return !this->busy_at(now_us()); });
+  this->reset.on_write([this](bool high) {
+    std::lock_guard<std::mutex> lock(this->lock_);
+    if (!high) {
+      this->reset_low_ = true;
+    } else if (this->reset_low_) {
+      this->reset_low_ = false;
+      this->stats.resets++;
+      for (Controller *c : {&this->master, &this->slave}) {
+        c->command = 0xFF;
+        c->pointer = 0;
+      }
+    }
+  });
+}
+
+void PanelSim::begin_transaction(uint32_t data_rate) {
+  this->data_rate_ = data_rate;
+  advance_us(this->timing.transaction_us);
+  std::lock_guard<std::mutex> lock(this->lock_);
+  this->stats.transactions++;
+  this->stats.spi_us += this->timing.transaction_us;
+}
+
+void PanelSim::end_transaction() {}
+
+void PanelSim::write(const uint8_t *data, size_t len) {
+  const uint64_t bus_us = this->data_rate_ > 0 ? (uint64_t) len * 8 * 1000000 / this->data_rate_ : 0;
+  const uint8_t cs = (this->cs_master.level() ? 0 : CS_MASTER) | (this->cs_slave.level() ? 0 : CS_SLAVE);
+  const bool dc = this->dc.level();
+  std::lock_guard<std::mutex> lock(this->lock_);
+  if (this->keep_trace) {
+    TraceEntry entry{now_us(), cs, dc, (uint32_t) len, (uint32_t) crc32(0, data, len), {}};
+    entry.head.assign(data, data + std::min<size_t>(len, 16));
+    this->trace.push_back(std::move(entry));
+  }
+  (dc ? this->stats.data_bytes : this->stats.command_bytes) += len;
+  if (cs == 0) this->stats.unselected_bytes += len;
+  if (cs == CS_MASTER) this->slave.dtm_interrupted = this->slave.command == CMD_DTM;
+  if (cs == CS_SLAVE) this->master.dtm_interrupted = this->master.command == CMD_DTM;
+  if (cs & CS_MASTER) this->receive(this->master, CS_MASTER, dc, data, len);
+  if (cs & CS_SLAVE) this->receive(this->slave, CS_SLAVE, dc, data, len);
+  // The bytes are on the wire before the write returns
+  advance_us(bus_us);
+  this->stats.spi_us += bus_us;
+}
+
+void PanelSim::receive(Controller &c, uint8_t cs_bit, bool dc, const uint8_t *data, size_t len) {
+  if (!dc) {
+    for (size_t i = 0; i < len; i++) {
+      c.command = data[i];
+      this->commands.push_back({cs_bit, c.command, {}});
+      const uint64_t now = now_us();
+      uint32_t busy_for = 0;
+      if (c.command == CMD_DTM) {
+        c.pointer = 0;
+        c.dtm_interrupted = false;
+      } else if (c.command == CMD_PON) {
+        busy_for = this->timing.power_on_us;
+      } else if (c.command == CMD_DRF) {
+        c.glass = c.ram;
+        c.refreshes++;
+        busy_for = this->timing.refresh_us;
+      } else if (c.command == CMD_POF) {
+        busy_for = this->timing.power_off_us;
+      }
+      if (busy_for > 0) this->busy_until_us_ = std::max<uint64_t>(this->busy_until_us_, now + busy_for);
+    }
+    return;
+  }
+  if (c.command != CMD_DTM) {
+    // Parameters go with the last command this controller received
+    for (auto it = this->commands.rbegin(); it != this->commands.rend(); ++it) {
+      if (it->cs != cs_bit) continue;
+      it->params.insert(it->params.end(), data, data + len);
+      break;
+    }
+    return;
+  }
+  if (this->busy_at(now_us())) this->stats.dtm_while_busy += len;
+  this->stats.dtm_bytes += len;
+  if (c.dtm_interrupted) this->stats.dtm_after_switch += len;
+  const size_t room = c.pointer < c.ram.size() ? c.ram.size() - c.pointer : 0;
+  const size_t n = std::min(room, len);
+  memcpy(c.ram.data() + c.pointer, data, n);
+  c.pointer += n;
+  c.overflow += len - n;
+}
+
+std::vector<uint8_t> PanelSim::glass_indices() const {
+  std::vector<uint8_t> out((size_t) WIDTH * HEIGHT);
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      const Controller &c = x < WIDTH / 2 ? this->master : this->slave;
+      const int cx = x % (WIDTH / 2);
+      const uint8_t byte = c.glass[(size_t) y * HALF_ROW + cx / 2];
+      out[(size_t) y * WIDTH + x] = (cx & 1) ? (byte & 0x0F) : (byte >> 4);
+    }
+  }
+  return out;
+}
+
+bool PanelSim::write_png(const std::string &path) const {
+  // Spectra6 inks by controller index, as in server/app/image_proc.py
+  static const uint8_t RGB[16][3] = {
+      {0, 0, 0},     {255, 255, 255}, {255, 255, 0}, {255, 0, 0},   {255, 0, 255}, {0, 0, 255},
+      {0, 255, 0},   {255, 0, 255},   {255, 0, 255}, {255, 0, 255}, {255, 0, 255}, {255, 0, 255},
+      {255, 0, 255}, {255, 0, 255},   {255, 0, 255}, {255, 0, 255},
+  };
+  const std::vector<uint8_t> indices = this->glass_indices();
+  std::vector<uint8_t> rgb(indices.size() * 3);
+  for (size_t i = 0; i < indices.size(); i++) memcpy(&rgb[i * 3], RGB[indices[i]], 3);
+  return epd_sim::write_png(path, WIDTH, HEIGHT, rgb);
+}
+
+bool PanelSim::write_trace(const std::string &path) const {
+  FILE *f = fopen(path.c_str(), "w");
+  if (f == nullptr) return false;
+  static const char *const CS_NAMES[] = {"-", "M", "S", "MS"};
+  for (const TraceEntry &e : this->trace) {
+    fprintf(f, "%llu %s %s %u %08x", (unsigned long long) e.t_us, CS_NAMES[e.cs], e.dc ? "D" : "C", e.len, e.crc);
+    for (uint8_t b : e.head) fprintf(f, " %02x", b);
+    fprintf(f, "\n");
+  }
+  return fclose(f) == 0;
+}
+
+void PanelSim::clear_trace() {
+  std::lock_guard<std::mutex> lock(this->lock_);
+  this->trace.clear();
+  this->commands.clear();
+}
+
+}  // namespace epd_sim
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "esphome/core/gpio.h"
+#include "esphome/components/spi/spi.h"
+
+namespace epd_sim {
+
+// A GPIO whose level the panel model reads (outputs) or drives (BUSY)
+class SimPin : public esphome::GPIOPin {
+ public:
+  void setup() override {}
+  void digital_write(bool value) override;
+  bool digital_read() override { return this->reader_ ? this->reader_() : this->level_; }
+  bool level() const { return this->level_; }
+  void on_write(std::function<void(bool)> &&f) { this->on_write_ = std::move(f); }
+  void set_reader(std::function<bool()> &&f) { this->reader_ = std::move(f); }
+
+ protected:
+  bool level_{false};
+  std::function<void(bool)> on_write_;
+  std::function<bool()> reader_;
+};
+
+// The Waveshare 13.3" Spectra6 panel as the driver sees it: the SPI bus, the two controllers
+// behind CS_M and CS_S, DC and a BUSY line both controllers pull low. Every transaction is kept
+// in a trace (time, chip selects, DC, bytes), DTM data lands in each controller's RAM, and DRF
+// latches that RAM as the picture on the glass, which can be rebuilt as a PNG.
+class PanelSim : public esphome::spi::SPIComponent {
+ public:
+  static const int WIDTH = 1200;
+  static const int HEIGHT = 1600;
+  // Each controller holds 600x1600 pixels at 4 bpp
+  static const int HALF_ROW = 300;
+  static const int RAM_SIZE = HALF_ROW * HEIGHT;
+
+  static const uint8_t CS_MASTER = 1;
+  static const uint8_t CS_SLAVE = 2;
+
+  struct Timing {
+    uint32_t power_on_us{120000};
+    uint32_t refresh_us{19000000};  // DRF: the full Spectra6 waveform
+    uint32_t power_off_us{40000};
+    // CPU and driver time around each SPI transaction (queue, CS, DMA setup)
+    uint32_t transaction_us{12};
+  };
+
+  // One SPI transaction: what was selected, DC, and the bytes (the first 16 and a CRC of all)
+  struct TraceEntry {
+    uint64_t t_us;
+    uint8_t cs;
+    bool dc;
+    uint32_t len;
+    uint32_t crc;
+    std::vector<uint8_t> head;
+  };
+
+  // A command as one controller received it, with the parameter bytes that followed (DTM data
+  // is not kept here)
+  struct Command {
+    uint8_t cs;
+    uint8_t command;
+    std::vector<uint8_t> params;
+  };
+
+  struct Controller {
+    std::vector<uint8_t> ram = std::vector<uint8_t>(RAM_SIZE, 0x11);
+    std::vector<uint8_t> glass = std::vector<uint8_t>(RAM_SIZE, 0x11);
+    uint8_t command{0xFF};
+    size_t pointer{0};
+    uint32_t overflow{0};  // DTM bytes past the end of RAM
+    bool dtm_interrupted{false};  // the other controller was written to since this DTM began
+    int refreshes{0};
+  };
+
+  struct Stats {
+    uint64_t transactions{0};
+    uint64_t command_bytes{0};
+    uint64_t data_bytes{0};
+    uint64_t dtm_bytes{0};  // summed over both controllers
+    uint64_t spi_us{0};  // bus time, overhead included
+    // DTM bytes that arrived while BUSY was low, which the controller ignores on the real panel
+    uint64_t dtm_while_busy{0};
+    // Bytes sent with neither controller selected
+    uint64_t unselected_bytes{0};
+    // DTM bytes a controller received after the other one was written to in the middle of its
+    // transfer; whether it keeps its write pointer then is not documented, so the driver avoids it
+    uint64_t dtm_after_switch{0};
+    int resets{0};
+  };
+
+  PanelSim();
+
+  SimPin cs_master, cs_slave, dc, reset, busy, power;
+  Timing timing;
+  Controller master, slave;
+  Stats stats;
+  std::vector<TraceEntry> trace;
+  std::vector<Command> commands;
+  bool keep_trace{true};
+
+  // BUSY is low until this time
+  uint64_t busy_until_us() const { return this->busy_until_us_; }
+  bool busy_at(uint64_t t_us) const { return t_us < this->busy_until_us_; }
+
+  void begin_transaction(uint32_t data_rate) override;
+  void end_transaction() override;
+  void write(const uint8_t *data, size_t len) override;
+
+  // Panel colour index of every pixel on the glass (after the last DRF), row by row
+  std::vector<uint8_t> glass_indices() const;
+  // The glass as an RGB PNG; nibbles without an ink show up magenta
+  bool write_png(const std::string &path) const;
+  // One line per transaction: "t_us cs dc len crc head..."
+  bool write_trace(const std::string &path) const;
+  void clear_trace();
+
+ protected:
+  void receive(Controller &c, uint8_t cs_bit, bool dc, const uint8_t *data, size_t len);
+
+  std::mutex lock_;
+  uint32_t data_rate_{0};
+  std::atomic<uint64_t> busy_until_us_{0};
+  bool reset_low_{false};
+};
+
+}  // namespace epd_sim
@@ -0,0 +1,48 @@
+#include "sim/png.h"
+#include <cstdio>
+#include <zlib.h>
+
+namespace epd_sim {
+
+static void put_u32(std::vector<uint8_t> &out, uint32_t v) {
+  for (int shift = 24; shift >= 0; shift -= 8) out.push_back((uint8_t) (v >> shift));
+}
+
+static void put_chunk(std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &payload) {
+  put_u32(out, (uint32_t) payload.size());
+  const size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), payload.begin(), payload.end());
+  put_u32(out, crc32(0, out.data() + start, (uInt) (out.size() - start)));
+}
+
+bool write_png(const std::string &path, int width, int height, const std::vector<uint8_t> &rgb) {
+  if (rgb.size() != (size_t) width * height * 3) return false;
+  // Every row starts with filter type 0 (none)
+  std::vector<uint8_t> raw;
+  raw.reserve((size_t) (width * 3 + 1) * height);
+  for (int y = 0; y < height; y++) {
+    raw.push_back(0);
+    raw.insert(raw.end(), rgb.begin() + (size_t) y * width * 3, rgb.begin() + (size_t) (y + 1) * width * 3);
+  }
+  uLongf packed_len = compressBound(raw.size());
+  std::vector<uint8_t> packed(packed_len);
+  if (compress2(packed.data(), &packed_len, raw.data(), raw.size(), 6) != Z_OK) return false;
+  packed.resize(packed_len);
+
+  std::vector<uint8_t> out = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  std::vector<uint8_t> header;
+  put_u32(header, width);
+  put_u32(header, height);
+  header.insert(header.end(), {8, 2, 0, 0, 0});  // 8 bits, truecolour, deflate, no filter, no interlace
+  put_chunk(out, "IHDR", header);
+  put_chunk(out, "IDAT", packed);
+  put_chunk(out, "IEND", {});
+
+  FILE *f = fopen(path.c_str(), "wb");
+  if (f == nullptr) return false;
+  const bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+  return fclose(f) == 0 && ok;
+}
+
+}  // namespace epd_sim
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace epd_sim {
+
+// 8-bit RGB PNG (rgb holds width * height * 3 bytes, row by row); false if the file cannot be
+// written
+bool write_png(const std::string &path, int width, int height, const std::vector<uint8_t> &rgb);
+
+}  // namespace epd_sim
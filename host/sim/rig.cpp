@@ -0,0 +1,75 @@
+#include "sim/rig.h"
+#include "sim/esphome_host.h"
+#include "esphome/core/hal.h"
+
+namespace epd_sim {
+
+Rig::Rig(uint32_t partition_size, const std::string &flash_path) : flash("frames", partition_size,
+                                                                         (esp_partition_subtype_t) 0x40, flash_path) {
+  set_http_server(&this->server);
+  reset_http_stats();
+  clear_preferences();
+  link() = Link{};
+}
+
+Rig::~Rig() {
+  wait_for_tasks();
+  this->frame.reset();
+  set_http_server(nullptr);
+}
+
+void Rig::boot(bool stream, uint32_t spi_rate) {
+  wait_for_tasks();
+  reset_clock();
+  this->frame = std::make_unique<HostFrame>();
+  HostFrame *f = this->frame.get();
+  f->set_reset_pin(&this->panel.reset);
+  f->set_dc_pin(&this->panel.dc);
+  f->set_busy_pin(&this->panel.busy);
+  f->set_power_pin(&this->panel.power);
+  f->set_cs_master_pin(&this->panel.cs_master);
+  f->set_cs_slave_pin(&this->panel.cs_slave);
+  f->assign_spi_parent(&this->panel);
+  f->set_data_rate(spi_rate);
+  f->set_image_url("http://frame.test/images/next?device_id=host-rig");
+  f->set_stream_display(stream);
+  f->set_download_bytes_sensor(&this->download_bytes);
+  f->set_download_success_binary(&this->download_success);
+  f->set_download_status_text(&this->download_status);
+  f->set_download_throughput_sensor(&this->throughput);
+  f->set_cache_depth_sensor(&this->cache_depth);
+  f->add_on_refresh_complete_callback([this](bool ok) {
+    this->refreshes++;
+    this->last_refresh_ok = ok;
+  });
+  this->download_status.state.clear();
+  f->setup();
+}
+
+void Rig::download() {
+  this->frame->startDownload();
+  wait_for_tasks();
+}
+
+bool Rig::refresh() {
+  const int before = this->refreshes;
+  // One loop() to pick up a streamed frame, then until BUSY has been released three times
+  this->frame->loop();
+  for (int i = 0; i < 10000 && this->frame->isRefreshing(); i++) {
+    esphome::delay(10);
+    this->frame->loop();
+  }
+  return this->refreshes > before && this->last_refresh_ok;
+}
+
+bool Rig::wake() {
+  this->download();
+  // A streamed frame is refreshed from loop(); displayFromFile() then finds it already shown
+  this->frame->loop();
+  this->frame->displayFromFile();
+  return this->refresh();
+}
+
+void Rig::serve(uint32_t seed, Layout layout) { this->server.frames.push_back(pack_frame(test_picture(seed), layout)); }
+
+}  // namespace epd_sim
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "epd_photo_frame.h"
+#include "sim/backend.h"
+#include "sim/clock.h"
+#include "sim/flash.h"
+#include "sim/http.h"
+#include "sim/panel.h"
+#include "sim/rtos.h"
+
+namespace epd_sim {
+
+// The component with its protected state opened up for the tests
+class HostFrame : public esphome::epd_photo_frame::EPDPhotoFrame {
+ public:
+  using EPDPhotoFrame::store_;
+  using EPDPhotoFrame::resume_;
+  using EPDPhotoFrame::cache_;
+  using EPDPhotoFrame::displayed_etag_;
+  using EPDPhotoFrame::frame_etag_;
+  using EPDPhotoFrame::data_rate_;
+  using EPDPhotoFrame::initDisplay;
+  using EPDPhotoFrame::sendImageDataFromStore;
+  using EPDPhotoFrame::RESUME_CHUNK_SIZE;
+  using EPDPhotoFrame::FRAME_DATA_SIZE;
+};
+
+// One device on the bench: flash partition, panel, backend and the component wired together
+// the way esphome_example.yaml wires them. Only one rig may exist at a time (the partition and
+// the backend are found globally, as on the device).
+class Rig {
+ public:
+  // 0x470000 is the frames partition of partitions_8mb.csv (four slots); 0x170000 that of
+  // partitions.csv (one slot)
+  explicit Rig(uint32_t partition_size = 0x470000, const std::string &flash_path = "");
+  ~Rig();
+
+  FlashSim flash;
+  PanelSim panel;
+  FrameServer server;
+  std::unique_ptr<HostFrame> frame;
+
+  esphome::sensor::Sensor download_bytes, throughput, cache_depth;
+  esphome::binary_sensor::BinarySensor download_success;
+  esphome::text_sensor::TextSensor download_status;
+
+  // Power on (or wake from deep sleep): a new component instance over the same flash, NVS and
+  // panel RAM, the clock back at 0, then setup()
+  void boot(bool stream = false, uint32_t spi_rate = esphome::spi::DATA_RATE_10MHZ);
+  // startDownload() and wait for the task, as the wake script does
+  void download();
+  // Run loop() every 10 ms until the refresh (including one a stream queued) is done; returns
+  // what the refresh callback reported, false if none ran
+  bool refresh();
+  // download(), displayFromFile() unless the frame was streamed, refresh()
+  bool wake();
+  // Append the test picture for seed to the backend's frames
+  void serve(uint32_t seed, Layout layout = Layout::SPLIT);
+
+  int refreshes{0};
+  bool last_refresh_ok{false};
+};
+
+}  // namespace epd_sim
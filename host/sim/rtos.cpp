@@ -0,0 +1,180 @@
+#include "sim/rtos.h"
+#include "sim/clock.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct HostTask {
+  std::mutex lock;
+  std::condition_variable cv;
+  uint32_t notify_count{0};
+  uint64_t notify_us{0};
+  bool done{false};
+  uint64_t end_us{0};
+  std::thread thread;
+};
+
+struct HostQueue {
+  std::mutex lock;
+  std::condition_variable cv;
+  size_t item_size;
+  size_t capacity;
+  // Each item carries the time it was sent at
+  std::deque<std::pair<std::vector<uint8_t>, uint64_t>> items;
+  // Time each free place became free, oldest first
+  std::deque<uint64_t> free_at;
+};
+
+namespace {
+
+std::mutex tasks_lock;
+std::condition_variable tasks_cv;
+std::vector<std::unique_ptr<HostTask>> tasks;
+HostTask main_task;
+thread_local HostTask *current_task = &main_task;
+std::atomic<int> allocations_left{-1};
+
+// A finite FreeRTOS timeout is also a bound on how long the host waits for real, so a test that
+// stalls a task fails instead of hanging
+template<typename Pred> bool wait_until(std::unique_lock<std::mutex> &lock, std::condition_variable &cv,
+                                        TickType_t ticks, Pred ready) {
+  if (ticks == portMAX_DELAY) {
+    cv.wait(lock, ready);
+    return true;
+  }
+  if (cv.wait_for(lock, std::chrono::milliseconds(ticks), ready)) return true;
+  epd_sim::advance_us((uint64_t) ticks * 1000);
+  return false;
+}
+
+}  // namespace
+
+namespace epd_sim {
+
+void wait_for_tasks() {
+  std::unique_lock<std::mutex> lock(tasks_lock);
+  tasks_cv.wait(lock, [] {
+    return std::all_of(tasks.begin(), tasks.end(), [](const std::unique_ptr<HostTask> &t) { return t->done; });
+  });
+  for (auto &task : tasks) {
+    if (task->thread.joinable()) task->thread.join();
+    sync_to(task->end_us);
+  }
+  tasks.clear();
+}
+
+int running_tasks() {
+  std::lock_guard<std::mutex> lock(tasks_lock);
+  return (int) std::count_if(tasks.begin(), tasks.end(), [](const std::unique_ptr<HostTask> &t) { return !t->done; });
+}
+
+void fail_allocations_after(int count) { allocations_left = count; }
+
+}  // namespace epd_sim
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stack_depth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t core) {
+  auto task = std::make_unique<HostTask>();
+  HostTask *handle = task.get();
+  const uint64_t start_us = epd_sim::now_us();
+  {
+    std::lock_guard<std::mutex> lock(tasks_lock);
+    tasks.push_back(std::move(task));
+  }
+  if (created != nullptr) *created = handle;
+  handle->thread = std::thread([handle, code, param, start_us] {
+    current_task = handle;
+    epd_sim::sync_to(start_us);
+    code(param);
+  });
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  HostTask *self = task != nullptr ? task : current_task;
+  std::lock_guard<std::mutex> lock(tasks_lock);
+  self->end_us = epd_sim::now_us();
+  self->done = true;
+  tasks_cv.notify_all();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() { return current_task; }
+
+void vTaskDelay(TickType_t ticks) { epd_sim::advance_us((uint64_t) ticks * 1000); }
+
+TickType_t xTaskGetTickCount() { return (TickType_t) epd_sim::now_ms(); }
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+  HostTask *self = current_task;
+  std::unique_lock<std::mutex> lock(self->lock);
+  if (!wait_until(lock, self->cv, ticks_to_wait, [self] { return self->notify_count > 0; })) return 0;
+  epd_sim::sync_to(self->notify_us);
+  const uint32_t count = self->notify_count;
+  self->notify_count = clear_on_exit ? 0 : count - 1;
+  // A consumed notification must not hold back a later one, e.g. after reset_clock()
+  if (self->notify_count == 0) self->notify_us = 0;
+  return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  std::lock_guard<std::mutex> lock(task->lock);
+  task->notify_count++;
+  task->notify_us = std::max(task->notify_us, epd_sim::now_us());
+  task->cv.notify_all();
+  return pdPASS;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  auto *queue = new HostQueue();
+  queue->item_size = item_size;
+  queue->capacity = length;
+  queue->free_at.assign(length, 0);
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!wait_until(lock, queue->cv, ticks_to_wait, [queue] { return !queue->free_at.empty(); })) return pdFALSE;
+  epd_sim::sync_to(queue->free_at.front());
+  queue->free_at.pop_front();
+  const uint8_t *bytes = static_cast<const uint8_t *>(item);
+  queue->items.emplace_back(std::vector<uint8_t>(bytes, bytes + queue->item_size), epd_sim::now_us());
+  queue->cv.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait) {
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!wait_until(lock, queue->cv, ticks_to_wait, [queue] { return !queue->items.empty(); })) return pdFALSE;
+  epd_sim::sync_to(queue->items.front().second);
+  memcpy(item, queue->items.front().first.data(), queue->item_size);
+  queue->items.pop_front();
+  queue->free_at.push_back(epd_sim::now_us());
+  queue->cv.notify_all();
+  return pdTRUE;
+}
+
+void vQueueDelete(QueueHandle_t queue) { delete queue; }
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+  int left = allocations_left.load();
+  while (left != -1) {
+    if (left == 0) return nullptr;
+    if (allocations_left.compare_exchange_weak(left, left - 1)) break;
+  }
+  return malloc(size);
+}
+
+void heap_caps_free(void *ptr) { free(ptr); }
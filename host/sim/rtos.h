@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+namespace epd_sim {
+
+// Wait for every task started so far to call vTaskDelete(nullptr), then move the caller's
+// clock to the latest time one of them ended at. A test uses it after startDownload() the way
+// the device's main loop would notice the task is gone.
+void wait_for_tasks();
+// Tasks currently running
+int running_tasks();
+// The next heap_caps_malloc() calls fail once count allocations have succeeded (-1: never)
+void fail_allocations_after(int count);
+
+}  // namespace epd_sim
@@ -0,0 +1,9 @@
+#pragma once
+
+// RTC memory is ordinary static storage on the host: it survives a simulated deep sleep (a new
+// component in the same process) like RTC_NOINIT memory survives one on the device
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+// Same polynomial and conditioning as zlib's crc32(), which the backend's manifest uses
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+#include "esphome/core/component.h"
+
+namespace esphome {
+
+template<typename T> using optional = std::optional<T>;
+
+struct Color {
+  uint8_t r{0}, g{0}, b{0}, w{0};
+  constexpr Color() = default;
+  constexpr Color(uint8_t r, uint8_t g, uint8_t b, uint8_t w = 0) : r(r), g(g), b(b), w(w) {}
+  bool is_on() const { return this->r != 0 || this->g != 0 || this->b != 0 || this->w != 0; }
+};
+
+static constexpr Color COLOR_OFF(0, 0, 0, 0);
+static constexpr Color COLOR_ON(255, 255, 255, 255);
+
+namespace display {
+
+enum DisplayType { DISPLAY_TYPE_BINARY = 1, DISPLAY_TYPE_GRAYSCALE = 2, DISPLAY_TYPE_COLOR = 3 };
+enum DisplayRotation {
+  DISPLAY_ROTATION_0_DEGREES = 0,
+  DISPLAY_ROTATION_90_DEGREES = 90,
+  DISPLAY_ROTATION_180_DEGREES = 180,
+  DISPLAY_ROTATION_270_DEGREES = 270,
+};
+
+struct Rect {
+  int16_t x{0}, y{0}, w{0}, h{0};
+  Rect() = default;
+  Rect(int16_t x, int16_t y, int16_t w, int16_t h) : x(x), y(y), w(w), h(h) {}
+  bool inside(int16_t px, int16_t py) const { return px >= x && px < x + w && py >= y && py < y + h; }
+};
+
+class Display;
+using display_writer_t = std::function<void(Display &)>;
+
+class DisplayPage {
+ public:
+  explicit DisplayPage(display_writer_t writer) : writer_(std::move(writer)) {}
+  const display_writer_t &get_writer() const { return this->writer_; }
+
+ protected:
+  display_writer_t writer_;
+};
+
+// The drawing subset the overlay needs: pixels and filled rectangles, with clipping and
+// do_update_() as in ESPHome (auto clear, page or lambda, then the clipping is dropped)
+class Display : public PollingComponent {
+ public:
+  virtual void fill(Color color) {}
+  void clear() { this->fill(COLOR_OFF); }
+  int get_width() { return this->get_width_internal(); }
+  int get_height() { return this->get_height_internal(); }
+  virtual int get_width_internal() = 0;
+  virtual int get_height_internal() = 0;
+  virtual DisplayType get_display_type() = 0;
+
+  void draw_pixel_at(int x, int y, Color color) {
+    if (!this->clipping_.empty() && !this->clipping_.back().inside(x, y)) return;
+    if (x < 0 || y < 0 || x >= this->get_width() || y >= this->get_height()) return;
+    this->draw_absolute_pixel_internal(x, y, color);
+  }
+  void filled_rectangle(int x1, int y1, int width, int height, Color color) {
+    for (int y = y1; y < y1 + height; y++) {
+      for (int x = x1; x < x1 + width; x++) this->draw_pixel_at(x, y, color);
+    }
+  }
+
+  void set_writer(display_writer_t &&writer) { this->writer_ = std::move(writer); }
+  void show_page(DisplayPage *page) { this->page_ = page; }
+  void set_auto_clear(bool auto_clear) { this->auto_clear_enabled_ = auto_clear; }
+  void set_rotation(DisplayRotation rotation) { this->rotation_ = rotation; }
+
+  void start_clipping(Rect rect) { this->clipping_.push_back(rect); }
+  void end_clipping() {
+    if (!this->clipping_.empty()) this->clipping_.pop_back();
+  }
+
+  void update() override { this->do_update_(); }
+
+ protected:
+  virtual void draw_absolute_pixel_internal(int x, int y, Color color) = 0;
+  void do_update_() {
+    if (this->auto_clear_enabled_) this->clear();
+    if (this->page_ != nullptr) {
+      this->page_->get_writer()(*this);
+    } else if (this->writer_.has_value()) {
+      (*this->writer_)(*this);
+    }
+    this->clipping_.clear();
+  }
+
+  bool auto_clear_enabled_{true};
+  optional<display_writer_t> writer_{};
+  DisplayPage *page_{nullptr};
+  DisplayRotation rotation_{DISPLAY_ROTATION_0_DEGREES};
+  std::vector<Rect> clipping_;
+};
+
+class DisplayBuffer : public Display {
+ protected:
+  uint8_t *buffer_{nullptr};
+};
+
+}  // namespace display
+}  // namespace esphome
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace spi {
+
+enum SPIBitOrder { BIT_ORDER_LSB_FIRST, BIT_ORDER_MSB_FIRST };
+enum SPIClockPolarity { CLOCK_POLARITY_LOW = false, CLOCK_POLARITY_HIGH = true };
+enum SPIClockPhase { CLOCK_PHASE_LEADING, CLOCK_PHASE_TRAILING };
+enum SPIDataRate : uint32_t {
+  DATA_RATE_1KHZ = 1000,
+  DATA_RATE_200KHZ = 200000,
+  DATA_RATE_1MHZ = 1000000,
+  DATA_RATE_2MHZ = 2000000,
+  DATA_RATE_4MHZ = 4000000,
+  DATA_RATE_5MHZ = 5000000,
+  DATA_RATE_8MHZ = 8000000,
+  DATA_RATE_10MHZ = 10000000,
+  DATA_RATE_20MHZ = 20000000,
+  DATA_RATE_40MHZ = 40000000,
+  DATA_RATE_80MHZ = 80000000,
+};
+
+// The bus: the host model in sim/panel.h overrides these to see every transaction
+class SPIComponent {
+ public:
+  virtual ~SPIComponent() = default;
+  virtual void begin_transaction(uint32_t data_rate) {}
+  virtual void end_transaction() {}
+  virtual void write(const uint8_t *data, size_t len) {}
+};
+
+// Chip select is driven by the component itself (cs_master/cs_slave), so the device only
+// brackets transactions and forwards bytes to the bus
+template<SPIBitOrder BIT_ORDER, SPIClockPolarity CLOCK_POLARITY, SPIClockPhase CLOCK_PHASE,
+         SPIDataRate DATA_RATE>
+class SPIDevice {
+ public:
+  void set_spi_parent(SPIComponent *parent) { this->parent_ = parent; }
+  void set_data_rate(uint32_t data_rate) { this->data_rate_ = data_rate; }
+  void spi_setup() {}
+  void enable() {
+    if (this->parent_ != nullptr) this->parent_->begin_transaction(this->data_rate_);
+  }
+  void disable() {
+    if (this->parent_ != nullptr) this->parent_->end_transaction();
+  }
+  void write_byte(uint8_t data) { this->write_array(&data, 1); }
+  void write_array(const uint8_t *data, size_t length) {
+    if (this->parent_ != nullptr) this->parent_->write(data, length);
+  }
+
+ protected:
+  SPIComponent *parent_{nullptr};
+  uint32_t data_rate_{DATA_RATE};
+};
+
+}  // namespace spi
+}  // namespace esphome
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace esphome {
+
+namespace setup_priority {
+static const float HARDWARE = 800.0f;
+static const float PROCESSOR = 400.0f;
+static const float DATA = 600.0f;
+}  // namespace setup_priority
+
+// The host has no scheduler: a harness calls setup() and loop() itself. Timeouts and intervals
+// are accepted and dropped; nothing the tests check depends on them.
+class Component {
+ public:
+  virtual ~Component() = default;
+  virtual void setup() {}
+  virtual void loop() {}
+  virtual void dump_config() {}
+  virtual float get_setup_priority() const { return 0.0f; }
+  virtual void on_shutdown() {}
+  void mark_failed() { this->failed_ = true; }
+  bool is_failed() const { return this->failed_; }
+
+ protected:
+  void set_timeout(const std::string &name, uint32_t timeout, std::function<void()> &&f) {}
+  void set_timeout(uint32_t timeout, std::function<void()> &&f) {}
+  void set_interval(const std::string &name, uint32_t interval, std::function<void()> &&f) {}
+  bool cancel_interval(const std::string &name) { return false; }
+
+  bool failed_{false};
+};
+
+class PollingComponent : public Component {
+ public:
+  virtual void update() = 0;
+  void set_update_interval(uint32_t update_interval) { this->update_interval_ = update_interval; }
+  uint32_t get_update_interval() const { return this->update_interval_; }
+
+ protected:
+  uint32_t update_interval_{0};
+};
+
+}  // namespace esphome
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+namespace esphome {
+
+// Simulated time of the calling thread (sim/clock.h); delay() advances it instead of sleeping
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+}  // namespace esphome
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+
+// Preferences are kept in memory for the life of the process, like NVS across a deep sleep;
+// epd_sim::clear_preferences() is a fresh device
+class ESPPreferenceObject {
+ public:
+  ESPPreferenceObject() = default;
+  ESPPreferenceObject(uint32_t key, size_t size) : key_(key), size_(size) {}
+
+  template<typename T> bool save(const T *src) {
+    return sizeof(T) == this->size_ && this->save_(reinterpret_cast<const uint8_t *>(src));
+  }
+  template<typename T> bool load(T *dest) {
+    return sizeof(T) == this->size_ && this->load_(reinterpret_cast<uint8_t *>(dest));
+  }
+
+ protected:
+  bool save_(const uint8_t *data);
+  bool load_(uint8_t *data);
+
+  uint32_t key_{0};
+  size_t size_{0};
+};
+
+class ESPPreferences {
+ public:
+  template<typename T> ESPPreferenceObject make_preference(uint32_t type, bool in_flash = false) {
+    return ESPPreferenceObject(type, sizeof(T));
+  }
+  bool sync() { return true; }
+};
+
+extern ESPPreferences *global_preferences;
+
+}  // namespace esphome
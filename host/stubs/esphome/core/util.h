@@ -0,0 +1,9 @@
+#pragma once
+
+namespace esphome {
+
+// Both follow epd_sim::set_network(); connected by default
+bool network_is_connected();
+bool api_is_connected();
+
+}  // namespace esphome
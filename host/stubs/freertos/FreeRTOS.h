@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+// Host stand-in for FreeRTOS: tasks are threads, one tick is one millisecond of simulated time
+// (see sim/clock.h)
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
@@ -0,0 +1,362 @@
+#include <gtest/gtest.h>
+#include <iterator>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "sim/rig.h"
+
+using epd_sim::Layout;
+using epd_sim::PanelSim;
+using epd_sim::Rig;
+
+namespace {
+
+std::string output(const std::string &name) { return std::string(EPD_HOST_OUTPUT_DIR) + "/" + name; }
+
+const int HostFrameChunk = epd_sim::HostFrame::RESUME_CHUNK_SIZE;
+
+// What one wake left on the panel, kept after its rig is gone
+struct WakeResult {
+  std::string status;
+  std::vector<uint8_t> master_ram, slave_ram;
+  std::vector<PanelSim::Command> commands;
+  uint64_t drf_us = 0;        // DRF on the bus
+  uint64_t last_data_us = 0;  // last DTM data before it
+  uint64_t dtm_while_busy = 0;
+  uint64_t dtm_after_switch = 0;
+};
+
+WakeResult wake_once(Layout layout, bool rle, bool stream) {
+  Rig rig;
+  rig.serve(8, layout);
+  rig.server.rle = rle;
+  rig.boot(stream);
+  WakeResult out;
+  EXPECT_TRUE(rig.wake());
+  out.status = rig.download_status.state;
+  out.master_ram = rig.panel.master.ram;
+  out.slave_ram = rig.panel.slave.ram;
+  out.commands = rig.panel.commands;
+  uint8_t command = 0;
+  for (const auto &e : rig.panel.trace) {
+    if (!e.dc && !e.head.empty()) command = e.head[0];
+    if (!e.dc && command == 0x12) {
+      out.drf_us = e.t_us;
+      break;
+    }
+    if (e.dc && command == 0x10) out.last_data_us = e.t_us;
+  }
+  out.dtm_while_busy = rig.panel.stats.dtm_while_busy;
+  out.dtm_after_switch = rig.panel.stats.dtm_after_switch;
+  return out;
+}
+
+}  // namespace
+
+TEST(Driver, StoredFrameReachesTheGlass) {
+  Rig rig;
+  rig.serve(1);
+  rig.boot();
+  EXPECT_TRUE(rig.wake());
+  EXPECT_EQ(rig.download_status.state, "ok");
+  EXPECT_EQ(rig.panel.glass_indices(), epd_sim::test_picture(1));
+  EXPECT_EQ(rig.panel.master.refreshes, 1);
+  EXPECT_EQ(rig.panel.slave.refreshes, 1);
+  EXPECT_EQ(rig.panel.master.overflow + rig.panel.slave.overflow, 0u);
+  EXPECT_EQ(rig.panel.stats.unselected_bytes, 0u);
+  EXPECT_EQ(rig.panel.stats.dtm_after_switch, 0u);
+  EXPECT_TRUE(rig.panel.write_png(output("stored_frame.png")));
+  EXPECT_TRUE(rig.panel.write_trace(output("stored_frame.trace")));
+}
+
+TEST(Driver, LegacyAndInterleavedFramesLookTheSame) {
+  for (Layout layout : {Layout::LEGACY, Layout::INTERLEAVED}) {
+    Rig rig;
+    rig.serve(2, layout);
+    rig.boot();
+    EXPECT_TRUE(rig.wake());
+    EXPECT_EQ(rig.panel.glass_indices(), epd_sim::test_picture(2));
+  }
+}
+
+TEST(Driver, EncodedDownloadStoresTheDecodedFrame) {
+  Rig rig;
+  rig.serve(3);
+  rig.boot();
+  rig.download();
+  ASSERT_EQ(rig.download_status.state, "ok");
+  const auto &frame = rig.server.frames[0];
+  // The solid bands compress, so fewer bytes crossed the link than the slot holds
+  EXPECT_LT(rig.download_bytes.state, frame.size());
+  const int slot = rig.frame->store_.activeSlot();
+  ASSERT_GE(slot, 0);
+  EXPECT_EQ(rig.frame->store_.record(slot)->size, frame.size());
+  EXPECT_EQ(0, memcmp(rig.frame->store_.map(slot), frame.data(), frame.size()));
+  rig.frame->store_.unmap();
+}
+
+TEST(Driver, InitMatchesTheLegacySequence) {
+  // The byte-at-a-time sequence initDisplay() sent before the init table, as (CS, DC, byte)
+  const uint8_t M = PanelSim::CS_MASTER, B = PanelSim::CS_MASTER | PanelSim::CS_SLAVE;
+  const struct {
+    uint8_t cs, command;
+    std::vector<uint8_t> params;
+  } legacy[] = {
+      {M, 0x74, {0xC0, 0x1C, 0x1C, 0xCC, 0xCC, 0xCC, 0x15, 0x15, 0x55}},
+      {B, 0xF0, {0x49, 0x55, 0x13, 0x5D, 0x05, 0x10}},
+      {B, 0x00, {0xDF, 0x69}},
+      {B, 0x50, {0xF7}},
+      {B, 0x60, {0x03, 0x03}},
+      {B, 0x86, {0x10}},
+      {B, 0xE3, {0x22}},
+      {B, 0xE0, {0x01}},
+      {B, 0x61, {0x04, 0xB0, 0x03, 0x20}},
+      {M, 0x01, {0x0F, 0x00, 0x28, 0x2C, 0x28, 0x38}},
+      {M, 0xB6, {0x07}},
+      {M, 0x06, {0xE8, 0x28}},
+      {M, 0xB7, {0x01}},
+      {M, 0x05, {0xE8, 0x28}},
+      {M, 0xB0, {0x01}},
+      {M, 0xB1, {0x02}},
+  };
+  std::vector<std::tuple<uint8_t, bool, uint8_t>> expected;
+  for (const auto &c : legacy) {
+    expected.emplace_back(c.cs, false, c.command);
+    for (uint8_t p : c.params) expected.emplace_back(c.cs, true, p);
+  }
+
+  Rig rig;
+  rig.boot();
+  std::vector<std::tuple<uint8_t, bool, uint8_t>> sent;
+  for (const auto &e : rig.panel.trace) {
+    ASSERT_EQ(e.head.size(), e.len);
+    for (uint8_t b : e.head) sent.emplace_back(e.cs, e.dc, b);
+  }
+  EXPECT_EQ(sent, expected);
+  EXPECT_GE(rig.panel.stats.resets, 1);
+  EXPECT_TRUE(rig.panel.power.level());
+  // One transaction for each command and one for its parameters, instead of one per byte
+  EXPECT_EQ(rig.panel.stats.transactions, 2 * std::size(legacy));
+}
+
+TEST(Driver, RefreshFollowsBusy) {
+  Rig rig;
+  rig.serve(4);
+  rig.boot();
+  rig.download();
+  rig.frame->displayFromFile();
+  ASSERT_TRUE(rig.frame->isRefreshing());
+  const uint64_t start = epd_sim::now_us();
+  EXPECT_TRUE(rig.refresh());
+  const auto &t = rig.panel.timing;
+  const uint64_t busy = (uint64_t) t.power_on_us + t.refresh_us + t.power_off_us;
+  // Each phase waits for BUSY, then 20 ms of idle; SETTLE adds 50 ms
+  EXPECT_GE(epd_sim::now_us() - start, busy);
+  EXPECT_LT(epd_sim::now_us() - start, busy + 200000);
+  EXPECT_EQ(rig.panel.stats.dtm_while_busy, 0u);
+  EXPECT_EQ(rig.frame->displayed_etag_.value, rig.server.etag(0));
+}
+
+TEST(Driver, UnchangedFrameIsNotSentAgain) {
+  Rig rig;
+  rig.serve(5);
+  rig.boot();
+  ASSERT_TRUE(rig.wake());
+  const uint64_t dtm = rig.panel.stats.dtm_bytes;
+  rig.boot();
+  epd_sim::reset_http_stats();
+  EXPECT_FALSE(rig.wake());
+  EXPECT_EQ(rig.download_status.state, "unchanged");
+  EXPECT_EQ(rig.panel.stats.dtm_bytes, dtm);
+  // One conditional manifest request, no frame bytes
+  EXPECT_EQ(epd_sim::http_stats().requests, 1);
+  EXPECT_EQ(epd_sim::http_stats().body_bytes, 0u);
+}
+
+TEST(Driver, TransferRingKeepsTheBusBusy) {
+  for (uint32_t rate : {2000000u, 10000000u, 40000000u}) {
+    Rig rig;
+    rig.serve(4);
+    rig.boot(false, rate);
+    rig.download();
+    rig.panel.stats = {};
+    rig.panel.clear_trace();
+    const uint64_t start = epd_sim::now_us();
+    rig.frame->displayFromFile();
+    // The send ends where the refresh begins (PON)
+    uint64_t end = 0;
+    for (const auto &e : rig.panel.trace) {
+      if (!e.dc && !e.head.empty() && e.head[0] == 0x04) end = e.t_us;
+    }
+    ASSERT_GT(end, start);
+    const double wire_us = 960000.0 * 8 * 1e6 / rate;
+    // Buffers are filled ahead of the DMA, so the bus never waits for the next one
+    EXPECT_LT(end - start, wire_us * 1.1) << rate << " Hz";
+    EXPECT_GT((double) rig.panel.stats.spi_us / (end - start), 0.9) << rate << " Hz";
+    EXPECT_TRUE(rig.refresh());
+  }
+}
+
+TEST(Driver, PartialRingAllocationIsUndone) {
+  Rig rig;
+  rig.serve(14);
+  rig.boot();
+  rig.download();
+  // Two of the four DMA buffers can be allocated, the third cannot
+  epd_sim::fail_allocations_after(2);
+  rig.frame->displayFromFile();
+  EXPECT_FALSE(rig.frame->isRefreshing());
+  // The next attempt starts from an empty ring rather than copying into the missing buffers
+  epd_sim::fail_allocations_after(-1);
+  rig.frame->displayFromFile();
+  ASSERT_TRUE(rig.frame->isRefreshing());
+  EXPECT_TRUE(rig.refresh());
+  EXPECT_EQ(rig.panel.glass_indices(), epd_sim::test_picture(14));
+}
+
+TEST(Driver, StreamedFrameReachesTheGlass) {
+  Rig rig;
+  rig.serve(6);
+  rig.boot(true);
+  EXPECT_TRUE(rig.wake());
+  EXPECT_EQ(rig.download_status.state, "streamed");
+  EXPECT_EQ(rig.panel.glass_indices(), epd_sim::test_picture(6));
+  EXPECT_EQ(rig.panel.stats.dtm_while_busy, 0u);
+  // One DTM transfer per controller, with no CS switch in the middle of either
+  EXPECT_EQ(rig.panel.stats.dtm_after_switch, 0u);
+  EXPECT_TRUE(rig.panel.write_png(output("streamed_frame.png")));
+}
+
+TEST(Driver, StreamAndStoreSendTheSameFrame) {
+  for (Layout layout : {Layout::LEGACY, Layout::INTERLEAVED, Layout::SPLIT}) {
+    for (bool rle : {false, true}) {
+      // One rig at a time: the backend and the flash partition are process-wide
+      WakeResult stored = wake_once(layout, rle, false);
+      WakeResult streamed = wake_once(layout, rle, true);
+      // Interleaved rows would switch controllers mid-DTM, so only split frames are streamed;
+      // the others fall back to the stored download before anything reaches the panel
+      EXPECT_EQ(streamed.status, layout == Layout::SPLIT ? "streamed" : "ok");
+      EXPECT_EQ(streamed.dtm_after_switch, 0u);
+      // Same controller RAM and the same commands and parameters, in the same order
+      EXPECT_TRUE(streamed.master_ram == stored.master_ram);
+      EXPECT_TRUE(streamed.slave_ram == stored.slave_ram);
+      ASSERT_EQ(streamed.commands.size(), stored.commands.size());
+      for (size_t i = 0; i < stored.commands.size(); i++) {
+        EXPECT_EQ(streamed.commands[i].cs, stored.commands[i].cs) << i;
+        EXPECT_EQ(streamed.commands[i].command, stored.commands[i].command) << i;
+        EXPECT_EQ(streamed.commands[i].params, stored.commands[i].params) << i;
+      }
+    }
+  }
+}
+
+TEST(Driver, StreamingRefreshesSooner) {
+  const WakeResult stored = wake_once(Layout::SPLIT, false, false);
+  const WakeResult streamed = wake_once(Layout::SPLIT, false, true);
+  // Storing first writes the whole frame to flash and then reads it back out
+  EXPECT_LT(streamed.drf_us + 2000000, stored.drf_us);
+  // Yet the refresh never starts before the last pixel byte is on the bus
+  EXPECT_GT(streamed.last_data_us, 0u);
+  EXPECT_LT(streamed.last_data_us, streamed.drf_us);
+  EXPECT_EQ(streamed.dtm_while_busy, 0u);
+}
+
+TEST(Driver, DeltaUpdateFetchesOnlyChangedChunks) {
+  Rig rig;
+  rig.serve(7);
+  rig.boot();
+  ASSERT_TRUE(rig.wake());
+  // Another picture that differs from the shown one in a single 100 KB chunk
+  std::vector<uint8_t> next = rig.server.frames[0];
+  for (size_t i = 300000; i < 300100; i++) next[i] ^= 0x11;
+  rig.server.frames.push_back(next);
+  rig.server.current = 1;
+  rig.boot();
+  epd_sim::reset_http_stats();
+  ASSERT_TRUE(rig.wake());
+  EXPECT_EQ(rig.download_bytes.state, 100 * 1024);
+  const int slot = rig.frame->store_.activeSlot();
+  EXPECT_EQ(0, memcmp(rig.frame->store_.map(slot), next.data(), next.size()));
+  rig.frame->store_.unmap();
+  EXPECT_EQ(rig.frame->displayed_etag_.value, rig.server.etag(1));
+}
+
+TEST(Driver, InterruptedDownloadResumes) {
+  Rig rig;
+  rig.serve(8);
+  rig.server.rle = false;
+  const auto &frame = rig.server.frames[0];
+  rig.boot();
+  // Wi-Fi drops 350 KB into the frame and stays down for the rest of the wake
+  epd_sim::lose_link_after(350 * 1024);
+  rig.download();
+  ASSERT_EQ(rig.download_status.state, "chunk_failed");
+  EXPECT_EQ(rig.frame->store_.activeSlot(), -1);
+  EXPECT_EQ(rig.frame->resume_.done, 0x7u);
+
+  // The next wake keeps the three complete chunks and fetches the rest
+  epd_sim::lose_link_after(-1);
+  rig.boot();
+  epd_sim::reset_http_stats();
+  rig.download();
+  EXPECT_EQ(rig.download_status.state, "ok");
+  EXPECT_EQ(rig.download_bytes.state, frame.size() - 3 * HostFrameChunk);
+  const int slot = rig.frame->store_.activeSlot();
+  ASSERT_GE(slot, 0);
+  EXPECT_EQ(0, memcmp(rig.frame->store_.map(slot), frame.data(), frame.size()));
+  rig.frame->store_.unmap();
+  EXPECT_EQ(rig.frame->resume_.etag[0], '\0');
+}
+
+TEST(Driver, DownloadRefusedWhileRefreshing) {
+  Rig rig;
+  rig.serve(9);
+  rig.server.rle = false;
+  rig.boot(true);
+  rig.download();
+  rig.frame->loop();
+  ASSERT_TRUE(rig.frame->isRefreshing());
+  epd_sim::reset_http_stats();
+  rig.frame->startDownload();
+  EXPECT_EQ(epd_sim::running_tasks(), 0);
+  EXPECT_EQ(epd_sim::http_stats().requests, 0);
+  EXPECT_TRUE(rig.refresh());
+  EXPECT_EQ(rig.panel.stats.dtm_while_busy, 0u);
+}
+
+TEST(Driver, FullCacheKeepsUnshownFrames) {
+  Rig rig(0x170000);  // one slot
+  rig.serve(10);
+  rig.serve(11);
+  rig.boot();
+  rig.download();
+  ASSERT_EQ(rig.download_status.state, "ok");
+  // The frame was never shown, so the next download must not overwrite it
+  rig.server.current = 1;
+  rig.download();
+  EXPECT_EQ(rig.download_status.state, "cache_full");
+  rig.frame->displayFromFile();
+  ASSERT_TRUE(rig.refresh());
+  EXPECT_EQ(rig.panel.glass_indices(), epd_sim::test_picture(10));
+  // Once it has been shown its slot is free again
+  rig.download();
+  EXPECT_EQ(rig.download_status.state, "ok");
+}
+
+TEST(Driver, TimedOutRefreshFreesTheSlot) {
+  Rig rig(0x170000);  // one slot
+  rig.serve(12);
+  rig.serve(13);
+  rig.boot();
+  rig.download();
+  ASSERT_EQ(rig.download_status.state, "ok");
+  // BUSY stays low past BUSY_TIMEOUT_MS during DRF
+  rig.panel.timing.refresh_us = 70000000;
+  rig.frame->displayFromFile();
+  EXPECT_FALSE(rig.refresh());
+  EXPECT_EQ(rig.frame->displayed_etag_.value, std::string());
+  // The frame went to the panel, so a timeout must not leave the only slot pinned
+  rig.server.current = 1;
+  rig.download();
+  EXPECT_EQ(rig.download_status.state, "ok");
+}
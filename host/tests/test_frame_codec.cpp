@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "frame_codec.h"
+#include "sim/backend.h"
+
+using esphome::epd_photo_frame::RLE_MAX_RUN;
+using esphome::epd_photo_frame::RleDecoder;
+
+namespace {
+
+std::vector<uint8_t> bytes(std::initializer_list<int> values) { return std::vector<uint8_t>(values.begin(), values.end()); }
+
+// Decodes `encoded` fed in pieces of the given sizes (the rest in one piece)
+std::vector<uint8_t> decode(const std::vector<uint8_t> &encoded, const std::vector<size_t> &pieces, bool *idle) {
+  RleDecoder decoder;
+  std::vector<uint8_t> out;
+  auto sink = [&out](const uint8_t *data, size_t len) {
+    out.insert(out.end(), data, data + len);
+    return true;
+  };
+  size_t pos = 0;
+  for (size_t piece : pieces) {
+    piece = std::min(piece, encoded.size() - pos);
+    EXPECT_TRUE(decoder.feed(encoded.data() + pos, piece, sink));
+    pos += piece;
+  }
+  EXPECT_TRUE(decoder.feed(encoded.data() + pos, encoded.size() - pos, sink));
+  *idle = decoder.idle();
+  return out;
+}
+
+}  // namespace
+
+TEST(FrameCodec, RoundTripsTheServerEncoding) {
+  std::mt19937 rng(7);
+  // Noise, flat areas and runs just around the 3-byte minimum and 130-byte maximum
+  std::vector<uint8_t> data;
+  for (int block = 0; block < 200; block++) {
+    const uint8_t value = rng() & 0xFF;
+    const int len = rng() % 3 == 0 ? 1 + rng() % 300 : std::vector<int>{1, 2, 3, 4, 129, 130, 131, 133}[rng() % 8];
+    for (int i = 0; i < len; i++) data.push_back(rng() % 2 == 0 ? value : rng() & 0xFF);
+    data.insert(data.end(), len, value);
+  }
+  const std::string wire = epd_sim::rle_encode(data);
+  const std::vector<uint8_t> encoded(wire.begin(), wire.end());
+  ASSERT_LT(encoded.size(), data.size());
+
+  for (int split = 0; split < 50; split++) {
+    // Pieces of 1 byte split every code; larger ones land anywhere, as ranges and retries do
+    std::vector<size_t> pieces;
+    for (size_t pos = 0; pos < encoded.size();) {
+      const size_t piece = split == 0 ? 1 : 1 + rng() % 700;
+      pieces.push_back(piece);
+      pos += piece;
+    }
+    bool idle = false;
+    EXPECT_EQ(decode(encoded, pieces, &idle), data);
+    EXPECT_TRUE(idle);
+  }
+}
+
+TEST(FrameCodec, TruncatedRunIsNotIdle) {
+  bool idle = true;
+  // A run control byte without its value produces nothing yet
+  EXPECT_EQ(decode(bytes({0x02, 1, 2, 3, 0x85}), {}, &idle), bytes({1, 2, 3}));
+  EXPECT_FALSE(idle);
+
+  // The value arriving in the next piece completes it
+  const std::vector<uint8_t> run = decode(bytes({0x85, 9}), {1}, &idle);
+  EXPECT_EQ(run, std::vector<uint8_t>(8, 9));
+  EXPECT_TRUE(idle);
+}
+
+TEST(FrameCodec, TruncatedLiteralIsNotIdle) {
+  bool idle = true;
+  EXPECT_EQ(decode(bytes({0x09, 1, 2, 3, 4}), {}, &idle), bytes({1, 2, 3, 4}));
+  EXPECT_FALSE(idle);
+}
+
+TEST(FrameCodec, LongestCodesStayInBounds) {
+  // 0x7F announces 128 literal bytes and 0xFF a run of RLE_MAX_RUN, the most a control byte
+  // can express, so no length read from the wire can overrun the run buffer
+  std::vector<uint8_t> encoded = {0x7F};
+  for (int i = 0; i < 128; i++) encoded.push_back(i);
+  encoded.push_back(0xFF);
+  encoded.push_back(0xAB);
+  bool idle = false;
+  const std::vector<uint8_t> out = decode(encoded, {1, 64, 64}, &idle);
+  ASSERT_EQ(out.size(), 128 + RLE_MAX_RUN);
+  for (int i = 0; i < 128; i++) EXPECT_EQ(out[i], i);
+  EXPECT_EQ(std::vector<uint8_t>(out.begin() + 128, out.end()), std::vector<uint8_t>(RLE_MAX_RUN, 0xAB));
+  EXPECT_TRUE(idle);
+}
+
+TEST(FrameCodec, SinkCanAbort) {
+  RleDecoder decoder;
+  int calls = 0;
+  const std::vector<uint8_t> encoded = {0x81, 5, 0x01, 6, 7};
+  EXPECT_FALSE(decoder.feed(encoded.data(), encoded.size(), [&calls](const uint8_t *, size_t) {
+    calls++;
+    return false;
+  }));
+  EXPECT_EQ(calls, 1);
+}
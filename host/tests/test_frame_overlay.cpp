@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "frame_overlay.h"
+#include "sim/rig.h"
+
+using esphome::Color;
+using esphome::display::Display;
+using esphome::epd_photo_frame::OverlayBand;
+using epd_sim::Rig;
+
+namespace {
+
+// The golden window straddles the band boundary at row 32 and the controller seam at x = 600;
+// test_picture(7) is noise there, so every drawn pixel shows
+const int WINDOW_X = 576, WINDOW_Y = 16, WINDOW_W = 48, WINDOW_H = 32;
+
+// One line per row, one hex digit per pixel (the panel colour index)
+std::string window_text(const std::vector<uint8_t> &indices) {
+  std::string text;
+  for (int y = WINDOW_Y; y < WINDOW_Y + WINDOW_H; y++) {
+    for (int x = WINDOW_X; x < WINDOW_X + WINDOW_W; x++) text += "0123456789abcdef"[indices[y * 1200 + x] & 0xF];
+    text += '\n';
+  }
+  return text;
+}
+
+std::string read_file(const std::string &path) {
+  std::ifstream in(path);
+  std::stringstream text;
+  text << in.rdbuf();
+  return text.str();
+}
+
+}  // namespace
+
+TEST(FrameOverlay, BandMatchesTheGolden) {
+  Rig rig;
+  rig.serve(7);
+  rig.boot();
+  rig.frame->set_writer([](Display &it) {
+    it.filled_rectangle(590, 20, 21, 20, Color(255, 0, 0));
+    it.draw_pixel_at(585, 30, Color(0, 0, 255));
+    it.draw_pixel_at(586, 30, Color(250, 240, 10));
+    it.draw_pixel_at(619, 47, Color(0, 200, 30));
+    it.draw_pixel_at(600, 16, Color(255, 255, 255));
+    it.draw_pixel_at(599, 16, Color(0, 0, 0));
+  });
+  ASSERT_TRUE(rig.wake());
+  // The bands are rendered once per controller, so each gets a single DTM transfer
+  EXPECT_EQ(rig.panel.stats.dtm_after_switch, 0u);
+
+  const std::vector<uint8_t> glass = rig.panel.glass_indices();
+  const std::string window = window_text(glass);
+  const std::string golden_path = std::string(EPD_HOST_GOLDEN_DIR) + "/overlay_band.txt";
+  if (getenv("EPD_HOST_UPDATE_GOLDEN") != nullptr) std::ofstream(golden_path) << window;
+  EXPECT_EQ(window, read_file(golden_path)) << "set EPD_HOST_UPDATE_GOLDEN=1 to rewrite " << golden_path;
+  EXPECT_TRUE(rig.panel.write_png(std::string(EPD_HOST_OUTPUT_DIR) + "/overlay.png"));
+
+  // Nothing outside the window differs from the photo
+  const std::vector<uint8_t> photo = epd_sim::test_picture(7);
+  for (int y = 0; y < 1600; y++) {
+    for (int x = 0; x < 1200; x++) {
+      const bool inside = x >= WINDOW_X && x < WINDOW_X + WINDOW_W && y >= WINDOW_Y && y < WINDOW_Y + WINDOW_H;
+      if (!inside && glass[y * 1200 + x] != photo[y * 1200 + x]) {
+        ADD_FAILURE() << "pixel " << x << "," << y << " changed";
+        return;
+      }
+    }
+  }
+}
+
+TEST(FrameOverlay, CompositeReplacesOnlyDrawnNibbles) {
+  OverlayBand band;
+  ASSERT_TRUE(band.allocate(8, 2));
+  band.begin(10, 2);
+  uint8_t row[4] = {0x12, 0x34, 0x56, 0x78};
+  band.composite(10, 0, row, 4);
+  EXPECT_EQ(std::vector<uint8_t>(row, row + 4), std::vector<uint8_t>({0x12, 0x34, 0x56, 0x78}));
+
+  band.set(1, 10, 0x3);   // low nibble of byte 0
+  band.set(4, 10, 0x6);   // high nibble of byte 2
+  band.set(8, 10, 0x5);   // past the width
+  band.set(2, 12, 0x5);   // past the band
+  band.composite(10, 0, row, 4);
+  EXPECT_EQ(std::vector<uint8_t>(row, row + 4), std::vector<uint8_t>({0x13, 0x34, 0x66, 0x78}));
+
+  // A row outside the band is left alone, and clear() lets the photo through again
+  uint8_t other[4] = {0x12, 0x34, 0x56, 0x78};
+  band.composite(12, 0, other, 4);
+  EXPECT_EQ(other[0], 0x12);
+  band.clear();
+  uint8_t cleared[4] = {0x12, 0x34, 0x56, 0x78};
+  band.composite(10, 0, cleared, 4);
+  EXPECT_EQ(cleared[0], 0x12);
+}
@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <esp_crc.h>
+#include "frame_store.h"
+#include "sim/flash.h"
+
+using esphome::epd_photo_frame::FrameStore;
+using epd_sim::FlashSim;
+
+namespace {
+
+const uint32_t CHUNK = 100 * 1024;  // EPDPhotoFrame::RESUME_CHUNK_SIZE
+const uint32_t FRAME = 960016;
+
+// A fresh flash image file per test; FlashSim keeps it across "reboots" of the store
+std::string image(const std::string &name) {
+  const std::string path = std::string(EPD_HOST_OUTPUT_DIR) + "/" + name + ".flash";
+  std::remove(path.c_str());
+  return path;
+}
+
+std::vector<uint8_t> frame_bytes(uint32_t seed) {
+  std::vector<uint8_t> out(FRAME);
+  uint32_t state = seed * 2654435761u + 1;
+  for (auto &b : out) {
+    state = state * 1103515245u + 12345u;
+    b = (uint8_t) (state >> 16);
+  }
+  return out;
+}
+
+// Writes the frame in download-sized pieces and commits it
+bool store(FrameStore &store, int slot, const std::vector<uint8_t> &frame, const char *etag) {
+  if (!store.invalidate(slot) || !store.beginWrite(slot, 0)) return false;
+  for (size_t pos = 0; pos < frame.size(); pos += 4096) {
+    if (!store.write(frame.data() + pos, std::min<size_t>(4096, frame.size() - pos))) return false;
+  }
+  return store.commit(slot, frame.size(), etag);
+}
+
+std::vector<uint8_t> mapped(FrameStore &store, int slot) {
+  const uint8_t *data = store.map(slot);
+  std::vector<uint8_t> out;
+  if (data != nullptr) out.assign(data, data + store.record(slot)->size);
+  store.unmap();
+  return out;
+}
+
+}  // namespace
+
+TEST(FrameStore, CommittedFrameSurvivesAReboot) {
+  const std::string path = image("reboot");
+  const std::vector<uint8_t> frame = frame_bytes(1);
+  {
+    FlashSim flash("frames", 0x470000, (esp_partition_subtype_t) 0x40, path);
+    FrameStore fs;
+    ASSERT_TRUE(fs.begin());
+    EXPECT_EQ(fs.slotCount(), 4);
+    EXPECT_EQ(fs.activeSlot(), -1);
+    ASSERT_TRUE(store(fs, 0, frame, "W/\"a\""));
+    EXPECT_EQ(flash.stats.unerased_writes, 0u);
+    // Sectors up to the first 64 KB boundary and whole blocks after it, not 235 sectors
+    EXPECT_LT(flash.stats.sector_erases, 32u);
+  }
+  FlashSim flash("frames", 0x470000, (esp_partition_subtype_t) 0x40, path);
+  FrameStore fs;
+  ASSERT_TRUE(fs.begin());
+  ASSERT_EQ(fs.activeSlot(), 0);
+  EXPECT_STREQ(fs.record(0)->etag, "W/\"a\"");
+  EXPECT_EQ(fs.record(0)->crc, esp_crc32_le(0, frame.data(), frame.size()));
+  EXPECT_EQ(mapped(fs, 0), frame);
+  EXPECT_EQ(flash.open_mappings(), 0);
+}
+
+TEST(FrameStore, ChunkRewriteKeepsTheNextChunk) {
+  FlashSim flash("frames", 0x170000, (esp_partition_subtype_t) 0x40, image("chunk"));
+  FrameStore fs;
+  ASSERT_TRUE(fs.begin());
+  std::vector<uint8_t> frame = frame_bytes(2);
+  ASSERT_TRUE(store(fs, 0, frame, "W/\"a\""));
+
+  // Patch chunk 2 in place, as a delta update does; it starts and ends inside 64 KB blocks
+  const std::vector<uint8_t> patch = frame_bytes(3);
+  std::copy(patch.begin() + 2 * CHUNK, patch.begin() + 3 * CHUNK, frame.begin() + 2 * CHUNK);
+  ASSERT_TRUE(fs.invalidate(0));
+  flash.erase_log.clear();
+  ASSERT_TRUE(fs.beginWrite(0, 2 * CHUNK, CHUNK));
+  ASSERT_TRUE(fs.write(frame.data() + 2 * CHUNK, CHUNK));
+  // Nothing past the chunk may be written or erased
+  EXPECT_FALSE(fs.write(frame.data(), 1));
+  const uint32_t base = FrameStore::RECORD_SIZE;
+  for (const auto &erase : flash.erase_log) {
+    EXPECT_GE(erase.first, base + 2 * CHUNK);
+    EXPECT_LE(erase.first + erase.second, base + 3 * CHUNK);
+  }
+  uint32_t crc = 0;
+  ASSERT_TRUE(fs.checksum(0, 2 * CHUNK, CHUNK, &crc));
+  EXPECT_EQ(crc, esp_crc32_le(0, frame.data() + 2 * CHUNK, CHUNK));
+  ASSERT_TRUE(fs.commit(0, FRAME, "W/\"b\""));
+  EXPECT_EQ(mapped(fs, 0), frame);
+  EXPECT_EQ(flash.stats.unerased_writes, 0u);
+}
+
+TEST(FrameStore, TornWriteKeepsTheLastGoodFrame) {
+  const std::string path = image("torn");
+  const std::vector<uint8_t> a = frame_bytes(4), b = frame_bytes(5);
+  {
+    FlashSim flash("frames", 0x470000, (esp_partition_subtype_t) 0x40, path);
+    FrameStore fs;
+    ASSERT_TRUE(fs.begin());
+    ASSERT_TRUE(store(fs, 0, a, "W/\"a\""));
+    const int slot = fs.freeSlot(fs.record(0)->sequence);
+    ASSERT_EQ(slot, 1);
+    // Power fails part way through the frame bytes of B
+    flash.cut_power_after(300000);
+    EXPECT_FALSE(store(fs, slot, b, "W/\"b\""));
+  }
+  {
+    FlashSim flash("frames", 0x470000, (esp_partition_subtype_t) 0x40, path);
+    FrameStore fs;
+    ASSERT_TRUE(fs.begin());
+    ASSERT_EQ(fs.activeSlot(), 0);
+    EXPECT_EQ(fs.record(1), nullptr);
+    EXPECT_EQ(mapped(fs, 0), a);
+    // This time B is complete, but power fails while its record is programmed
+    ASSERT_TRUE(fs.invalidate(1) && fs.beginWrite(1, 0) && fs.write(b.data(), b.size()));
+    flash.cut_power_after(40);
+    EXPECT_FALSE(fs.commit(1, b.size(), "W/\"b\""));
+  }
+  FlashSim flash("frames", 0x470000, (esp_partition_subtype_t) 0x40, path);
+  FrameStore fs;
+  ASSERT_TRUE(fs.begin());
+  EXPECT_EQ(fs.activeSlot(), 0);
+  EXPECT_EQ(fs.record(1), nullptr);
+  EXPECT_EQ(mapped(fs, 0), a);
+}
+
+TEST(FrameStore, RetagKeepsTheFrame) {
+  const std::string path = image("retag");
+  const std::vector<uint8_t> frame = frame_bytes(6);
+  uint32_t sequence = 0;
+  {
+    FlashSim flash("frames", 0x470000, (esp_partition_subtype_t) 0x40, path);
+    FrameStore fs;
+    ASSERT_TRUE(fs.begin());
+    ASSERT_TRUE(store(fs, 2, frame, "W/\"old\""));
+    sequence = fs.record(2)->sequence;
+    flash.stats = {};
+    ASSERT_TRUE(fs.retag(2, "W/\"new\""));
+    // Only the record sector is touched
+    EXPECT_EQ(flash.stats.sector_erases, 1u);
+    EXPECT_EQ(flash.stats.bytes_programmed, sizeof(FrameStore::SlotRecord));
+  }
+  FlashSim flash("frames", 0x470000, (esp_partition_subtype_t) 0x40, path);
+  FrameStore fs;
+  ASSERT_TRUE(fs.begin());
+  ASSERT_NE(fs.record(2), nullptr);
+  EXPECT_STREQ(fs.record(2)->etag, "W/\"new\"");
+  EXPECT_EQ(fs.record(2)->sequence, sequence);
+  EXPECT_EQ(fs.record(2)->crc, esp_crc32_le(0, frame.data(), frame.size()));
+  EXPECT_EQ(mapped(fs, 2), frame);
+}
+
+TEST(FrameStore, LegacySpiffsPartitionIsUsedRaw) {
+  FlashSim flash("spiffs", 0x170000, ESP_PARTITION_SUBTYPE_DATA_SPIFFS);
+  FrameStore fs;
+  ASSERT_TRUE(fs.begin());
+  EXPECT_STREQ(fs.partition()->label, "spiffs");
+  EXPECT_EQ(fs.slotCount(), 1);
+  // With one slot the shown frame is the one to overwrite
+  ASSERT_TRUE(store(fs, 0, frame_bytes(7), nullptr));
+  EXPECT_EQ(fs.freeSlot(fs.record(0)->sequence), 0);
+  EXPECT_EQ(fs.freeSlot(0), -1);
+}
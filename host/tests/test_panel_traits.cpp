@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "panel_traits.h"
+#include "sim/rig.h"
+
+using namespace esphome::epd_photo_frame;
+using epd_sim::PanelSim;
+using epd_sim::Rig;
+
+namespace {
+
+// A smaller panel with an uneven split, to show the geometry is not tied to the 13.3" numbers
+struct TestPanel {
+  static constexpr int WIDTH = 800;
+  static constexpr int HEIGHT = 480;
+  static constexpr int BPP = 4;
+  static constexpr int CONTROLLERS = 2;
+  static constexpr int MASTER_COLUMNS = 320;
+  static constexpr int CONTROLLER_HRES = 640;
+  static constexpr int CONTROLLER_VRES = 240;
+  static constexpr InitCommand INIT_SEQUENCE[] = {
+      {INIT_TARGET_BOTH, PSR, 2, {0xDF, 0x69}},
+      {INIT_TARGET_BOTH, TRES, 4, {CONTROLLER_HRES >> 8, CONTROLLER_HRES & 0xFF, 0, CONTROLLER_VRES}},
+  };
+  static constexpr PaletteEntry PALETTE[] = {{0, 0, 0, 0x0}, {255, 255, 255, 0x1}};
+};
+using TestGeometry = PanelGeometry<TestPanel>;
+
+static_assert(TestGeometry::BYTES_PER_ROW == 400, "");
+static_assert(TestGeometry::MASTER_BYTES_PER_ROW == 160, "");
+static_assert(TestGeometry::SLAVE_BYTES_PER_ROW == 240, "");
+static_assert(TestGeometry::FRAME_DATA_SIZE == 192000, "");
+static_assert(TestGeometry::MASTER_DATA_SIZE == 76800, "");
+static_assert(TestGeometry::INIT_COMMANDS == 2, "");
+
+using Panel = Spectra6Geometry13in3;
+
+}  // namespace
+
+TEST(PanelTraits, NearestColorPicksTheInk) {
+  for (const PaletteEntry &p : Panel::PALETTE) EXPECT_EQ(Panel::nearest_color(p.r, p.g, p.b), p.index);
+  EXPECT_EQ(Panel::nearest_color(40, 30, 20), SPECTRA6_BLACK);
+  EXPECT_EQ(Panel::nearest_color(230, 235, 220), SPECTRA6_WHITE);
+  EXPECT_EQ(Panel::nearest_color(240, 200, 30), SPECTRA6_YELLOW);
+  EXPECT_EQ(Panel::nearest_color(200, 40, 40), SPECTRA6_RED);
+  EXPECT_EQ(Panel::nearest_color(30, 60, 200), SPECTRA6_BLUE);
+  EXPECT_EQ(Panel::nearest_color(40, 180, 60), SPECTRA6_GREEN);
+
+  EXPECT_EQ(TestGeometry::nearest_color(100, 100, 100), 0x0);
+  EXPECT_EQ(TestGeometry::nearest_color(150, 150, 150), 0x1);
+}
+
+TEST(PanelTraits, ControllersReceiveTheTableResolution) {
+  Rig rig;
+  rig.boot();
+  for (uint8_t cs : {PanelSim::CS_MASTER, PanelSim::CS_SLAVE}) {
+    std::vector<uint8_t> tres;
+    for (const auto &c : rig.panel.commands) {
+      if (c.command == TRES && (c.cs & cs)) tres = c.params;
+    }
+    EXPECT_EQ(tres, std::vector<uint8_t>({Panel::CONTROLLER_HRES >> 8, Panel::CONTROLLER_HRES & 0xFF,
+                                          Panel::CONTROLLER_VRES >> 8, Panel::CONTROLLER_VRES & 0xFF}));
+  }
+}
@@ -1,4 +1,5 @@
 from pydantic_settings import BaseSettings, SettingsConfigDict
+from typing import Literal
 from pydantic import Field
 
 
@@ -10,13 +11,44 @@ class Settings(BaseSettings):
     server_base_url: str = Field("http://localhost:8000", alias="SERVER_BASE_URL")
     db_url: str = Field("sqlite+aiosqlite:///./data/epd.db", alias="DB_URL")
     default_wake_time: str = Field("03:00", alias="DEFAULT_WAKE_TIME")
-    panel_width: int = Field(1600, alias="PANEL_WIDTH")
-    panel_height: int = Field(1200, alias="PANEL_HEIGHT")
+    # Portrait, as the device streams rows (components/epd_photo_frame/panel_traits.h)
+    panel_width: int = Field(1200, alias="PANEL_WIDTH")
+    panel_height: int = Field(1600, alias="PANEL_HEIGHT")
+    # Controllers and the master's share of each row (CONTROLLERS, MASTER_COLUMNS); the "split"
+    # layout sends the master block first, as PanelGeometry::MASTER_DATA_SIZE expects
+    panel_controllers: int = Field(2, alias="PANEL_CONTROLLERS")
+    panel_master_columns: int = Field(600, alias="PANEL_MASTER_COLUMNS")
+    # Worker processes for rendering (0 renders in a thread), and how many frames may be queued
+    # before /images/next answers 503 with Retry-After
+    render_workers: int = Field(2, alias="RENDER_WORKERS")
+    render_queue_limit: int = Field(16, alias="RENDER_QUEUE_LIMIT")
+    # Spectra6 dithering (app/image_proc.py quantize_spectra6)
+    dither: Literal["ordered", "floyd-steinberg", "none"] = Field("ordered", alias="DITHER")
     min_days_before_repeat: int = Field(7, alias="MIN_DAYS_BEFORE_REPEAT")
+    frame_cache_dir: str = Field("./data/frames", alias="FRAME_CACHE_DIR")
+    # How long a device keeps getting the same frame from /next (one wake's download)
+    frame_session_seconds: int = Field(300, alias="FRAME_SESSION_SECONDS")
+    # Render each device's next frame this long before its wake; 0 turns the worker off
+    prerender_lead_seconds: int = Field(900, alias="PRERENDER_LEAD_SECONDS")
+    prerender_interval_seconds: int = Field(60, alias="PRERENDER_INTERVAL_SECONDS")
+    # Fleet wake scheduling (app/wake_scheduler.py): each device wakes up to WAKE_SPREAD_SECONDS
+    # after its nominal time, and a WAKE_SLOT_SECONDS slot takes only as many wakes as the render
+    # workers handle at the measured cost per wake (WAKE_COST_SECONDS until there is a measurement).
+    # WAKE_SLOT_LIMIT > 0 fixes the slot size instead. Spread and limit 0 turn it off.
+    wake_spread_seconds: int = Field(900, alias="WAKE_SPREAD_SECONDS")
+    wake_slot_seconds: int = Field(60, alias="WAKE_SLOT_SECONDS")
+    wake_cost_seconds: float = Field(5.0, alias="WAKE_COST_SECONDS")
+    wake_slot_limit: int = Field(0, alias="WAKE_SLOT_LIMIT")
 
     immich_base_url: str = Field(..., alias="IMMICH_BASE_URL")
     immich_api_key: str = Field(..., alias="IMMICH_API_KEY")
     immich_album_id: str = Field(..., alias="IMMICH_ALBUM_ID")
+    # Age after which the cached album index is checked again (in the background)
+    immich_album_refresh_seconds: int = Field(60, alias="IMMICH_ALBUM_REFRESH_SECONDS")
+    # Long edge of Immich's preview images (its "preview size" setting). When it is at least the
+    # panel's long edge, the preview is rendered instead of the original if its crop still covers
+    # the panel. Immich's default of 1440 is too small for 1600 rows, hence 0 (always original).
+    immich_preview_size: int = Field(0, alias="IMMICH_PREVIEW_SIZE")
 
 
 settings = Settings()  # type: ignore[arg-type]
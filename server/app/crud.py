@@ -1,12 +1,24 @@
 from __future__ import annotations
+import random
 from datetime import datetime, timedelta, timezone as dt_timezone
-from sqlalchemy import select, func
+from sqlalchemy import delete, insert, select, func
 from sqlalchemy.ext.asyncio import AsyncSession
-from .models import Device, ImageDownload, DeviceSchedule
+from .models import (
+    Device,
+    DeviceRotation,
+    DeviceSchedule,
+    ImageDownload,
+    RotationEntry,
+)
 from .config import settings
+from .frame_cache import frame_cache
+from .metrics import DB_SECONDS
+from .render_pool import render_pool
+from .wake_scheduler import wake_scheduler
 from croniter import croniter
 
 
+@DB_SECONDS.timed(op="upsert_device")
 async def upsert_device(
     session: AsyncSession,
     device_id: str,
@@ -36,15 +48,31 @@ async def upsert_device(
     return dev
 
 
+@DB_SECONDS.timed(op="mark_image_download")
 async def mark_image_download(
     session: AsyncSession, device: Device, asset_id: str
 ) -> None:
     dl = ImageDownload(device_id_fk=device.id, asset_id=asset_id)
     session.add(dl)
     device.last_image_asset_id = asset_id
+    # Move the rotation past the asset's position, also when it is not the entry at the cursor
+    # (a batch skips assets that left the album); an asset behind the cursor moves nothing
+    rot = await session.get(DeviceRotation, device.id)
+    if rot is not None and rot.cursor < rot.size:
+        res = await session.execute(
+            select(func.min(RotationEntry.position)).where(
+                RotationEntry.device_id_fk == device.id,
+                RotationEntry.position >= rot.cursor,
+                RotationEntry.asset_id == asset_id,
+            )
+        )
+        position = res.scalar_one_or_none()
+        if position is not None:
+            rot.cursor = position + 1
     await session.commit()
 
 
+@DB_SECONDS.timed(op="get_recent_asset_ids")
 async def get_recent_asset_ids(session: AsyncSession, device: Device) -> set[str]:
     cutoff = datetime.utcnow() - timedelta(days=device.min_days_before_repeat)
     res = await session.execute(
@@ -56,6 +84,92 @@ async def get_recent_asset_ids(session: AsyncSession, device: Device) -> set[str
     return {row[0] for row in res.fetchall()}
 
 
+@DB_SECONDS.timed(op="build_rotation")
+async def build_rotation(
+    session: AsyncSession, device: Device, asset_ids: list[str], album_stamp: str
+) -> DeviceRotation:
+    """Start a new pass through the album in random order.
+
+    Assets shown within min_days_before_repeat go to the end, so they only come up again once
+    everything else has been shown.
+    """
+    recent = await get_recent_asset_ids(session, device)
+    fresh = [a for a in asset_ids if a not in recent]
+    repeat = [a for a in asset_ids if a in recent]
+    random.shuffle(fresh)
+    random.shuffle(repeat)
+    order = fresh + repeat
+    await session.execute(
+        delete(RotationEntry).where(RotationEntry.device_id_fk == device.id)
+    )
+    if order:
+        await session.execute(
+            insert(RotationEntry),
+            [
+                {"device_id_fk": device.id, "position": i, "asset_id": a}
+                for i, a in enumerate(order)
+            ],
+        )
+    rot = await session.get(DeviceRotation, device.id)
+    if rot is None:
+        rot = DeviceRotation(device_id_fk=device.id)
+        session.add(rot)
+    rot.cursor = 0
+    rot.size = len(order)
+    rot.album_stamp = album_stamp
+    await session.commit()
+    return rot
+
+
+@DB_SECONDS.timed(op="extend_rotation")
+async def extend_rotation(
+    session: AsyncSession,
+    device: Device,
+    rot: DeviceRotation,
+    asset_ids: list[str],
+    album_stamp: str,
+) -> None:
+    """Append assets added to the album since the pass started, in random order.
+
+    Runs once per album change; removed assets are skipped when their turn comes.
+    """
+    res = await session.execute(
+        select(RotationEntry.asset_id).where(RotationEntry.device_id_fk == device.id)
+    )
+    queued = {row[0] for row in res.fetchall()}
+    added = [a for a in asset_ids if a not in queued]
+    random.shuffle(added)
+    if added:
+        await session.execute(
+            insert(RotationEntry),
+            [
+                {"device_id_fk": device.id, "position": rot.size + i, "asset_id": a}
+                for i, a in enumerate(added)
+            ],
+        )
+    rot.size += len(added)
+    rot.album_stamp = album_stamp
+    await session.commit()
+
+
+@DB_SECONDS.timed(op="rotation_entries")
+async def rotation_entries(
+    session: AsyncSession, device: Device, start: int, limit: int
+) -> list[tuple[int, str]]:
+    """(position, asset_id) from `start` on; a primary key range scan."""
+    res = await session.execute(
+        select(RotationEntry.position, RotationEntry.asset_id)
+        .where(
+            RotationEntry.device_id_fk == device.id,
+            RotationEntry.position >= start,
+        )
+        .order_by(RotationEntry.position)
+        .limit(limit)
+    )
+    return [(row[0], row[1]) for row in res.fetchall()]
+
+
+@DB_SECONDS.timed(op="get_device_by_device_id")
 async def get_device_by_device_id(
     session: AsyncSession, device_id: str
 ) -> Device | None:
@@ -63,6 +177,7 @@ async def get_device_by_device_id(
     return res.scalar_one_or_none()
 
 
+@DB_SECONDS.timed(op="list_schedules")
 async def list_schedules(session: AsyncSession, device: Device) -> list[DeviceSchedule]:
     res = await session.execute(
         select(DeviceSchedule).where(DeviceSchedule.device_id_fk == device.id)
@@ -70,6 +185,7 @@ async def list_schedules(session: AsyncSession, device: Device) -> list[DeviceSc
     return list(res.scalars().all())
 
 
+@DB_SECONDS.timed(op="add_schedule")
 async def add_schedule(
     session: AsyncSession, device: Device, name: str, cron: str, active: bool = True
 ) -> DeviceSchedule:
@@ -80,6 +196,7 @@ async def add_schedule(
     return sched
 
 
+@DB_SECONDS.timed(op="delete_schedule")
 async def delete_schedule(
     session: AsyncSession, device: Device, schedule_id: int
 ) -> bool:
@@ -112,10 +229,22 @@ def _next_from_crons(crons: list[str], now_ts: int) -> int | None:
 
 
 async def compute_next_wake_epoch(session: AsyncSession, device: Device) -> int:
+    now_ts = int(datetime.utcnow().replace(tzinfo=dt_timezone.utc).timestamp())
+    nominal = await _nominal_wake_epoch(session, device, now_ts)
+    # Spread across the fleet so devices sharing a schedule do not all wake in the same second
+    return wake_scheduler.assign(
+        device.device_id,
+        nominal,
+        now_ts,
+        render_pool.render_seconds,
+        frame_cache.transfer_seconds,
+    )
+
+
+async def _nominal_wake_epoch(session: AsyncSession, device: Device, now_ts: int) -> int:
     # Collect active schedules for the device
     schedules = await list_schedules(session, device)
     crons = [s.cron for s in schedules if s.active]
-    now_ts = int(datetime.utcnow().replace(tzinfo=dt_timezone.utc).timestamp())
     nxt = _next_from_crons(crons, now_ts)
     if nxt is not None:
         return nxt
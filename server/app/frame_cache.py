@@ -0,0 +1,204 @@
+from __future__ import annotations
+import hashlib
+import mmap
+import os
+import time
+from collections import OrderedDict
+from dataclasses import dataclass
+from typing import Callable, Optional
+from .config import settings
+
+# Bump when the render pipeline changes so stale frames are not served from disk
+RENDER_VERSION = 3
+
+
+@dataclass
+class CachedFrame:
+    digest: str  # sha1 of the frame bytes, which is also its file name
+    data: memoryview  # read-only view of the mapped file
+
+    @property
+    def etag(self) -> str:
+        # Weak: the same frame keeps its tag whether it is sent plain or run-length coded
+        return 'W/"%s"' % self.digest[:20]
+
+
+@dataclass
+class FrameSession:
+    asset_id: str
+    layout: Optional[str]
+    frame: CachedFrame
+    started: float
+    last_used: float = 0.0
+    recorded: bool = False  # the delivery is in the device's history
+
+
+@dataclass
+class PreparedFrame:
+    asset_id: str
+    version: str
+    layout: Optional[str]
+
+
+class FrameCache:
+    """Packed frames on disk, addressed by their content, plus each device's current frame.
+
+    A frame is rendered once per (asset, version, layout, panel size, dither); every Range request of
+    a download is then a slice of the mapped file. Encoded variants live next to the frame.
+    """
+
+    def __init__(self, root: str, max_open: int = 32):
+        self.root = root
+        self.max_open = max_open
+        self._open: OrderedDict[str, memoryview] = OrderedDict()
+        self._sessions: dict[str, FrameSession] = {}
+        self._prepared: dict[str, PreparedFrame] = {}
+        self._layouts: dict[str, Optional[str]] = {}
+        self.renders = 0
+        self.hits = 0
+        # Wakes that found their frame pre-rendered, and wakes that had to pick and render
+        self.prerender_hits = 0
+        self.prerender_misses = 0
+        # Moving average of first to last request of a download, for the wake scheduler
+        self.transfer_seconds: Optional[float] = None
+
+    @staticmethod
+    def render_key(
+        asset_id: str,
+        version: str,
+        layout: Optional[str],
+        width: int,
+        height: int,
+        dither: str,
+        controllers: int = 2,
+        master_columns: int = 0,
+    ) -> str:
+        raw = "|".join(
+            (
+                str(RENDER_VERSION),
+                asset_id,
+                version,
+                layout or "",
+                f"{width}x{height}",
+                dither,
+                f"{controllers}:{master_columns}",
+            )
+        )
+        return hashlib.sha1(raw.encode()).hexdigest()
+
+    def _path(self, name: str) -> str:
+        return os.path.join(self.root, name[:2], name)
+
+    def _write(self, name: str, data: bytes) -> None:
+        path = self._path(name)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        # Readers never see a partial file
+        tmp = f"{path}.{os.getpid()}.tmp"
+        with open(tmp, "wb") as f:
+            f.write(data)
+        os.replace(tmp, path)
+
+    def _map(self, name: str) -> Optional[memoryview]:
+        view = self._open.get(name)
+        if view is not None:
+            self._open.move_to_end(name)
+            return view
+        try:
+            with open(self._path(name), "rb") as f:
+                if os.fstat(f.fileno()).st_size == 0:
+                    return None
+                view = memoryview(mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ))
+        except FileNotFoundError:
+            return None
+        self._open[name] = view
+        # Dropped views are unmapped once the last response holding a slice is sent
+        while len(self._open) > self.max_open:
+            self._open.popitem(last=False)
+        return view
+
+    def get(self, key: str) -> Optional[CachedFrame]:
+        try:
+            with open(self._path(key + ".key")) as f:
+                digest = f.read().strip()
+        except FileNotFoundError:
+            return None
+        data = self._map(digest)
+        if data is None:
+            return None
+        self.hits += 1
+        return CachedFrame(digest, data)
+
+    def put(self, key: str, packed: bytes) -> CachedFrame:
+        digest = hashlib.sha1(packed).hexdigest()
+        if self._map(digest) is None:
+            self._write(digest, packed)
+        self._write(key + ".key", digest.encode())
+        self.renders += 1
+        return CachedFrame(digest, self._map(digest))
+
+    def variant(
+        self, frame: CachedFrame, name: str, encode: Callable[[memoryview], bytes]
+    ) -> memoryview:
+        """An encoding of a frame, produced on first use and kept next to it."""
+        variant_name = f"{frame.digest}.{name}"
+        data = self._map(variant_name)
+        if data is None:
+            self._write(variant_name, encode(frame.data))
+            data = self._map(variant_name)
+        return data
+
+    def session(self, device_id: str, layout: Optional[str]) -> Optional[FrameSession]:
+        """The frame a device is downloading, while it is younger than FRAME_SESSION_SECONDS."""
+        sess = self._sessions.get(device_id)
+        if sess is None or sess.layout != layout:
+            return None
+        now = time.monotonic()
+        if now - sess.started > settings.frame_session_seconds:
+            self._observe_transfer(self._sessions.pop(device_id))
+            return None
+        sess.last_used = now
+        return sess
+
+    def _observe_transfer(self, sess: Optional[FrameSession]) -> None:
+        if sess is None or sess.last_used <= sess.started:
+            return
+        seconds = sess.last_used - sess.started
+        prev = self.transfer_seconds
+        self.transfer_seconds = seconds if prev is None else 0.8 * prev + 0.2 * seconds
+
+    def start_session(
+        self, device_id: str, asset_id: str, layout: Optional[str], frame: CachedFrame
+    ) -> FrameSession:
+        self._observe_transfer(self._sessions.get(device_id))
+        sess = FrameSession(asset_id, layout, frame, time.monotonic())
+        self._sessions[device_id] = sess
+        self._layouts[device_id] = layout
+        return sess
+
+    def end_session(self, device_id: str) -> None:
+        self._observe_transfer(self._sessions.pop(device_id, None))
+
+    def last_layout(self, device_id: str, default: Optional[str]) -> Optional[str]:
+        """The X-EPD-Layout of the device's last download."""
+        return self._layouts.get(device_id, default)
+
+    def prepare(
+        self, device_id: str, asset_id: str, version: str, layout: Optional[str]
+    ) -> None:
+        """Remember a frame rendered ahead of the device's wake; it is not recorded yet."""
+        self._prepared[device_id] = PreparedFrame(asset_id, version, layout)
+
+    def is_prepared(self, device_id: str) -> bool:
+        return device_id in self._prepared
+
+    def prepared_count(self) -> int:
+        return len(self._prepared)
+
+    def take_prepared(self, device_id: str, layout: Optional[str]) -> Optional[PreparedFrame]:
+        prepared = self._prepared.pop(device_id, None)
+        if prepared is None or prepared.layout != layout:
+            return None
+        return prepared
+
+
+frame_cache = FrameCache(settings.frame_cache_dir)
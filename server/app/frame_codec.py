@@ -0,0 +1,73 @@
+from __future__ import annotations
+import re
+import zlib
+
+# Run-length wire encoding understood by the device
+# (components/epd_photo_frame/frame_codec.h). A control byte c < 0x80 is followed by
+# c + 1 literal bytes; c >= 0x80 is followed by one byte repeated (c & 0x7F) + 3 times.
+RLE_ENCODING = "x-epd-rle"
+_MIN_RUN = 3
+_MAX_RUN = 0x7F + _MIN_RUN
+_MAX_LITERAL = 0x80
+# Runs are located by the regex engine so the Python loop only runs once per run
+_RUN = re.compile(rb"(.)\1{2,}", re.S)
+
+
+def _emit_literal(out: bytearray, data: bytes, start: int, end: int) -> None:
+    while start < end:
+        n = min(end - start, _MAX_LITERAL)
+        out.append(n - 1)
+        out += data[start : start + n]
+        start += n
+
+
+def rle_encode(data: bytes) -> bytes:
+    out = bytearray()
+    pos = 0
+    for m in _RUN.finditer(data):
+        _emit_literal(out, data, pos, m.start())
+        n = m.end() - m.start()
+        while n >= _MIN_RUN:
+            take = min(n, _MAX_RUN)
+            out.append(0x80 | (take - _MIN_RUN))
+            out += m.group(1)
+            n -= take
+        # A 1-2 byte tail of a long run is cheaper as part of the next literal
+        pos = m.end() - n
+    _emit_literal(out, data, pos, len(data))
+    return bytes(out)
+
+
+def rle_decode(data: bytes) -> bytes:
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        c = data[i]
+        i += 1
+        if c < 0x80:
+            out += data[i : i + c + 1]
+            i += c + 1
+        else:
+            out += data[i : i + 1] * ((c & 0x7F) + _MIN_RUN)
+            i += 1
+    return bytes(out)
+
+
+def accepts_rle(accept_encoding: str | None) -> bool:
+    if not accept_encoding:
+        return False
+    codings = [c.split(";")[0].strip().lower() for c in accept_encoding.split(",")]
+    return RLE_ENCODING in codings
+
+
+# Per-chunk CRC32 manifest for delta downloads. The device compares it with its stored frame
+# and fetches only the ranges that differ; chunks match its 100 KB range size.
+MANIFEST_CHUNK_SIZE = 100 * 1024
+
+
+def chunk_manifest(packed: bytes, chunk_size: int = MANIFEST_CHUNK_SIZE) -> str:
+    lines = [f"size {len(packed)}", f"chunk {chunk_size}"]
+    view = memoryview(packed)
+    for start in range(0, len(packed), chunk_size):
+        lines.append("%08x" % zlib.crc32(view[start : start + chunk_size]))
+    return "\n".join(lines) + "\n"
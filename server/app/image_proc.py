@@ -1,36 +1,288 @@
 from __future__ import annotations
-from PIL import Image
+import math
+import os
+import struct
+import time
+from concurrent.futures import ThreadPoolExecutor
+from functools import lru_cache
+from PIL import Image, ImageChops
 from io import BytesIO
 
+# Frame header understood by the device (components/epd_photo_frame/frame_format.h)
+FRAME_MAGIC = b"EPDF"
+FRAME_VERSION = 1
+FRAME_HEADER = struct.Struct("<4sBBBBHHI")
+LAYOUT_INTERLEAVED = "interleaved"
+LAYOUT_SPLIT = "split"
+_LAYOUT_CODES = {LAYOUT_INTERLEAVED: 0, LAYOUT_SPLIT: 1}
 
-def center_crop_resize_to_panel(data: bytes, width: int, height: int) -> Image.Image:
-    img = Image.open(BytesIO(data)).convert("L")
-    # Center-crop to aspect ratio, then resize with high-quality filter
-    src_w, src_h = img.size
+# Panel inks and the nibble the controller takes for each
+# (components/epd_photo_frame/panel_traits.h, Spectra6Panel13in3::PALETTE)
+SPECTRA6_PALETTE = (
+    ((0, 0, 0), 0x0),
+    ((255, 255, 255), 0x1),
+    ((255, 255, 0), 0x2),
+    ((255, 0, 0), 0x3),
+    ((0, 0, 255), 0x5),
+    ((0, 255, 0), 0x6),
+)
+DITHER_ORDERED = "ordered"
+DITHER_FLOYD_STEINBERG = "floyd-steinberg"
+DITHER_NONE = "none"
+
+# Both halves of a byte, for packing without a per-pixel Python loop
+_SHIFT_HIGH = bytes((v << 4) & 0xF0 for v in range(256))
+_TOP_NIBBLE = bytes(v >> 4 for v in range(256))
+# Palette position -> controller nibble
+_SPECTRA6_CODES = [code for _, code in SPECTRA6_PALETTE] + [0] * (
+    256 - len(SPECTRA6_PALETTE)
+)
+# Rows per band when dithering in threads: a multiple of 8 keeps the Bayer phase, and an even
+# pixel count per band keeps every packed byte inside one band
+DITHER_BAND_ROWS = 200
+_BAYER_8 = (
+    (0, 32, 8, 40, 2, 34, 10, 42),
+    (48, 16, 56, 24, 50, 18, 58, 26),
+    (12, 44, 4, 36, 14, 46, 6, 38),
+    (60, 28, 52, 20, 62, 30, 54, 22),
+    (3, 35, 11, 43, 1, 33, 9, 41),
+    (51, 19, 59, 27, 49, 17, 57, 25),
+    (15, 47, 7, 39, 13, 45, 5, 37),
+    (63, 31, 55, 23, 61, 29, 53, 21),
+)
+
+
+def panel_crop_box(
+    src_w: int, src_h: int, width: int, height: int
+) -> tuple[int, int, int, int]:
+    """Centred box of the source with the panel's aspect ratio."""
     target_ratio = width / height
     src_ratio = src_w / src_h
     if src_ratio > target_ratio:
         # Wider than target: crop left/right
         new_w = int(src_h * target_ratio)
         offset = (src_w - new_w) // 2
-        img = img.crop((offset, 0, offset + new_w, src_h))
-    else:
-        # Taller than target: crop top/bottom
-        new_h = int(src_w / target_ratio)
-        offset = (src_h - new_h) // 2
-        img = img.crop((0, offset, src_w, offset + new_h))
-    img = img.resize((width, height), Image.LANCZOS)
-    return img
+        return (offset, 0, offset + new_w, src_h)
+    # Taller than target: crop top/bottom
+    new_h = int(src_w / target_ratio)
+    offset = (src_h - new_h) // 2
+    return (0, offset, src_w, offset + new_h)
+
+
+def covers_panel(data: bytes, width: int, height: int) -> bool:
+    """Whether the photo's panel-shaped crop has at least the panel's pixels (header only)."""
+    try:
+        src_w, src_h = Image.open(BytesIO(data)).size
+    except OSError:
+        return False
+    x0, y0, x1, y1 = panel_crop_box(src_w, src_h, width, height)
+    return x1 - x0 >= width and y1 - y0 >= height
+
+
+def decode_for_panel(data: bytes, width: int, height: int) -> Image.Image:
+    """RGB image, decoded no larger than the panel crop needs."""
+    img = Image.open(BytesIO(data))
+    x0, y0, x1, y1 = panel_crop_box(img.width, img.height, width, height)
+    scale = min((x1 - x0) / width, (y1 - y0) / height)
+    if scale >= 2:
+        # JPEG: decode at 1/2, 1/4 or 1/8 size in the DCT domain, never below the panel
+        img.draft("RGB", (math.ceil(img.width / scale), math.ceil(img.height / scale)))
+    return img.convert("RGB")
+
 
+def crop_resize_to_panel(img: Image.Image, width: int, height: int) -> Image.Image:
+    # The crop is part of the resize, and a cheap box reduction does most of the shrinking
+    box = panel_crop_box(img.width, img.height, width, height)
+    return img.resize((width, height), Image.LANCZOS, box=box, reducing_gap=3.0)
 
-def pack_grayscale_4bpp(img: Image.Image) -> bytes:
-    # Input is L-mode 8-bit grayscale; output packs two 4-bit pixels per byte, MS nibble first
+
+def center_crop_resize_to_panel(data: bytes, width: int, height: int) -> Image.Image:
+    return crop_resize_to_panel(decode_for_panel(data, width, height), width, height)
+
+
+def pack_nibbles(values: bytes) -> bytes:
+    """Two 4-bit values (0-15) per byte, MS nibble first; an odd tail is padded with 0."""
+    high = values[0::2].translate(_SHIFT_HIGH)
+    low = values[1::2]
+    if len(low) < len(high):
+        low += b"\0"
+    if not high:
+        return b""
+    # The halves never overlap, so a saturating add is an OR; both run in C
+    size = (len(high), 1)
+    return ImageChops.add(
+        Image.frombytes("L", size, high), Image.frombytes("L", size, low)
+    ).tobytes()
+
+
+def pack_grayscale_4bpp(
+    img: Image.Image,
+    layout: str | None = None,
+    controllers: int = 2,
+    master_columns: int | None = None,
+) -> bytes:
+    # Input is L-mode 8-bit grayscale; output packs two 4-bit pixels per byte, MS nibble first.
+    # layout=None keeps the legacy headerless row-interleaved stream; "interleaved"/"split"
+    # prepend a frame header, and "split" stores all master half-rows before all slave half-rows.
     if img.mode != "L":
         img = img.convert("L")
-    pixels = img.tobytes()
-    buf = bytearray()
-    for i in range(0, len(pixels), 2):
-        p0 = pixels[i] >> 4
-        p1 = (pixels[i + 1] >> 4) if i + 1 < len(pixels) else 0
-        buf.append((p0 << 4) | p1)
-    return bytes(buf)
+    buf = pack_nibbles(img.tobytes().translate(_TOP_NIBBLE))
+    if layout is None:
+        return buf
+    return frame_with_layout(buf, img.width, img.height, layout, controllers, master_columns)
+
+
+@lru_cache(maxsize=1)
+def _spectra6_palette_image() -> Image.Image:
+    pal = Image.new("P", (1, 1))
+    pal.putpalette([c for rgb, _ in SPECTRA6_PALETTE for c in rgb])
+    return pal
+
+
+@lru_cache(maxsize=4)
+def _bayer_offsets(width: int, height: int) -> Image.Image:
+    # Threshold map 2..254, centred on 128 so a pure ink never turns into another one
+    rows = []
+    for tile_row in _BAYER_8:
+        row = bytes(v * 4 + 2 for v in tile_row) * (width // 8 + 1)
+        rows.append(row[:width])
+    plane = Image.frombytes("L", (width, height), b"".join(rows[y % 8] for y in range(height)))
+    return Image.merge("RGB", (plane, plane, plane))
+
+
+@lru_cache(maxsize=1)
+def _band_executor() -> ThreadPoolExecutor:
+    # One per process; Pillow releases the GIL inside add, quantize and tobytes
+    return ThreadPoolExecutor(_cpu_count(), thread_name_prefix="dither")
+
+
+def _cpu_count() -> int:
+    if hasattr(os, "sched_getaffinity"):
+        return len(os.sched_getaffinity(0))
+    return os.cpu_count() or 1
+
+
+def _spectra6_bands(img: Image.Image, dither: str, pack: bool) -> bytes:
+    if img.mode != "RGB":
+        img = img.convert("RGB")
+    offsets = None
+    if dither == DITHER_ORDERED:
+        offsets = _bayer_offsets(img.width, img.height)
+        mode = Image.Dither.NONE
+    elif dither == DITHER_FLOYD_STEINBERG:
+        mode = Image.Dither.FLOYDSTEINBERG
+    elif dither == DITHER_NONE:
+        mode = Image.Dither.NONE
+    else:
+        raise ValueError(f"unknown dither {dither!r}")
+    codes = bytes(_SPECTRA6_CODES)
+
+    def band(box: tuple[int, int, int, int]) -> bytes:
+        part = img.crop(box)
+        if offsets is not None:
+            part = ImageChops.add(part, offsets.crop(box), offset=-128)
+        out = part.quantize(palette=_spectra6_palette_image(), dither=mode).tobytes().translate(codes)
+        return pack_nibbles(out) if pack else out
+
+    # Error diffusion carries into the rows below, so Floyd-Steinberg stays one band
+    rows = img.height if dither == DITHER_FLOYD_STEINBERG else DITHER_BAND_ROWS
+    boxes = [(0, y, img.width, min(y + rows, img.height)) for y in range(0, img.height, rows)]
+    if len(boxes) == 1 or _cpu_count() == 1:
+        return b"".join(map(band, boxes))
+    return b"".join(_band_executor().map(band, boxes))
+
+
+def quantize_spectra6(img: Image.Image, dither: str = DITHER_ORDERED) -> bytes:
+    """One controller nibble per pixel, row-major.
+
+    "ordered" (8x8 Bayer) only depends on each pixel's own position, so an edit changes the
+    frame only where it touches and delta downloads stay small. "floyd-steinberg" is smoother
+    but carries error across the whole frame below an edit. "ordered" and "none" work on bands
+    of DITHER_BAND_ROWS rows in parallel threads.
+    """
+    return _spectra6_bands(img, dither, pack=False)
+
+
+def pack_spectra6_4bpp(
+    img: Image.Image,
+    layout: str | None = None,
+    dither: str = DITHER_ORDERED,
+    controllers: int = 2,
+    master_columns: int | None = None,
+) -> bytes:
+    """Panel-native frame: Spectra6 nibbles, in the same layouts as pack_grayscale_4bpp."""
+    # Each band is packed in its own thread as well
+    buf = _spectra6_bands(img, dither, pack=True)
+    if layout is None:
+        return buf
+    return frame_with_layout(buf, img.width, img.height, layout, controllers, master_columns)
+
+
+def frame_with_layout(
+    packed: bytes,
+    width: int,
+    height: int,
+    layout: str,
+    controllers: int = 2,
+    master_columns: int | None = None,
+) -> bytes:
+    """Header plus 4 bpp rows; "split" sends columns [0, master_columns) of every row first.
+
+    controllers and master_columns follow the panel traits (CONTROLLERS, MASTER_COLUMNS), so the
+    master block is PanelGeometry::MASTER_DATA_SIZE long; master_columns defaults to half a row.
+    """
+    if layout not in _LAYOUT_CODES:
+        raise ValueError(f"unknown layout {layout!r}")
+    if controllers not in (1, 2):
+        raise ValueError(f"unsupported controller count {controllers}")
+    if master_columns is None:
+        master_columns = width // 2 if controllers == 2 else width
+    if controllers == 1 and master_columns != width:
+        raise ValueError("a single controller drives the whole row")
+    if controllers == 2 and not 0 < master_columns < width:
+        raise ValueError(f"master columns {master_columns} outside the {width} pixel row")
+    if master_columns % 2:
+        raise ValueError("the controller split must fall on a byte")
+    header = FRAME_HEADER.pack(
+        FRAME_MAGIC,
+        FRAME_VERSION,
+        _LAYOUT_CODES[layout],
+        4,
+        controllers,
+        width,
+        height,
+        len(packed),
+    )
+    if layout == LAYOUT_INTERLEAVED or controllers == 1:
+        return header + packed
+    row = len(packed) // height
+    split = master_columns // 2
+    master = b"".join(packed[r * row : r * row + split] for r in range(height))
+    slave = b"".join(packed[r * row + split : (r + 1) * row] for r in range(height))
+    return header + master + slave
+
+
+def render_frame_timed(
+    data: bytes,
+    width: int,
+    height: int,
+    layout: str | None,
+    dither: str,
+    controllers: int = 2,
+    master_columns: int | None = None,
+) -> tuple[bytes, dict[str, float]]:
+    """Encoded photo to panel frame; the whole CPU-bound stage, run in the render pool.
+
+    Also returns the seconds spent decoding, resizing and packing, as metrics recorded in a
+    worker process would never reach /metrics.
+    """
+    t0 = time.perf_counter()
+    img = decode_for_panel(data, width, height)
+    t1 = time.perf_counter()
+    img = crop_resize_to_panel(img, width, height)
+    t2 = time.perf_counter()
+    packed = pack_spectra6_4bpp(
+        img, layout=layout, dither=dither, controllers=controllers, master_columns=master_columns
+    )
+    t3 = time.perf_counter()
+    return packed, {"decode": t1 - t0, "resize": t2 - t1, "pack": t3 - t2}
@@ -1,31 +1,137 @@
 from __future__ import annotations
 import asyncio
-from typing import Any
+import logging
+import time
+from dataclasses import dataclass
+from typing import Any, Optional
 import httpx
 from .config import settings
+from .metrics import IMMICH_SECONDS
+
+logger = logging.getLogger(__name__)
+
+# Album metadata that changes whenever assets are added, removed or edited
+_ALBUM_STAMP_KEYS = ("updatedAt", "assetCount", "lastModifiedAssetTimestamp")
+# All the frame pipeline reads from an album entry (see routers/images.py)
+_ASSET_KEYS = ("id", "checksum", "updatedAt")
+
+
+@dataclass
+class AlbumIndex:
+    assets: list[dict[str, Any]]
+    stamp: tuple
+    etag: Optional[str]
+    checked: float  # time.monotonic() of the last successful check
 
 
 class ImmichClient:
-    def __init__(self, base_url: str, api_key: str):
+    def __init__(
+        self,
+        base_url: str,
+        api_key: str,
+        transport: Optional[httpx.AsyncBaseTransport] = None,
+    ):
         self._base = base_url.rstrip("/")
         self._api_key = api_key
         self._headers = {"x-api-key": api_key}
+        self._transport = transport
+        self._client: Optional[httpx.AsyncClient] = None
+        self._client_loop: Optional[asyncio.AbstractEventLoop] = None
+        self._albums: dict[str, AlbumIndex] = {}
+        self._refreshing: dict[str, asyncio.Task] = {}
+
+    def _http(self) -> httpx.AsyncClient:
+        # One connection pool for the life of the app; a new one only if the event loop changed
+        loop = asyncio.get_running_loop()
+        if self._client is None or self._client_loop is not loop:
+            self._client = httpx.AsyncClient(
+                base_url=self._base,
+                headers=self._headers,
+                timeout=30,
+                transport=self._transport,
+            )
+            self._client_loop = loop
+        return self._client
+
+    async def aclose(self) -> None:
+        if self._client is not None:
+            await self._client.aclose()
+            self._client = None
 
     async def list_album_assets(self, album_id: str) -> list[dict[str, Any]]:
-        url = f"{self._base}/api/albums/{album_id}"
-        async with httpx.AsyncClient(timeout=30) as client:
-            resp = await client.get(url, headers=self._headers)
-            resp.raise_for_status()
-            data = resp.json()
-            assets = data.get("assets", [])
-            return assets
-
-    async def get_asset_bytes(self, asset_id: str) -> bytes:
-        url = f"{self._base}/api/assets/{asset_id}/original"
-        async with httpx.AsyncClient(timeout=None) as client:
-            resp = await client.get(url, headers=self._headers)
+        """The album's assets from the local index; a stale index is refreshed in the background."""
+        index = self._albums.get(album_id)
+        if index is None:
+            return (await self.refresh_album(album_id)).assets
+        stale = time.monotonic() - index.checked > settings.immich_album_refresh_seconds
+        if stale and album_id not in self._refreshing:
+            task = asyncio.create_task(self.refresh_album(album_id))
+            self._refreshing[album_id] = task
+            task.add_done_callback(lambda t: self._refresh_done(album_id, t))
+        return index.assets
+
+    def _refresh_done(self, album_id: str, task: asyncio.Task) -> None:
+        self._refreshing.pop(album_id, None)
+        if not task.cancelled() and task.exception() is not None:
+            # The old index keeps serving; the next request tries again
+            logger.warning("album %s refresh failed: %r", album_id, task.exception())
+
+    async def refresh_album(self, album_id: str) -> AlbumIndex:
+        """Bring the album index up to date, downloading the asset list only if it changed."""
+        http = self._http()
+        index = self._albums.get(album_id)
+        if index is not None:
+            with IMMICH_SECONDS.time(call="album_meta"):
+                resp = await http.get(
+                    f"/api/albums/{album_id}", params={"withoutAssets": "true"}
+                )
             resp.raise_for_status()
-            return resp.content
+            meta = resp.json()
+            if tuple(meta.get(k) for k in _ALBUM_STAMP_KEYS) == index.stamp:
+                index.checked = time.monotonic()
+                return index
+
+        headers = {"If-None-Match": index.etag} if index is not None and index.etag else {}
+        with IMMICH_SECONDS.time(call="album"):
+            resp = await http.get(f"/api/albums/{album_id}", headers=headers)
+        if resp.status_code == 304 and index is not None:
+            index.checked = time.monotonic()
+            return index
+        resp.raise_for_status()
+        data = resp.json()
+        # Only what the pipeline reads is kept, not the full asset records
+        assets = [
+            {k: a[k] for k in _ASSET_KEYS if k in a} for a in data.get("assets", [])
+        ]
+        index = AlbumIndex(
+            assets=assets,
+            stamp=tuple(data.get(k) for k in _ALBUM_STAMP_KEYS),
+            etag=resp.headers.get("etag"),
+            checked=time.monotonic(),
+        )
+        self._albums[album_id] = index
+        return index
+
+    async def _download(
+        self, call: str, url: str, params: Optional[dict] = None
+    ) -> bytearray:
+        # Chunks go straight into one buffer instead of being kept and joined
+        buf = bytearray()
+        with IMMICH_SECONDS.time(call=call):
+            async with self._http().stream("GET", url, params=params, timeout=None) as resp:
+                resp.raise_for_status()
+                async for chunk in resp.aiter_bytes():
+                    buf += chunk
+        return buf
+
+    async def get_asset_preview_bytes(self, asset_id: str) -> bytearray:
+        # JPEG of IMMICH_PREVIEW_SIZE on the long edge, whatever the original's format
+        return await self._download(
+            "preview", f"/api/assets/{asset_id}/thumbnail", params={"size": "preview"}
+        )
+
+    async def get_asset_bytes(self, asset_id: str) -> bytearray:
+        return await self._download("original", f"/api/assets/{asset_id}/original")
 
 
 immich = ImmichClient(settings.immich_base_url, settings.immich_api_key)
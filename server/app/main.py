@@ -1,12 +1,20 @@
 from __future__ import annotations
 import asyncio
 from fastapi import FastAPI
+from fastapi.responses import PlainTextResponse
 from sqlalchemy.ext.asyncio import AsyncSession
 from sqlalchemy import text
 from .db import get_engine, Base
+from .config import settings
+from .frame_cache import frame_cache
+from .immich import immich
+from .metrics import CONTENT_TYPE, HISTOGRAMS, scalar
+from .prerender import run_prerender_worker
+from .render_pool import render_pool
 from .routers import devices, images
 
 app = FastAPI(title="EPD Backend")
+_prerender_task: asyncio.Task | None = None
 
 
 @app.on_event("startup")
@@ -15,6 +23,24 @@ async def on_startup() -> None:
     engine = get_engine()
     async with engine.begin() as conn:
         await conn.run_sync(Base.metadata.create_all)
+        # create_all leaves tables that already exist alone; databases from before the index
+        await conn.execute(
+            text(
+                "CREATE INDEX IF NOT EXISTS ix_image_downloads_device_time "
+                "ON image_downloads (device_id_fk, downloaded_at)"
+            )
+        )
+    global _prerender_task
+    if settings.prerender_lead_seconds > 0:
+        _prerender_task = asyncio.create_task(run_prerender_worker())
+
+
+@app.on_event("shutdown")
+async def on_shutdown() -> None:
+    if _prerender_task is not None:
+        _prerender_task.cancel()
+    render_pool.shutdown()
+    await immich.aclose()
 
 
 app.include_router(devices.router)
@@ -24,3 +50,37 @@ app.include_router(images.router)
 @app.get("/")
 async def root():
     return {"ok": True, "service": "epd-backend"}
+
+
+@app.get("/metrics", response_class=PlainTextResponse)
+async def metrics():
+    """Prometheus text format: per-stage histograms and the frame cache and render pool counters."""
+    lines: list[str] = []
+    for histogram in HISTOGRAMS:
+        lines += histogram.expose()
+    lines += scalar("epd_render_depth", "Frames being fetched or rendered", render_pool.depth)
+    lines += scalar(
+        "epd_render_rejected_total", "Requests answered 503", render_pool.rejected, "counter"
+    )
+    lines += scalar(
+        "epd_render_shared_total",
+        "Requests that waited for a render already running",
+        render_pool.shared,
+        "counter",
+    )
+    lines += scalar(
+        "epd_frames_rendered_total", "Frames rendered", frame_cache.renders, "counter"
+    )
+    lines += scalar(
+        "epd_prerender_hits_total",
+        "Wakes whose frame was rendered ahead",
+        frame_cache.prerender_hits,
+        "counter",
+    )
+    lines += scalar(
+        "epd_prerender_misses_total",
+        "Wakes that had to pick and render",
+        frame_cache.prerender_misses,
+        "counter",
+    )
+    return PlainTextResponse("\n".join(lines) + "\n", media_type=CONTENT_TYPE)
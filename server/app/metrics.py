@@ -0,0 +1,118 @@
+from __future__ import annotations
+import functools
+import time
+from bisect import bisect_left
+from contextlib import contextmanager
+from typing import Any, Awaitable, Callable, Iterator, TypeVar
+
+# Prometheus text exposition (format 0.0.4) without the client library: the backend only needs
+# a few histograms, all observed on the event loop, so no locking either.
+
+CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8"
+
+# Seconds, from a cached lookup (~0.1 ms) to a slow original download
+LATENCY_BUCKETS = (
+    0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0,
+)
+# Response bodies, from a 304 to a whole unranged frame
+SIZE_BUCKETS = (0, 1024, 16 * 1024, 64 * 1024, 100 * 1024, 256 * 1024, 512 * 1024, 1024 * 1024)
+
+F = TypeVar("F", bound=Callable[..., Awaitable[Any]])
+
+
+def _format(value: float) -> str:
+    return repr(float(value)) if value != int(value) else str(int(value))
+
+
+def _labels(pairs: tuple[tuple[str, str], ...]) -> str:
+    if not pairs:
+        return ""
+    inner = ",".join(
+        '%s="%s"' % (k, v.replace("\\", "\\\\").replace('"', '\\"')) for k, v in pairs
+    )
+    return "{" + inner + "}"
+
+
+class Histogram:
+    def __init__(self, name: str, help: str, buckets: tuple[float, ...] = LATENCY_BUCKETS):
+        self.name = name
+        self.help = help
+        self.buckets = tuple(sorted(buckets))
+        # sorted label pairs -> [per-bucket counts..., sum, count]
+        self._series: dict[tuple[tuple[str, str], ...], list[float]] = {}
+
+    def observe(self, value: float, **labels: str) -> None:
+        key = tuple(sorted(labels.items()))
+        series = self._series.get(key)
+        if series is None:
+            series = self._series[key] = [0] * len(self.buckets) + [0.0, 0]
+        i = bisect_left(self.buckets, value)
+        if i < len(self.buckets):
+            series[i] += 1
+        series[-2] += value
+        series[-1] += 1
+
+    @contextmanager
+    def time(self, **labels: str) -> Iterator[None]:
+        """Observe the duration of the block, also when it raises."""
+        start = time.perf_counter()
+        try:
+            yield
+        finally:
+            self.observe(time.perf_counter() - start, **labels)
+
+    def timed(self, **labels: str) -> Callable[[F], F]:
+        """Decorator observing every call of a coroutine function."""
+
+        def wrap(fn: F) -> F:
+            @functools.wraps(fn)
+            async def inner(*args: Any, **kwargs: Any) -> Any:
+                with self.time(**labels):
+                    return await fn(*args, **kwargs)
+
+            return inner  # type: ignore[return-value]
+
+        return wrap
+
+    def count(self, **labels: str) -> int:
+        series = self._series.get(tuple(sorted(labels.items())))
+        return int(series[-1]) if series else 0
+
+    def total(self, **labels: str) -> float:
+        series = self._series.get(tuple(sorted(labels.items())))
+        return series[-2] if series else 0.0
+
+    def expose(self) -> list[str]:
+        lines = [f"# HELP {self.name} {self.help}", f"# TYPE {self.name} histogram"]
+        for key, series in sorted(self._series.items()):
+            cumulative = 0
+            for bound, n in zip(self.buckets, series):
+                cumulative += n
+                le = key + (("le", _format(bound)),)
+                lines.append(f"{self.name}_bucket{_labels(le)} {int(cumulative)}")
+            le = key + (("le", "+Inf"),)
+            lines.append(f"{self.name}_bucket{_labels(le)} {int(series[-1])}")
+            lines.append(f"{self.name}_sum{_labels(key)} {_format(series[-2])}")
+            lines.append(f"{self.name}_count{_labels(key)} {int(series[-1])}")
+        return lines
+
+
+def scalar(name: str, help: str, value: float, kind: str = "gauge") -> list[str]:
+    """A single value read at scrape time, e.g. a counter kept elsewhere."""
+    return [f"# HELP {name} {help}", f"# TYPE {name} {kind}", f"{name} {_format(value)}"]
+
+
+# Stages of serving a frame: album listing, photo download, decode, resize, pack, the render job
+# as a whole, and picking the next photo
+STAGE_SECONDS = Histogram("epd_stage_seconds", "Time spent per stage of producing a frame")
+# Calls to Immich, by endpoint (album metadata, album listing, original, preview)
+IMMICH_SECONDS = Histogram("epd_immich_seconds", "Immich request latency")
+# The crud helpers, by function
+DB_SECONDS = Histogram("epd_db_seconds", "Database helper latency")
+# /images/next and /images/asset responses, by encoding
+RESPONSE_BYTES = Histogram(
+    "epd_response_bytes", "Frame bytes sent per response (one Range request)", SIZE_BUCKETS
+)
+REQUEST_SECONDS = Histogram("epd_request_seconds", "Frame request latency, by endpoint")
+
+HISTOGRAMS = (STAGE_SECONDS, IMMICH_SECONDS, DB_SECONDS, RESPONSE_BYTES, REQUEST_SECONDS)
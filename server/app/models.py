@@ -1,6 +1,14 @@
 from __future__ import annotations
 from datetime import datetime, timedelta
-from sqlalchemy import String, Integer, DateTime, Boolean, ForeignKey, UniqueConstraint
+from sqlalchemy import (
+    String,
+    Integer,
+    DateTime,
+    Boolean,
+    ForeignKey,
+    Index,
+    UniqueConstraint,
+)
 from sqlalchemy.orm import Mapped, mapped_column, relationship
 from .db import Base
 
@@ -58,3 +66,28 @@ class ImageDownload(Base):
     downloaded_at: Mapped[datetime] = mapped_column(DateTime, default=datetime.utcnow)
 
     device: Mapped[Device] = relationship(back_populates="downloads")
+
+    # A device's recent downloads are a range scan, however long its history
+    __table_args__ = (
+        Index("ix_image_downloads_device_time", "device_id_fk", "downloaded_at"),
+    )
+
+
+class DeviceRotation(Base):
+    """A device's shuffled pass through the album; `cursor` is the next position to show."""
+
+    __tablename__ = "device_rotations"
+
+    device_id_fk: Mapped[int] = mapped_column(ForeignKey("devices.id"), primary_key=True)
+    cursor: Mapped[int] = mapped_column(Integer, default=0)
+    size: Mapped[int] = mapped_column(Integer, default=0)
+    # Album snapshot the queue was last reconciled with (see routers/images.py album_snapshot)
+    album_stamp: Mapped[str] = mapped_column(String(40), default="")
+
+
+class RotationEntry(Base):
+    __tablename__ = "rotation_entries"
+
+    device_id_fk: Mapped[int] = mapped_column(ForeignKey("devices.id"), primary_key=True)
+    position: Mapped[int] = mapped_column(Integer, primary_key=True)
+    asset_id: Mapped[str] = mapped_column(String(64))
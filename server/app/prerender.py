@@ -0,0 +1,55 @@
+from __future__ import annotations
+import asyncio
+import logging
+import time
+from fastapi import HTTPException
+from sqlalchemy import select
+from sqlalchemy.ext.asyncio import AsyncSession
+from .config import settings
+from .crud import compute_next_wake_epoch
+from .db import get_sessionmaker
+from .frame_cache import frame_cache
+from .image_proc import LAYOUT_SPLIT
+from .models import Device
+from .routers.images import render_asset_frame, select_next_assets
+
+logger = logging.getLogger(__name__)
+
+
+async def prerender_due(db: AsyncSession) -> int:
+    """Pick and render the next frame of every device waking within PRERENDER_LEAD_SECONDS.
+
+    Nothing is recorded as downloaded here; /images/next does that when the device takes the
+    frame. Returns the number of frames prepared.
+    """
+    now_ts = int(time.time())
+    res = await db.execute(select(Device))
+    prepared = 0
+    for dev in res.scalars().all():
+        if frame_cache.is_prepared(dev.device_id):
+            continue
+        wake_ts = await compute_next_wake_epoch(db, dev)
+        if wake_ts - now_ts > settings.prerender_lead_seconds:
+            continue
+        # The firmware asks for the split layout
+        layout = frame_cache.last_layout(dev.device_id, LAYOUT_SPLIT)
+        try:
+            asset_id, version = (await select_next_assets(db, dev.device_id))[0]
+            await render_asset_frame(asset_id, layout, version)
+        except HTTPException as e:
+            logger.warning("pre-render for %s skipped: %s", dev.device_id, e.detail)
+            continue
+        frame_cache.prepare(dev.device_id, asset_id, version, layout)
+        prepared += 1
+    return prepared
+
+
+async def run_prerender_worker() -> None:
+    while True:
+        try:
+            async with get_sessionmaker()() as db:  # type: ignore[call-arg]
+                await prerender_due(db)
+        except Exception:
+            # Immich or the disk being unavailable only costs this round
+            logger.exception("pre-render round failed")
+        await asyncio.sleep(settings.prerender_interval_seconds)
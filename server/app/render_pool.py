@@ -0,0 +1,82 @@
+from __future__ import annotations
+import asyncio
+import multiprocessing
+import time
+from concurrent.futures import ProcessPoolExecutor
+from typing import Any, Awaitable, Callable, Optional
+from .config import settings
+
+
+class RenderQueueFull(Exception):
+    pass
+
+
+class RenderPool:
+    """Runs renders in worker processes so the event loop keeps serving other requests.
+
+    A job covers everything for one frame (fetching the original and rendering it). Requests
+    for a frame that is already queued wait for that job instead of starting another one, and
+    no new job is accepted while `queue_limit` are in flight.
+    """
+
+    def __init__(self, workers: int, queue_limit: int):
+        self.workers = workers
+        self.queue_limit = queue_limit
+        self._executor: Optional[ProcessPoolExecutor] = None
+        self._jobs: dict[str, asyncio.Future] = {}
+        self.peak_depth = 0
+        self.completed = 0
+        self.shared = 0
+        self.rejected = 0
+        # Moving average of a job's duration, for the wake scheduler
+        self.render_seconds: Optional[float] = None
+
+    @property
+    def depth(self) -> int:
+        return len(self._jobs)
+
+    async def run_cpu(self, fn: Callable[..., Any], *args: Any) -> Any:
+        """fn(*args) in a worker process (or a thread with RENDER_WORKERS=0)."""
+        if self.workers <= 0:
+            return await asyncio.to_thread(fn, *args)
+        if self._executor is None:
+            # Not fork: the server process has threads (aiosqlite) and an event loop
+            self._executor = ProcessPoolExecutor(
+                self.workers, mp_context=multiprocessing.get_context("spawn")
+            )
+        return await asyncio.get_running_loop().run_in_executor(self._executor, fn, *args)
+
+    async def job(self, key: str, produce: Callable[[], Awaitable[Any]]) -> Any:
+        """Result of produce(), shared by every caller asking for the same key meanwhile."""
+        running = self._jobs.get(key)
+        if running is not None:
+            self.shared += 1
+            # One caller giving up must not cancel the job for the others
+            return await asyncio.shield(running)
+        if len(self._jobs) >= self.queue_limit:
+            self.rejected += 1
+            raise RenderQueueFull()
+        started = time.monotonic()
+        task = asyncio.ensure_future(produce())
+        self._jobs[key] = task
+        self.peak_depth = max(self.peak_depth, len(self._jobs))
+        try:
+            result = await asyncio.shield(task)
+        finally:
+            if task.done():
+                self._jobs.pop(key, None)
+            else:
+                task.add_done_callback(lambda _: self._jobs.pop(key, None))
+        self.completed += 1
+        seconds = time.monotonic() - started
+        prev = self.render_seconds
+        self.render_seconds = seconds if prev is None else 0.8 * prev + 0.2 * seconds
+        return result
+
+    def shutdown(self) -> None:
+        if self._executor is not None:
+            self._executor.shutdown(wait=False, cancel_futures=True)
+            self._executor = None
+
+
+render_pool = RenderPool(settings.render_workers, settings.render_queue_limit)
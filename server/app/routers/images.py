@@ -1,64 +1,232 @@
 from __future__ import annotations
+import hashlib
 from typing import Optional
-from fastapi import APIRouter, Depends, HTTPException, Request, Response
-from fastapi.responses import StreamingResponse
+from urllib.parse import urlencode
+from fastapi import APIRouter, Depends, Header, HTTPException, Query, Request, Response
+from fastapi.responses import PlainTextResponse, StreamingResponse
 from sqlalchemy.ext.asyncio import AsyncSession
 from sqlalchemy import select
 from ..db import get_db
-from ..crud import get_device_by_device_id, get_recent_asset_ids, mark_image_download
+from ..crud import (
+    build_rotation,
+    extend_rotation,
+    get_device_by_device_id,
+    get_recent_asset_ids,
+    mark_image_download,
+    rotation_entries,
+)
 from ..immich import immich
 from ..config import settings
-from ..image_proc import center_crop_resize_to_panel, pack_grayscale_4bpp
+from ..frame_cache import CachedFrame, FrameSession, frame_cache
+from ..models import DeviceRotation
+from ..frame_codec import RLE_ENCODING, accepts_rle, chunk_manifest, rle_encode
+from ..image_proc import LAYOUT_INTERLEAVED, LAYOUT_SPLIT, covers_panel, render_frame_timed
+from ..metrics import RESPONSE_BYTES, REQUEST_SECONDS, STAGE_SECONDS
+from ..render_pool import RenderQueueFull, render_pool
 
 router = APIRouter(prefix="/images", tags=["images"])
 
 
-async def select_next_asset_id(db: AsyncSession, device_id: str) -> str:
+def asset_version(asset: dict) -> str:
+    # Changes when the original is edited, so the edited photo is rendered again
+    return str(asset.get("checksum") or asset.get("updatedAt") or "")
+
+
+_album_snapshot: Optional[tuple[list, dict[str, str], str]] = None
+
+
+def album_snapshot(assets: list[dict]) -> tuple[dict[str, str], str]:
+    """asset_id -> version, and a stamp naming this exact set of assets.
+
+    Built once per album listing: the Immich client hands out the same list until the album
+    changes, so the per-request cost does not grow with the album.
+    """
+    global _album_snapshot
+    if _album_snapshot is None or _album_snapshot[0] is not assets:
+        versions: dict[str, str] = {}
+        for asset in assets:
+            asset_id = asset.get("id") or asset.get("assetId") or asset.get("asset_id")
+            if asset_id:
+                versions[asset_id] = asset_version(asset)
+        stamp = hashlib.sha1("\n".join(versions).encode()).hexdigest()
+        _album_snapshot = (assets, versions, stamp)
+    return _album_snapshot[1], _album_snapshot[2]
+
+
+async def select_next_assets(
+    db: AsyncSession, device_id: str, count: int = 1
+) -> list[tuple[str, str]]:
+    """(asset_id, version) of the device's next `count` photos, from its rotation queue.
+
+    Nothing moves until the download is recorded (mark_image_download), so asking twice gives
+    the same answer.
+    """
     dev = await get_device_by_device_id(db, device_id)
     if dev is None:
         raise HTTPException(status_code=404, detail="device not found")
-    assets = await immich.list_album_assets(settings.immich_album_id)
+    with STAGE_SECONDS.time(stage="album"):
+        assets = await immich.list_album_assets(settings.immich_album_id)
     if not assets:
         raise HTTPException(status_code=404, detail="album empty")
-    recent = await get_recent_asset_ids(db, dev)
-    for asset in assets:
-        asset_id = asset.get("id") or asset.get("assetId") or asset.get("asset_id")
-        if not asset_id:
-            continue
-        if asset_id in recent:
+    versions, stamp = album_snapshot(assets)
+    if not versions:
+        raise HTTPException(status_code=500, detail="invalid asset")
+
+    rot = await db.get(DeviceRotation, dev.id)
+    if rot is None or rot.cursor >= rot.size:
+        rot = await build_rotation(db, dev, list(versions), stamp)
+    elif rot.album_stamp != stamp:
+        await extend_rotation(db, dev, rot, list(versions), stamp)
+
+    picked: list[tuple[str, str]] = []
+    pos = rot.cursor
+    while len(picked) < count:
+        entries = await rotation_entries(db, dev, pos, count - len(picked) + 8)
+        if not entries:
+            if picked or rot.cursor == 0:
+                break
+            # Only removed assets were left: the pass is over
+            rot = await build_rotation(db, dev, list(versions), stamp)
+            pos = 0
             continue
-        return asset_id
-    # If all recent, fall back to the first
-    fallback = (
-        assets[0].get("id") or assets[0].get("assetId") or assets[0].get("asset_id")
-    )
-    if not fallback:
+        for position, asset_id in entries:
+            pos = position + 1
+            if asset_id not in versions:
+                if not picked:
+                    # Gone from the album; never offer it again in this pass
+                    rot.cursor = pos
+                continue
+            picked.append((asset_id, versions[asset_id]))
+            if len(picked) == count:
+                break
+    if db.dirty:
+        await db.commit()
+    if not picked:
         raise HTTPException(status_code=500, detail="invalid asset")
-    return fallback
+    return picked
 
 
-@router.get("/next")
-async def next_image(
-    request: Request, device_id: str, db: AsyncSession = Depends(get_db)
-):
+def etag_matches(if_none_match: Optional[str], etag: str) -> bool:
+    if not if_none_match:
+        return False
+    if if_none_match.strip() == "*":
+        return True
+    opaque = etag.removeprefix("W/")
+    return any(t.strip().removeprefix("W/") == opaque for t in if_none_match.split(","))
+
+
+async def render_asset_frame(
+    asset_id: str, layout: Optional[str], version: str = ""
+) -> CachedFrame:
+    if layout not in (None, LAYOUT_INTERLEAVED, LAYOUT_SPLIT):
+        raise HTTPException(status_code=400, detail="unknown layout")
+    key = frame_cache.render_key(
+        asset_id,
+        version,
+        layout,
+        settings.panel_width,
+        settings.panel_height,
+        settings.dither,
+        settings.panel_controllers,
+        settings.panel_master_columns,
+    )
+    frame = frame_cache.get(key)
+    if frame is not None:
+        return frame
+
+    async def produce() -> CachedFrame:
+        binary = None
+        if settings.immich_preview_size >= max(settings.panel_width, settings.panel_height):
+            # A fraction of the original's size, and always a JPEG (also for HEIC originals)
+            with STAGE_SECONDS.time(stage="fetch"):
+                preview = await immich.get_asset_preview_bytes(asset_id)
+            if covers_panel(preview, settings.panel_width, settings.panel_height):
+                binary = preview
+        if binary is None:
+            with STAGE_SECONDS.time(stage="fetch"):
+                binary = await immich.get_asset_bytes(asset_id)
+        packed, stages = await render_pool.run_cpu(
+            render_frame_timed,
+            binary,
+            settings.panel_width,
+            settings.panel_height,
+            layout,
+            settings.dither,
+            settings.panel_controllers,
+            settings.panel_master_columns,
+        )
+        for stage, seconds in stages.items():
+            STAGE_SECONDS.observe(seconds, stage=stage)
+        return frame_cache.put(key, packed)
+
+    try:
+        with STAGE_SECONDS.time(stage="render"):
+            return await render_pool.job(key, produce)
+    except RenderQueueFull:
+        # The device retries the range; prefer that over queueing without bound
+        raise HTTPException(
+            status_code=503, detail="render queue full", headers={"Retry-After": "5"}
+        )
+
+
+async def render_next_frame(
+    db: AsyncSession, device_id: str, layout: Optional[str]
+) -> FrameSession:
     dev = await get_device_by_device_id(db, device_id)
     if dev is None:
         raise HTTPException(status_code=404, detail="device not found")
-    asset_id = await select_next_asset_id(db, device_id)
-    binary = await immich.get_asset_bytes(asset_id)
-    img = center_crop_resize_to_panel(
-        binary, settings.panel_width, settings.panel_height
-    )
-    packed = pack_grayscale_4bpp(img)
+    if layout not in (None, LAYOUT_INTERLEAVED, LAYOUT_SPLIT):
+        raise HTTPException(status_code=400, detail="unknown layout")
+    # Every range of one download gets the same frame, without picking or rendering again
+    session = frame_cache.session(device_id, layout)
+    if session is not None:
+        return session
+    # The pre-render worker (app/prerender.py) may have picked and rendered it already
+    prepared = frame_cache.take_prepared(device_id, layout)
+    if prepared is not None and prepared.asset_id in await get_recent_asset_ids(db, dev):
+        # Delivered through a batch in the meantime
+        prepared = None
+    if prepared is not None:
+        frame_cache.prerender_hits += 1
+        asset_id, version = prepared.asset_id, prepared.version
+    else:
+        frame_cache.prerender_misses += 1
+        with STAGE_SECONDS.time(stage="select"):
+            asset_id, version = (await select_next_assets(db, device_id))[0]
+    frame = await render_asset_frame(asset_id, layout, version)
+    # Not recorded yet: a manifest or a 304 does not deliver the frame
+    return frame_cache.start_session(device_id, asset_id, layout, frame)
+
+
+async def record_delivery(db: AsyncSession, device_id: str, session: FrameSession) -> None:
+    """Persist that the device got the session's asset, once per download."""
+    if session.recorded:
+        return
+    # Set before the first await so concurrent ranges record it once
+    session.recorded = True
+    dev = await get_device_by_device_id(db, device_id)
+    if dev is not None:
+        await mark_image_download(db, dev, session.asset_id)
 
-    # Persist that this device got this asset now
-    await mark_image_download(db, dev, asset_id)
+
+def frame_response(
+    request: Request, frame: CachedFrame, if_none_match: Optional[str]
+) -> Response:
+    """Serve a packed frame with ETag, x-epd-rle and Range support."""
+    etag = frame.etag
+
+    if etag_matches(if_none_match, etag):
+        # The device already shows this frame
+        return Response(status_code=304, headers={"ETag": etag, "Vary": "Accept-Encoding"})
+
+    encoded = accepts_rle(request.headers.get("accept-encoding"))
+    body = frame_cache.variant(frame, "rle", rle_encode) if encoded else frame.data
 
     # Implement Range support (bytes= start-end)
     range_header: Optional[str] = request.headers.get("range") or request.headers.get(
         "Range"
     )
-    total_size = len(packed)
+    total_size = len(body)
     start = 0
     end = total_size - 1
     status_code = 200
@@ -66,14 +234,22 @@ async def next_image(
         "Accept-Ranges": "bytes",
         "Content-Type": "application/octet-stream",
         "Content-Length": str(total_size),
+        "Vary": "Accept-Encoding",
+        "ETag": etag,
     }
+    if encoded:
+        # Ranges address the encoded body, so the device can resume mid-stream
+        headers["Content-Encoding"] = RLE_ENCODING
     if range_header and range_header.startswith("bytes="):
         try:
             range_spec = range_header.split("=", 1)[1]
             s, e = range_spec.split("-")
             start = int(s) if s else 0
             end = int(e) if e else total_size - 1
-            if start < 0 or end < start or end >= total_size:
+            # A last-byte-pos past the end is clamped (RFC 7233); the device asks for
+            # fixed-size chunks without knowing the encoded size up front
+            end = min(end, total_size - 1)
+            if start < 0 or end < start:
                 raise ValueError("bad range")
             status_code = 206
             headers["Content-Range"] = f"bytes {start}-{end}/{total_size}"
@@ -81,10 +257,110 @@ async def next_image(
         except Exception:
             raise HTTPException(status_code=416, detail="invalid range")
 
-    chunk = memoryview(packed)[start : end + 1]
+    RESPONSE_BYTES.observe(end - start + 1, encoding=RLE_ENCODING if encoded else "identity")
+    # A slice of the mapped file, sent without copying
     return Response(
-        content=chunk.tobytes(),
+        content=body[start : end + 1],
         media_type="application/octet-stream",
         status_code=status_code,
         headers=headers,
     )
+
+
+@router.get("/next/manifest")
+async def next_image_manifest(
+    device_id: str,
+    x_epd_layout: Optional[str] = Header(None),
+    if_none_match: Optional[str] = Header(None),
+    db: AsyncSession = Depends(get_db),
+):
+    """Per-chunk CRC32s of the frame /next would serve, for delta downloads."""
+    frame = (await render_next_frame(db, device_id, x_epd_layout)).frame
+    if etag_matches(if_none_match, frame.etag):
+        return Response(status_code=304, headers={"ETag": frame.etag})
+    return PlainTextResponse(chunk_manifest(frame.data), headers={"ETag": frame.etag})
+
+
+@router.get("/next")
+async def next_image(
+    request: Request,
+    device_id: str,
+    x_epd_layout: Optional[str] = Header(None),
+    if_none_match: Optional[str] = Header(None),
+    db: AsyncSession = Depends(get_db),
+):
+    with REQUEST_SECONDS.time(endpoint="next"):
+        session = await render_next_frame(db, device_id, x_epd_layout)
+        response = frame_response(request, session.frame, if_none_match)
+        # The rotation moves on once a body is sent, not when the device only asked
+        if response.status_code != 304:
+            await record_delivery(db, device_id, session)
+        return response
+
+
+@router.get("/batch", response_class=PlainTextResponse)
+async def next_image_batch(
+    request: Request,
+    device_id: str,
+    count: int = Query(4, ge=1, le=16),
+    db: AsyncSession = Depends(get_db),
+):
+    """URLs of the device's next `count` frames, one per line, for its on-device cache."""
+    dev = await get_device_by_device_id(db, device_id)
+    if dev is None:
+        raise HTTPException(status_code=404, detail="device not found")
+    assets = await select_next_assets(db, device_id, count)
+    lines = []
+    for asset_id, version in assets:
+        # Cached frames are shown later without contacting the server
+        await mark_image_download(db, dev, asset_id)
+        url = request.url_for("asset_image", asset_id=asset_id)
+        params = {"device_id": device_id}
+        if version:
+            params["v"] = version
+        lines.append(f"{url}?{urlencode(params)}")
+    return "\n".join(lines) + "\n"
+
+
+@router.get("/asset/{asset_id}", name="asset_image")
+async def asset_image(
+    request: Request,
+    asset_id: str,
+    device_id: str,
+    v: str = "",
+    x_epd_layout: Optional[str] = Header(None),
+    if_none_match: Optional[str] = Header(None),
+    db: AsyncSession = Depends(get_db),
+):
+    """One specific frame; ranged requests for it always return the same bytes."""
+    if await get_device_by_device_id(db, device_id) is None:
+        raise HTTPException(status_code=404, detail="device not found")
+    with REQUEST_SECONDS.time(endpoint="asset"):
+        frame = await render_asset_frame(asset_id, x_epd_layout, v)
+        return frame_response(request, frame, if_none_match)
+
+
+@router.get("/prerender")
+async def prerender_stats():
+    """How often a wake found its frame already rendered."""
+    hits, misses = frame_cache.prerender_hits, frame_cache.prerender_misses
+    return {
+        "hits": hits,
+        "misses": misses,
+        "hit_rate": hits / (hits + misses) if hits + misses else None,
+        "prepared": frame_cache.prepared_count(),
+    }
+
+
+@router.get("/render")
+async def render_stats():
+    """Render pool load: frames in flight now and at most, and what happened to requests."""
+    return {
+        "workers": render_pool.workers,
+        "depth": render_pool.depth,
+        "peak_depth": render_pool.peak_depth,
+        "queue_limit": render_pool.queue_limit,
+        "completed": render_pool.completed,
+        "shared": render_pool.shared,
+        "rejected": render_pool.rejected,
+    }
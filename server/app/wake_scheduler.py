@@ -0,0 +1,86 @@
+from __future__ import annotations
+import hashlib
+import math
+from typing import Optional
+from .config import settings
+
+
+def device_jitter(device_id: str) -> int:
+    """A stable per-device number, so a device keeps its place across restarts."""
+    return int.from_bytes(hashlib.sha1(device_id.encode()).digest()[:4], "big")
+
+
+class WakeScheduler:
+    """Spreads wakes so the fleet does not hit Immich and the renderer in the same second.
+
+    Every wake is moved to a per-device offset of up to WAKE_SPREAD_SECONDS after its nominal
+    time (cron or default_wake_time), then to the first WAKE_SLOT_SECONDS slot from there that
+    still has room. A slot holds as many wakes as the render workers get through in it at the
+    measured cost of one wake (render plus transfer). Wakes are only ever moved later.
+    """
+
+    def __init__(self) -> None:
+        self._slots: dict[int, set[str]] = {}
+        # device_id -> (nominal epoch, assigned epoch)
+        self._assigned: dict[str, tuple[int, int]] = {}
+
+    def slot_capacity(
+        self, render_seconds: Optional[float], transfer_seconds: Optional[float]
+    ) -> int:
+        if settings.wake_slot_limit > 0:
+            return settings.wake_slot_limit
+        cost = (render_seconds or 0.0) + (transfer_seconds or 0.0)
+        if cost <= 0:
+            cost = settings.wake_cost_seconds
+        workers = max(1, settings.render_workers)
+        return max(1, math.floor(settings.wake_slot_seconds * workers / cost))
+
+    def assign(
+        self,
+        device_id: str,
+        nominal_ts: int,
+        now_ts: int,
+        render_seconds: Optional[float] = None,
+        transfer_seconds: Optional[float] = None,
+    ) -> int:
+        """Epoch the device should wake at for a wake nominally due at `nominal_ts`."""
+        if settings.wake_spread_seconds <= 0 and settings.wake_slot_limit <= 0:
+            return nominal_ts
+        previous = self._assigned.get(device_id)
+        if previous is not None:
+            if previous[0] == nominal_ts:
+                # The config is fetched more than once per wake
+                return previous[1]
+            if previous[1] > now_ts:
+                # Schedule changed before the booked wake came
+                self._slots.get(previous[1] // settings.wake_slot_seconds, set()).discard(
+                    device_id
+                )
+        self._prune(now_ts)
+
+        slot_len = settings.wake_slot_seconds
+        jitter = device_jitter(device_id)
+        start = nominal_ts + jitter % max(1, settings.wake_spread_seconds)
+        slot = start // slot_len
+        capacity = self.slot_capacity(render_seconds, transfer_seconds)
+        while len(self._slots.get(slot, ())) >= capacity:
+            slot += 1
+        wake_ts = start if slot == start // slot_len else slot * slot_len + jitter % slot_len
+        self._slots.setdefault(slot, set()).add(device_id)
+        self._assigned[device_id] = (nominal_ts, wake_ts)
+        return wake_ts
+
+    def slot_counts(self) -> dict[int, int]:
+        """Booked wakes per slot start epoch."""
+        return {
+            slot * settings.wake_slot_seconds: len(ids)
+            for slot, ids in sorted(self._slots.items())
+        }
+
+    def _prune(self, now_ts: int) -> None:
+        oldest = (now_ts - 86400) // settings.wake_slot_seconds
+        for slot in [s for s in self._slots if s < oldest]:
+            del self._slots[slot]
+
+
+wake_scheduler = WakeScheduler()
@@ -0,0 +1,207 @@
+"""Load test: simulated devices downloading frames the way the firmware does.
+
+Runs the app in-process against a fake Immich, so results depend only on this machine and the
+arguments. Each wake asks /images/next for the split layout in 100 KB ranges, the first one
+conditional, like run_download_task() before it adapts the range size; a 503 is retried after a
+back-off. The album's photos are generated from a seed, so every run renders the same frames.
+
+    python loadtest.py --devices 20 --wakes 3
+    python loadtest.py --devices 50 --immich-latency 0.2 --max-p99-ms 2000   # fails above 2 s
+
+Prints throughput, range latency percentiles and where the server spent its time (/metrics).
+"""
+from __future__ import annotations
+import argparse
+import asyncio
+import json
+import os
+import random
+import sys
+import tempfile
+import time
+from io import BytesIO
+
+# Settings are read on import, so the sandbox is set up first
+os.environ.setdefault("IMMICH_BASE_URL", "http://immich.loadtest")
+os.environ.setdefault("IMMICH_API_KEY", "loadtest")
+os.environ.setdefault("IMMICH_ALBUM_ID", "loadtest-album")
+os.environ["DB_URL"] = "sqlite+aiosqlite:///" + os.path.join(tempfile.mkdtemp(), "epd.db")
+os.environ["FRAME_CACHE_DIR"] = tempfile.mkdtemp()
+# Every wake picks and renders on request instead of finding a pre-rendered frame
+os.environ["PRERENDER_LEAD_SECONDS"] = "0"
+
+import httpx
+from PIL import Image
+
+from app.frame_cache import frame_cache
+from app.immich import immich
+from app.main import app, on_shutdown, on_startup
+from app.metrics import STAGE_SECONDS
+
+RANGE_SIZE = 100 * 1024  # CHUNK_SIZE_INITIAL in components/epd_photo_frame/epd_photo_frame.h
+RETRIES = 3
+
+
+def make_photo(seed: int, size: tuple[int, int]) -> bytes:
+    # Smooth colour fields with some grain, roughly as hard to dither as a photo
+    rng = random.Random(seed)
+    tile = Image.frombytes("RGB", (16, 12), rng.randbytes(16 * 12 * 3))
+    img = tile.resize(size, Image.BICUBIC)
+    grain_size = (size[0] // 4, size[1] // 4)
+    grain = Image.frombytes("L", grain_size, rng.randbytes(grain_size[0] * grain_size[1]))
+    img = Image.blend(img, grain.resize(size).convert("RGB"), 0.15)
+    buf = BytesIO()
+    img.save(buf, format="JPEG", quality=90)
+    return buf.getvalue()
+
+
+def fake_immich(photos: list[bytes], latency: float) -> httpx.MockTransport:
+    album = os.environ["IMMICH_ALBUM_ID"]
+    assets = [{"id": f"photo-{i}", "checksum": f"c{i}"} for i in range(len(photos))]
+
+    async def handler(request: httpx.Request) -> httpx.Response:
+        await asyncio.sleep(latency)
+        path = request.url.path
+        if path == f"/api/albums/{album}":
+            meta = {"id": album, "updatedAt": "loadtest", "assetCount": len(assets)}
+            if request.url.params.get("withoutAssets") == "true":
+                return httpx.Response(200, json=meta)
+            return httpx.Response(200, json={**meta, "assets": assets})
+        if path.startswith("/api/assets/photo-"):
+            index = int(path.split("/")[3].removeprefix("photo-"))
+            return httpx.Response(200, content=photos[index])
+        return httpx.Response(404)
+
+    return httpx.MockTransport(handler)
+
+
+def ms(seconds: float) -> float:
+    return round(seconds * 1000, 1)
+
+
+def percentile(values: list[float], p: float) -> float:
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * p))] if ordered else 0.0
+
+
+async def wake(client: httpx.AsyncClient, device_id: str, stats: dict) -> None:
+    """One download of /images/next, range by range."""
+    start, total, etag = 0, None, None
+    while total is None or start < total:
+        headers = {"X-EPD-Layout": "split", "Range": f"bytes={start}-{start + RANGE_SIZE - 1}"}
+        if start == 0 and stats["etags"].get(device_id):
+            headers["If-None-Match"] = stats["etags"][device_id]
+        for attempt in range(1, RETRIES + 1):
+            t = time.perf_counter()
+            r = await client.get(
+                "/images/next", params={"device_id": device_id}, headers=headers
+            )
+            elapsed = time.perf_counter() - t
+            stats["requests"] += 1
+            if r.status_code != 503:
+                break
+            stats["rejected"] += 1
+            await asyncio.sleep(min(0.2 * 2 ** (attempt - 1), 2.0))
+        if r.status_code == 304:
+            stats["not_modified"] += 1
+            return
+        if r.status_code != 206:
+            stats["failed"] += 1
+            return
+        stats["first" if start == 0 else "rest"].append(elapsed)
+        stats["bytes"] += len(r.content)
+        total = int(r.headers["Content-Range"].split("/")[1])
+        etag = r.headers.get("ETag")
+        start += RANGE_SIZE
+    stats["frames"] += 1
+    stats["etags"][device_id] = etag
+
+
+async def run(args: argparse.Namespace) -> dict:
+    size = (args.photo_width, args.photo_height)
+    photos = [make_photo(args.seed + i, size) for i in range(args.photos)]
+    immich._transport = fake_immich(photos, args.immich_latency)
+    immich._client = None
+    await on_startup()
+    stats = {
+        "requests": 0, "rejected": 0, "failed": 0, "not_modified": 0, "frames": 0, "bytes": 0,
+        "first": [], "rest": [], "etags": {},
+    }
+    devices = [f"loadtest-{i:04d}" for i in range(args.devices)]
+    transport = httpx.ASGITransport(app=app)
+    try:
+        async with httpx.AsyncClient(
+            transport=transport, base_url="http://epd", timeout=None
+        ) as client:
+            for device_id in devices:
+                await client.post("/devices/register", json={"device_id": device_id})
+            t0 = time.perf_counter()
+            for _ in range(args.wakes):
+                # The whole fleet wakes at once, the worst case WAKE_SPREAD_SECONDS avoids
+                await asyncio.gather(*(wake(client, d, stats) for d in devices))
+                for device_id in devices:
+                    frame_cache.end_session(device_id)
+            wall = time.perf_counter() - t0
+    finally:
+        await on_shutdown()
+
+    latencies = stats["first"] + stats["rest"]
+    range_ms = {
+        name: ms(percentile(latencies, p))
+        for name, p in (("p50", 0.5), ("p90", 0.9), ("p99", 0.99))
+    }
+    range_ms["max"] = ms(max(latencies, default=0.0))
+    return {
+        "devices": args.devices,
+        "wakes": args.wakes,
+        "wall_s": round(wall, 2),
+        "requests": stats["requests"],
+        "rejected_503": stats["rejected"],
+        "failed": stats["failed"],
+        "frames": stats["frames"],
+        "frames_per_s": round(stats["frames"] / wall, 2),
+        "requests_per_s": round(stats["requests"] / wall, 1),
+        "mb_per_s": round(stats["bytes"] / wall / 1e6, 2),
+        "range_ms": range_ms,
+        "first_range_p50_ms": ms(percentile(stats["first"], 0.5)),
+        "later_range_p50_ms": ms(percentile(stats["rest"], 0.5)),
+        "stage_mean_ms": {
+            stage: ms(STAGE_SECONDS.total(stage=stage) / n)
+            for stage in ("album", "select", "fetch", "decode", "resize", "pack", "render")
+            if (n := STAGE_SECONDS.count(stage=stage))
+        },
+    }
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--devices", type=int, default=10)
+    parser.add_argument("--wakes", type=int, default=2, help="downloads per device")
+    parser.add_argument("--photos", type=int, default=8, help="photos in the fake album")
+    parser.add_argument("--photo-width", type=int, default=4000)
+    parser.add_argument("--photo-height", type=int, default=3000)
+    parser.add_argument(
+        "--immich-latency", type=float, default=0.05, help="seconds per Immich call"
+    )
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--json", action="store_true", help="print the report as JSON")
+    parser.add_argument(
+        "--max-p99-ms", type=float, default=0, help="exit 1 if the range p99 is above this"
+    )
+    args = parser.parse_args()
+
+    report = asyncio.run(run(args))
+    if args.json:
+        print(json.dumps(report))
+    else:
+        for key, value in report.items():
+            print(f"{key:>20}: {value}")
+    if args.max_p99_ms and report["range_ms"]["p99"] > args.max_p99_ms:
+        p99 = report["range_ms"]["p99"]
+        print(f"range p99 {p99} ms is above {args.max_p99_ms} ms", file=sys.stderr)
+        return 1
+    return 1 if report["failed"] else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
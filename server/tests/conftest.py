@@ -13,6 +13,8 @@ os.environ.setdefault("IMMICH_ALBUM_ID", "album-1")
 
 from app.db import Base
 from app.main import app
+from app.frame_cache import frame_cache
+from app.wake_scheduler import wake_scheduler
 import app.db as app_db
 
 
@@ -46,6 +48,21 @@ async def _patch_engine(monkeypatch, test_engine):
     yield
 
 
+@pytest.fixture(autouse=True)
+def _fresh_frame_cache(monkeypatch, tmp_path):
+    # Tests reuse asset ids for different pictures, so none may see another's frames
+    monkeypatch.setattr(frame_cache, "root", str(tmp_path / "frames"))
+    monkeypatch.setattr(frame_cache, "_open", type(frame_cache._open)())
+    monkeypatch.setattr(frame_cache, "_sessions", {})
+    monkeypatch.setattr(frame_cache, "_prepared", {})
+    monkeypatch.setattr(frame_cache, "_layouts", {})
+    monkeypatch.setattr(frame_cache, "prerender_hits", 0)
+    monkeypatch.setattr(frame_cache, "prerender_misses", 0)
+    monkeypatch.setattr(wake_scheduler, "_slots", {})
+    monkeypatch.setattr(wake_scheduler, "_assigned", {})
+    yield
+
+
 @pytest.fixture()
 async def client(test_sessionmaker) -> AsyncIterator[AsyncClient]:
     # Override dependency that yields DB session
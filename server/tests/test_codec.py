@@ -0,0 +1,94 @@
+import pytest
+from httpx import AsyncClient
+from PIL import Image
+from io import BytesIO
+import app.immich as immich_mod
+from app.frame_codec import RLE_ENCODING, rle_decode, rle_encode
+from app.image_proc import pack_grayscale_4bpp
+
+
+def _dummy_image_bytes(w: int = 1600, h: int = 1200) -> bytes:
+    img = Image.new("L", (w, h), color=128)
+    buf = BytesIO()
+    img.save(buf, format="PNG")
+    return buf.getvalue()
+
+
+@pytest.mark.parametrize(
+    "data",
+    [
+        b"",
+        b"a",
+        b"aab",
+        b"a" * 130,
+        b"a" * 131,
+        b"a" * 133,
+        bytes(range(256)) * 2,
+        b"\x11" * 500 + bytes(range(200)) + b"\x22" * 2,
+    ],
+)
+def test_rle_round_trip(data):
+    assert rle_decode(rle_encode(data)) == data
+
+
+def test_rle_compresses_flat_frame():
+    img = Image.new("L", (1200, 1600), color=128)
+    packed = pack_grayscale_4bpp(img, layout="split")
+    encoded = rle_encode(packed)
+    assert rle_decode(encoded) == packed
+    assert len(encoded) * 50 < len(packed)
+
+
+@pytest.mark.asyncio
+async def test_next_image_rle_ranges(client: AsyncClient, monkeypatch):
+    async def fake_list(album_id: str):
+        return [{"id": "asset-1"}]
+
+    async def fake_get(asset_id: str):
+        return _dummy_image_bytes()
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    monkeypatch.setattr(immich_mod.immich, "get_asset_bytes", fake_get)
+    await client.post("/devices/register", json={"device_id": "dev-rle"})
+
+    plain = await client.get("/images/next", params={"device_id": "dev-rle"})
+    assert "Content-Encoding" not in plain.headers
+
+    # Ask for a range larger than the encoded body, as the device does
+    r = await client.get(
+        "/images/next",
+        params={"device_id": "dev-rle"},
+        headers={"Accept-Encoding": RLE_ENCODING, "Range": "bytes=0-102399"},
+    )
+    assert r.status_code == 206
+    assert r.headers["Content-Encoding"] == RLE_ENCODING
+    total = int(r.headers["Content-Range"].rsplit("/", 1)[1])
+    assert total == len(r.content) < len(plain.content)
+    assert rle_decode(r.content) == plain.content
+
+
+@pytest.mark.asyncio
+async def test_etag_shared_across_encodings(client: AsyncClient, monkeypatch):
+    # A download that started run-length coded is resumed with plain ranges of the same frame
+    async def fake_list(album_id: str):
+        return [{"id": "asset-1"}]
+
+    async def fake_get(asset_id: str):
+        return _dummy_image_bytes()
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    monkeypatch.setattr(immich_mod.immich, "get_asset_bytes", fake_get)
+    await client.post("/devices/register", json={"device_id": "dev-resume"})
+
+    params = {"device_id": "dev-resume"}
+    encoded = await client.get(
+        "/images/next", params=params, headers={"Accept-Encoding": RLE_ENCODING}
+    )
+    plain = await client.get(
+        "/images/next",
+        params=params,
+        headers={"Accept-Encoding": "identity", "Range": "bytes=102400-204799"},
+    )
+    assert plain.status_code == 206
+    assert plain.headers["ETag"] == encoded.headers["ETag"]
+    assert plain.content == rle_decode(encoded.content)[102400:204800]
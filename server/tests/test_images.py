@@ -3,6 +3,15 @@ from httpx import AsyncClient
 from PIL import Image
 from io import BytesIO
 import app.immich as immich_mod
+from app.frame_cache import frame_cache
+from app.image_proc import (
+    FRAME_HEADER,
+    SPECTRA6_PALETTE,
+    pack_grayscale_4bpp,
+    pack_nibbles,
+    pack_spectra6_4bpp,
+    quantize_spectra6,
+)
 
 
 def _dummy_image_bytes(w: int = 1600, h: int = 1200) -> bytes:
@@ -40,3 +49,378 @@ async def test_next_image_range(client: AsyncClient, monkeypatch):
     assert r.status_code == 206
     assert r.headers.get("Content-Range") is not None
     assert len(r.content) == min(4096, total)
+
+
+def test_pack_split_layout():
+    # 4x2 image: row 0 = 0x00 0x10 0x20 0x30, row 1 = 0x40 0x50 0x60 0x70
+    img = Image.frombytes("L", (4, 2), bytes(range(0, 0x80, 0x10)))
+    legacy = pack_grayscale_4bpp(img)
+    assert legacy == bytes([0x01, 0x23, 0x45, 0x67])
+
+    split = pack_grayscale_4bpp(img, layout="split")
+    magic, version, layout, bpp, ctrls, w, h, size = FRAME_HEADER.unpack_from(split)
+    assert (magic, version, layout, bpp, ctrls) == (b"EPDF", 1, 1, 4, 2)
+    assert (w, h, size) == (4, 2, 4)
+    # Master halves of both rows, then slave halves
+    assert split[FRAME_HEADER.size :] == bytes([0x01, 0x45, 0x23, 0x67])
+
+    interleaved = pack_grayscale_4bpp(img, layout="interleaved")
+    assert interleaved[FRAME_HEADER.size :] == legacy
+
+
+def test_pack_split_layout_uneven():
+    # 8x2 image whose master drives only the first 2 columns of each row
+    img = Image.frombytes("L", (8, 2), bytes(range(0, 0x100, 0x10)))
+    legacy = pack_grayscale_4bpp(img)
+    assert legacy == bytes([0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF])
+
+    split = pack_grayscale_4bpp(img, layout="split", master_columns=2)
+    assert split[FRAME_HEADER.size :] == bytes([0x01, 0x89, 0x23, 0x45, 0x67, 0xAB, 0xCD, 0xEF])
+    # TestPanel in host/tests/test_panel_traits.cpp: 320 of 800 columns, 160 bytes per master row
+    img_800 = Image.new("RGB", (800, 4), (255, 0, 0))
+    img_800.paste((0, 0, 255), (320, 0, 800, 4))
+    split_800 = pack_spectra6_4bpp(img_800, layout="split", master_columns=320)
+    body = split_800[FRAME_HEADER.size :]
+    assert body == bytes([0x33]) * 640 + bytes([0x55]) * 960
+
+    single = pack_grayscale_4bpp(img, layout="split", controllers=1)
+    _, _, _, _, ctrls, _, _, _ = FRAME_HEADER.unpack_from(single)
+    assert ctrls == 1
+    assert single[FRAME_HEADER.size :] == legacy
+
+    for bad in ({"master_columns": 3}, {"master_columns": 8}, {"controllers": 3}):
+        with pytest.raises(ValueError):
+            pack_grayscale_4bpp(img, layout="split", **bad)
+
+
+def test_pack_nibbles_matches_reference():
+    import random
+
+    values = bytes(random.Random(1).randrange(16) for _ in range(1001))
+    expected = bytearray()
+    for i in range(0, len(values), 2):
+        low = values[i + 1] if i + 1 < len(values) else 0
+        expected.append((values[i] << 4) | low)
+    assert pack_nibbles(values) == bytes(expected)
+    assert pack_nibbles(b"") == b""
+
+
+@pytest.mark.parametrize("dither", ["ordered", "floyd-steinberg", "none"])
+def test_spectra6_inks_are_exact(dither):
+    for rgb, code in SPECTRA6_PALETTE:
+        img = Image.new("RGB", (8, 8), rgb)
+        assert quantize_spectra6(img, dither) == bytes([code]) * 64
+    # Left half red, right half blue: one nibble per pixel, packed in pairs
+    img = Image.new("RGB", (4, 1), (255, 0, 0))
+    img.paste((0, 0, 255), (2, 0, 4, 1))
+    assert pack_spectra6_4bpp(img, dither=dither) == bytes([0x33, 0x55])
+
+
+def test_spectra6_ordered_dither_mixes_and_stays_local():
+    from PIL import ImageDraw
+
+    # Orange sits halfway between red and yellow: an even mix of the two inks
+    orange = quantize_spectra6(Image.new("RGB", (16, 16), (255, 128, 0)))
+    assert orange.count(0x2) == orange.count(0x3) == 128
+
+    # An edit only changes the rows it touches, so delta downloads stay small
+    base = Image.new("RGB", (64, 64), (128, 128, 128))
+    edited = base.copy()
+    ImageDraw.Draw(edited).rectangle((8, 4, 40, 9), fill=(255, 0, 0))
+    a = quantize_spectra6(base)
+    b = quantize_spectra6(edited)
+    changed = {i // 64 for i in range(len(a)) if a[i] != b[i]}
+    assert changed == set(range(4, 10))
+
+
+@pytest.mark.parametrize("dither", ["ordered", "none"])
+def test_spectra6_bands_match_the_whole_frame(monkeypatch, dither):
+    import app.image_proc as image_proc
+
+    # Odd width and a short odd last band, so a packed byte would straddle a bad band edge
+    img = Image.effect_noise((37, 101), 80).convert("RGB")
+    monkeypatch.setattr(image_proc, "DITHER_BAND_ROWS", 1000)
+    whole = quantize_spectra6(img, dither), pack_spectra6_4bpp(img, dither=dither)
+    # Bands of 16 rows, spread over the thread pool even on a single-core runner
+    monkeypatch.setattr(image_proc, "DITHER_BAND_ROWS", 16)
+    monkeypatch.setattr(image_proc, "_cpu_count", lambda: 4)
+    banded = quantize_spectra6(img, dither), pack_spectra6_4bpp(img, dither=dither)
+    assert banded == whole
+    assert len(banded[1]) == (37 * 101 + 1) // 2
+
+
+@pytest.mark.asyncio
+async def test_next_image_split_layout_header(client: AsyncClient, monkeypatch):
+    async def fake_list(album_id: str):
+        return [{"id": "asset-1"}]
+
+    async def fake_get(asset_id: str):
+        return _dummy_image_bytes()
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    monkeypatch.setattr(immich_mod.immich, "get_asset_bytes", fake_get)
+    await client.post("/devices/register", json={"device_id": "dev-split"})
+
+    r = await client.get(
+        "/images/next",
+        params={"device_id": "dev-split"},
+        headers={"X-EPD-Layout": "split", "Range": "bytes=0-15"},
+    )
+    assert r.status_code == 206
+    assert r.content[:4] == b"EPDF"
+    assert r.headers["Content-Range"].endswith("/960016")
+    # Portrait rows, as the device's panel traits expect
+    _, _, _, _, _, w, h, size = FRAME_HEADER.unpack_from(r.content)
+    assert (w, h, size) == (1200, 1600, 960000)
+
+    r = await client.get(
+        "/images/next",
+        params={"device_id": "dev-split"},
+        headers={"X-EPD-Layout": "diagonal"},
+    )
+    assert r.status_code == 400
+
+
+@pytest.mark.asyncio
+async def test_next_image_etag_not_modified(client: AsyncClient, monkeypatch):
+    async def fake_list(album_id: str):
+        return [{"id": "asset-1"}]
+
+    async def fake_get(asset_id: str):
+        return _dummy_image_bytes()
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    monkeypatch.setattr(immich_mod.immich, "get_asset_bytes", fake_get)
+    await client.post("/devices/register", json={"device_id": "dev-etag"})
+
+    r = await client.get("/images/next", params={"device_id": "dev-etag"})
+    assert r.status_code == 200
+    etag = r.headers["ETag"]
+
+    # Same frame again: stable tag, and a matching If-None-Match skips the body
+    r = await client.get(
+        "/images/next",
+        params={"device_id": "dev-etag"},
+        headers={"If-None-Match": etag, "Range": "bytes=0-102399"},
+    )
+    assert r.status_code == 304
+    assert r.headers["ETag"] == etag
+    assert r.content == b""
+
+    r = await client.get(
+        "/images/next",
+        params={"device_id": "dev-etag"},
+        headers={"If-None-Match": 'W/"stale"'},
+    )
+    assert r.status_code == 200
+    assert r.headers["ETag"] == etag
+
+
+@pytest.mark.asyncio
+async def test_manifest_delta_patch(client: AsyncClient, monkeypatch):
+    import zlib
+    from PIL import ImageDraw
+
+    current = {"img": Image.new("L", (1600, 1200), color=128), "checksum": "v1"}
+
+    async def fake_list(album_id: str):
+        return [{"id": "asset-1", "checksum": current["checksum"]}]
+
+    async def fake_get(asset_id: str):
+        buf = BytesIO()
+        current["img"].save(buf, format="PNG")
+        return buf.getvalue()
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    monkeypatch.setattr(immich_mod.immich, "get_asset_bytes", fake_get)
+    await client.post("/devices/register", json={"device_id": "dev-delta"})
+    params = {"device_id": "dev-delta"}
+
+    old = (await client.get("/images/next", params=params)).content
+
+    # A caption overlay near the top touches only the first chunk(s)
+    edited = current["img"].copy()
+    ImageDraw.Draw(edited).rectangle((100, 20, 900, 60), fill=255)
+    current["img"] = edited
+    current["checksum"] = "v2"
+    # The device wakes again later
+    frame_cache.end_session("dev-delta")
+
+    r = await client.get("/images/next/manifest", params=params)
+    assert r.status_code == 200
+    etag = r.headers["ETag"]
+    lines = r.text.split()
+    assert lines[0:2] == ["size", str(len(old))]
+    chunk = int(lines[3])
+    crcs = [int(c, 16) for c in lines[4:]]
+
+    # What the device does: patch the chunks whose CRC differs from the stored frame
+    frame = bytearray(old)
+    fetched = 0
+    for i, crc in enumerate(crcs):
+        start = i * chunk
+        if zlib.crc32(frame[start : start + chunk]) == crc:
+            continue
+        end = min(start + chunk, len(frame)) - 1
+        r = await client.get(
+            "/images/next", params=params, headers={"Range": f"bytes={start}-{end}"}
+        )
+        assert r.status_code == 206
+        frame[start : end + 1] = r.content
+        fetched += len(r.content)
+
+    new = (await client.get("/images/next", params=params)).content
+    assert bytes(frame) == new != old
+    assert 0 < fetched <= len(new) // 4
+
+    # Nothing to patch once the device shows the current frame
+    r = await client.get(
+        "/images/next/manifest",
+        params=params,
+        headers={"If-None-Match": etag},
+    )
+    assert r.status_code == 304
+
+
+@pytest.mark.asyncio
+async def test_batch_lists_distinct_frames(client: AsyncClient, monkeypatch):
+    shades = {"asset-1": 0, "asset-2": 128, "asset-3": 255}
+
+    async def fake_list(album_id: str):
+        return [{"id": asset_id} for asset_id in shades]
+
+    async def fake_get(asset_id: str):
+        buf = BytesIO()
+        Image.new("L", (1600, 1200), color=shades[asset_id]).save(buf, format="PNG")
+        return buf.getvalue()
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    monkeypatch.setattr(immich_mod.immich, "get_asset_bytes", fake_get)
+    await client.post("/devices/register", json={"device_id": "dev-batch"})
+
+    r = await client.get("/images/batch", params={"device_id": "dev-batch", "count": 2})
+    assert r.status_code == 200
+    urls = r.text.split()
+    assert len(urls) == 2
+
+    frames = []
+    for url in urls:
+        assert "/images/asset/" in url and "device_id=dev-batch" in url
+        first = await client.get(url, headers={"Range": "bytes=0-99"})
+        assert first.status_code == 206
+        rest = await client.get(url, headers={"Range": "bytes=100-"})
+        whole = await client.get(url)
+        assert first.content + rest.content == whole.content
+        frames.append(whole.content)
+    assert frames[0] != frames[1]
+
+    # Both batch frames count as delivered, so /next moves on to the third
+    r = await client.get("/images/next", params={"device_id": "dev-batch"})
+    assert r.content not in frames
+
+    r = await client.get("/images/batch", params={"device_id": "dev-batch", "count": 0})
+    assert r.status_code == 422
+
+
+@pytest.mark.asyncio
+async def test_ranges_render_and_record_once(
+    client: AsyncClient, monkeypatch, test_sessionmaker
+):
+    from sqlalchemy import func, select
+    from app.models import Device, ImageDownload
+
+    fetches = []
+
+    async def fake_list(album_id: str):
+        return [{"id": "asset-1"}, {"id": "asset-2"}]
+
+    async def fake_get(asset_id: str):
+        fetches.append(asset_id)
+        buf = BytesIO()
+        shade = 64 if asset_id == "asset-1" else 192
+        Image.new("L", (1600, 1200), color=shade).save(buf, format="PNG")
+        return buf.getvalue()
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    monkeypatch.setattr(immich_mod.immich, "get_asset_bytes", fake_get)
+    await client.post("/devices/register", json={"device_id": "dev-once"})
+    params = {"device_id": "dev-once"}
+
+    # One download in 100 KB ranges, as the device makes it
+    whole = (await client.get("/images/next", params=params)).content
+    parts = []
+    for start in range(0, len(whole), 102400):
+        r = await client.get(
+            "/images/next", params=params, headers={"Range": f"bytes={start}-{start + 102399}"}
+        )
+        assert r.status_code == 206
+        parts.append(r.content)
+    assert b"".join(parts) == whole
+    assert len(fetches) == 1
+    first = fetches[0]
+
+    async with test_sessionmaker() as session:
+        dev_pk = (
+            await session.execute(select(Device.id).where(Device.device_id == "dev-once"))
+        ).scalar_one()
+        downloads = await session.execute(
+            select(func.count()).where(ImageDownload.device_id_fk == dev_pk)
+        )
+        assert downloads.scalar_one() == 1
+
+    # The next wake moves on; the first frame stays on disk
+    frame_cache.end_session("dev-once")
+    r = await client.get("/images/next", params=params)
+    assert r.content != whole
+    assert len(fetches) == 2 and fetches[1] != first
+    r = await client.get(f"/images/asset/{first}", params=params)
+    assert r.content == whole
+    assert len(fetches) == 2
+
+
+@pytest.mark.asyncio
+async def test_preview_used_when_it_covers_panel(client: AsyncClient, monkeypatch):
+    from app.config import settings
+    from app.image_proc import covers_panel
+
+    fetched = []
+
+    async def fake_preview(asset_id: str):
+        fetched.append(("preview", asset_id))
+        # Landscape 2880x2160: the portrait crop is 1620x2160, enough for 1200x1600
+        size = (2880, 2160) if asset_id == "asset-big" else (1440, 1080)
+        buf = BytesIO()
+        Image.new("RGB", size, color=(255, 255, 0)).save(buf, format="JPEG")
+        return buf.getvalue()
+
+    async def fake_get(asset_id: str):
+        fetched.append(("original", asset_id))
+        return _dummy_image_bytes(4000, 3000)
+
+    monkeypatch.setattr(immich_mod.immich, "get_asset_preview_bytes", fake_preview)
+    monkeypatch.setattr(immich_mod.immich, "get_asset_bytes", fake_get)
+    monkeypatch.setattr(settings, "immich_preview_size", 2880)
+    await client.post("/devices/register", json={"device_id": "dev-preview-src"})
+    params = {"device_id": "dev-preview-src"}
+
+    r = await client.get("/images/asset/asset-big", params=params)
+    assert r.status_code == 200
+    assert fetched == [("preview", "asset-big")]
+
+    fetched.clear()
+    r = await client.get("/images/asset/asset-small", params=params)
+    assert r.status_code == 200
+    assert fetched == [("preview", "asset-small"), ("original", "asset-small")]
+
+    assert not covers_panel(b"not an image", 1200, 1600)
+
+
+def test_reduced_decode_keeps_panel_size():
+    from app.image_proc import center_crop_resize_to_panel
+
+    # Big enough for a 1/4 DCT-domain decode; the crop and the result stay panel-shaped
+    buf = BytesIO()
+    Image.new("RGB", (8000, 6000), color=(255, 0, 0)).save(buf, format="JPEG")
+    img = center_crop_resize_to_panel(buf.getvalue(), 1200, 1600)
+    assert img.size == (1200, 1600)
+    assert quantize_spectra6(img) == bytes([0x3]) * (1200 * 1600)
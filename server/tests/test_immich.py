@@ -0,0 +1,90 @@
+import pytest
+import httpx
+from fastapi import FastAPI, Request, Response
+from app.config import settings
+from app.immich import ImmichClient
+
+
+def _fake_immich():
+    """Just enough of the Immich API, counting what the client asks for."""
+    state = {
+        "updatedAt": "2024-01-01T00:00:00Z",
+        "assets": [{"id": f"a{i}", "checksum": f"c{i}", "exifInfo": {}} for i in range(3)],
+        "calls": [],
+    }
+    fake = FastAPI()
+
+    @fake.get("/api/albums/{album_id}")
+    async def album(album_id: str, request: Request, withoutAssets: bool = False):
+        assert request.headers["x-api-key"] == "test-key"
+        state["calls"].append("meta" if withoutAssets else "full")
+        body = {
+            "id": album_id,
+            "updatedAt": state["updatedAt"],
+            "assetCount": len(state["assets"]),
+        }
+        if not withoutAssets:
+            body["assets"] = state["assets"]
+        return body
+
+    @fake.get("/api/assets/{asset_id}/original")
+    async def original(asset_id: str):
+        state["calls"].append(f"original {asset_id}")
+        return Response(content=asset_id.encode() * 100_000, media_type="image/jpeg")
+
+    return fake, state
+
+
+@pytest.mark.asyncio
+async def test_album_index_refreshes_only_on_change(monkeypatch):
+    fake, state = _fake_immich()
+    client = ImmichClient(
+        "http://immich.test", "test-key", transport=httpx.ASGITransport(app=fake)
+    )
+
+    assets = await client.list_album_assets("album-1")
+    assert [a["id"] for a in assets] == ["a0", "a1", "a2"]
+    # Only the fields the pipeline reads are kept
+    assert assets[0] == {"id": "a0", "checksum": "c0"}
+    assert state["calls"] == ["full"]
+
+    # Fresh: served from the index without a request
+    await client.list_album_assets("album-1")
+    assert state["calls"] == ["full"]
+
+    # Stale but unchanged: one small metadata request
+    monkeypatch.setattr(settings, "immich_album_refresh_seconds", 0)
+    await client.refresh_album("album-1")
+    assert state["calls"] == ["full", "meta"]
+
+    # Changed: the asset list is downloaded again
+    state["assets"].append({"id": "a3", "checksum": "c3"})
+    state["updatedAt"] = "2024-01-02T00:00:00Z"
+    index = await client.refresh_album("album-1")
+    assert state["calls"] == ["full", "meta", "meta", "full"]
+    assert len(index.assets) == 4
+
+    # A stale index is returned right away and refreshed in the background
+    state["assets"].append({"id": "a4"})
+    state["updatedAt"] = "2024-01-03T00:00:00Z"
+    assets = await client.list_album_assets("album-1")
+    assert len(assets) == 4
+    await client._refreshing["album-1"]
+    assert len(await client.list_album_assets("album-1")) == 5
+    await client.aclose()
+
+
+@pytest.mark.asyncio
+async def test_one_pool_and_streamed_originals():
+    fake, state = _fake_immich()
+    client = ImmichClient(
+        "http://immich.test", "test-key", transport=httpx.ASGITransport(app=fake)
+    )
+    first = await client.get_asset_bytes("a1")
+    pool = client._http()
+    second = await client.get_asset_bytes("a2")
+    assert client._http() is pool
+    assert bytes(first) == b"a1" * 100_000
+    assert bytes(second) == b"a2" * 100_000
+    assert state["calls"] == ["original a1", "original a2"]
+    await client.aclose()
@@ -0,0 +1,68 @@
+import pytest
+from httpx import AsyncClient
+from PIL import Image
+from io import BytesIO
+import app.immich as immich_mod
+from app.metrics import DB_SECONDS, RESPONSE_BYTES, STAGE_SECONDS, Histogram
+
+
+def test_histogram_exposition():
+    h = Histogram("t_seconds", "Test", buckets=(0.1, 1.0))
+    h.observe(0.05, stage="a")
+    h.observe(0.5, stage="a")
+    h.observe(3.0, stage="a")
+    assert h.expose() == [
+        "# HELP t_seconds Test",
+        "# TYPE t_seconds histogram",
+        't_seconds_bucket{stage="a",le="0.1"} 1',
+        't_seconds_bucket{stage="a",le="1"} 2',
+        't_seconds_bucket{stage="a",le="+Inf"} 3',
+        't_seconds_sum{stage="a"} 3.55',
+        't_seconds_count{stage="a"} 3',
+    ]
+
+
+@pytest.mark.asyncio
+async def test_ranged_download_is_measured(client: AsyncClient, monkeypatch):
+    buf = BytesIO()
+    Image.new("RGB", (1600, 1200), (200, 40, 40)).save(buf, format="JPEG")
+
+    async def fake_list(album_id: str):
+        return [{"id": "metrics-1"}]
+
+    async def fake_get(asset_id: str):
+        return buf.getvalue()
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    monkeypatch.setattr(immich_mod.immich, "get_asset_bytes", fake_get)
+    await client.post("/devices/register", json={"device_id": "dev-metrics"})
+
+    before = {s: STAGE_SECONDS.count(stage=s) for s in ("decode", "resize", "pack", "select")}
+    sent = RESPONSE_BYTES.count(encoding="identity")
+    marks = DB_SECONDS.count(op="mark_image_download")
+    # The device's pattern: 100 KB ranges of the split-layout frame
+    start, total, requests = 0, None, 0
+    while total is None or start < total:
+        r = await client.get(
+            "/images/next",
+            params={"device_id": "dev-metrics"},
+            headers={"X-EPD-Layout": "split", "Range": f"bytes={start}-{start + 102399}"},
+        )
+        assert r.status_code == 206
+        total = int(r.headers["Content-Range"].split("/")[1])
+        start += 102400
+        requests += 1
+    assert requests == 10
+
+    # One pick and one render for the whole download, one size sample per range
+    for stage, n in before.items():
+        assert STAGE_SECONDS.count(stage=stage) == n + 1
+    assert RESPONSE_BYTES.count(encoding="identity") == sent + requests
+    assert DB_SECONDS.count(op="mark_image_download") == marks + 1
+
+    r = await client.get("/metrics")
+    assert r.status_code == 200
+    assert r.headers["content-type"].startswith("text/plain; version=0.0.4")
+    assert 'epd_stage_seconds_count{stage="decode"}' in r.text
+    assert 'epd_db_seconds_bucket{op="get_device_by_device_id",le="+Inf"}' in r.text
+    assert "epd_render_rejected_total" in r.text
@@ -0,0 +1,71 @@
+import pytest
+from httpx import AsyncClient
+from PIL import Image
+from io import BytesIO
+import app.immich as immich_mod
+from app.config import settings
+from app.frame_cache import frame_cache
+from app.prerender import prerender_due
+
+
+@pytest.mark.asyncio
+async def test_prerendered_frame_is_a_cache_hit(
+    client: AsyncClient, monkeypatch, test_sessionmaker
+):
+    fetches = []
+
+    async def fake_list(album_id: str):
+        return [{"id": "asset-1"}, {"id": "asset-2"}]
+
+    async def fake_get(asset_id: str):
+        fetches.append(asset_id)
+        buf = BytesIO()
+        Image.new("RGB", (1600, 1200), color=(255, 0, 0)).save(buf, format="PNG")
+        return buf.getvalue()
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    monkeypatch.setattr(immich_mod.immich, "get_asset_bytes", fake_get)
+    await client.post("/devices/register", json={"device_id": "dev-pre"})
+
+    # Every device wakes within two days
+    monkeypatch.setattr(settings, "prerender_lead_seconds", 2 * 86400)
+    async with test_sessionmaker() as db:
+        assert await prerender_due(db) >= 1
+    assert frame_cache.is_prepared("dev-pre")
+    rendered = len(fetches)
+
+    # At wake: no Immich traffic, no render
+    r = await client.get(
+        "/images/next", params={"device_id": "dev-pre"}, headers={"X-EPD-Layout": "split"}
+    )
+    assert r.status_code == 200
+    assert len(fetches) == rendered
+    assert not frame_cache.is_prepared("dev-pre")
+
+    # A device asking for another layout than was prepared is a miss
+    async with test_sessionmaker() as db:
+        await prerender_due(db)
+    frame_cache.end_session("dev-pre")
+    r = await client.get("/images/next", params={"device_id": "dev-pre"})
+    assert r.status_code == 200
+
+    r = await client.get("/images/prerender")
+    stats = r.json()
+    assert (stats["hits"], stats["misses"]) == (1, 1)
+    assert stats["hit_rate"] == 0.5
+
+
+@pytest.mark.asyncio
+async def test_prerender_waits_for_the_lead_time(
+    client: AsyncClient, monkeypatch, test_sessionmaker
+):
+    async def fake_list(album_id: str):
+        return [{"id": "asset-1"}]
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    await client.post("/devices/register", json={"device_id": "dev-later"})
+
+    monkeypatch.setattr(settings, "prerender_lead_seconds", 0)
+    async with test_sessionmaker() as db:
+        assert await prerender_due(db) == 0
+    assert not frame_cache.is_prepared("dev-later")
@@ -0,0 +1,69 @@
+import asyncio
+import pytest
+from httpx import AsyncClient
+from PIL import Image
+from io import BytesIO
+import app.immich as immich_mod
+from app.render_pool import render_pool
+
+
+def _photo_bytes() -> bytes:
+    buf = BytesIO()
+    Image.new("RGB", (1600, 1200), color=(0, 0, 255)).save(buf, format="PNG")
+    return buf.getvalue()
+
+
+@pytest.mark.asyncio
+async def test_concurrent_requests_share_one_render(client: AsyncClient, monkeypatch):
+    fetches = []
+
+    async def fake_get(asset_id: str):
+        fetches.append(asset_id)
+        await asyncio.sleep(0.05)
+        return _photo_bytes()
+
+    monkeypatch.setattr(immich_mod.immich, "get_asset_bytes", fake_get)
+    monkeypatch.setattr(render_pool, "shared", 0)
+    await client.post("/devices/register", json={"device_id": "dev-share-a"})
+    await client.post("/devices/register", json={"device_id": "dev-share-b"})
+
+    a, b = await asyncio.gather(
+        client.get("/images/asset/asset-1", params={"device_id": "dev-share-a"}),
+        client.get("/images/asset/asset-1", params={"device_id": "dev-share-b"}),
+    )
+    assert a.status_code == b.status_code == 200
+    assert a.content == b.content
+    assert fetches == ["asset-1"]
+    assert render_pool.shared == 1
+    assert render_pool.depth == 0
+
+
+@pytest.mark.asyncio
+async def test_full_queue_pushes_back(client: AsyncClient, monkeypatch):
+    release = asyncio.Event()
+
+    async def fake_get(asset_id: str):
+        await release.wait()
+        return _photo_bytes()
+
+    monkeypatch.setattr(immich_mod.immich, "get_asset_bytes", fake_get)
+    monkeypatch.setattr(render_pool, "queue_limit", 1)
+    monkeypatch.setattr(render_pool, "rejected", 0)
+    await client.post("/devices/register", json={"device_id": "dev-busy"})
+    params = {"device_id": "dev-busy"}
+
+    first = asyncio.create_task(client.get("/images/asset/asset-1", params=params))
+    while render_pool.depth == 0:
+        await asyncio.sleep(0.01)
+
+    r = await client.get("/images/asset/asset-2", params=params)
+    assert r.status_code == 503
+    assert r.headers["Retry-After"] == "5"
+
+    r = await client.get("/images/render")
+    assert r.json()["depth"] == 1
+    assert r.json()["rejected"] == 1
+
+    release.set()
+    assert (await first).status_code == 200
+    assert render_pool.depth == 0
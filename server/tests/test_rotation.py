@@ -0,0 +1,153 @@
+import pytest
+from io import BytesIO
+from httpx import AsyncClient
+from PIL import Image
+import app.immich as immich_mod
+from app.crud import get_device_by_device_id, get_recent_asset_ids, mark_image_download
+from app.frame_cache import frame_cache
+from app.routers.images import select_next_assets
+
+
+async def _show_next(db, device_id: str) -> str:
+    asset_id, _ = (await select_next_assets(db, device_id))[0]
+    dev = await get_device_by_device_id(db, device_id)
+    await mark_image_download(db, dev, asset_id)
+    return asset_id
+
+
+@pytest.mark.asyncio
+async def test_rotation_shows_every_asset_once_per_pass(
+    client: AsyncClient, monkeypatch, test_sessionmaker
+):
+    album = [{"id": f"rot-{i}"} for i in range(20)]
+
+    async def fake_list(album_id: str):
+        return album
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    await client.post("/devices/register", json={"device_id": "dev-rot"})
+
+    async with test_sessionmaker() as db:
+        # Asking again before the download is recorded gives the same photo
+        first = await select_next_assets(db, "dev-rot")
+        assert await select_next_assets(db, "dev-rot") == first
+
+        shown = [await _show_next(db, "dev-rot") for _ in range(20)]
+        assert sorted(shown) == sorted(a["id"] for a in album)
+
+        # Everything was shown within min_days_before_repeat, so the next pass is a reshuffle
+        # of all of them
+        again = [await _show_next(db, "dev-rot") for _ in range(20)]
+        assert sorted(again) == sorted(shown)
+
+
+@pytest.mark.asyncio
+async def test_rotation_puts_recent_assets_last(
+    client: AsyncClient, monkeypatch, test_sessionmaker
+):
+    album = [{"id": f"rec-{i}"} for i in range(10)]
+
+    async def fake_list(album_id: str):
+        return album
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    await client.post("/devices/register", json={"device_id": "dev-recent"})
+
+    async with test_sessionmaker() as db:
+        dev = await get_device_by_device_id(db, "dev-recent")
+        # Shown through some other path before the device had a rotation
+        for asset_id in ("rec-0", "rec-1", "rec-2"):
+            await mark_image_download(db, dev, asset_id)
+        shown = [await _show_next(db, "dev-recent") for _ in range(10)]
+        assert set(shown[7:]) == {"rec-0", "rec-1", "rec-2"}
+
+
+@pytest.mark.asyncio
+async def test_rotation_follows_album_changes(
+    client: AsyncClient, monkeypatch, test_sessionmaker
+):
+    album = [{"id": f"chg-{i}"} for i in range(6)]
+
+    async def fake_list(album_id: str):
+        return album
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    await client.post("/devices/register", json={"device_id": "dev-change"})
+
+    async with test_sessionmaker() as db:
+        shown = [await _show_next(db, "dev-change")]
+        upcoming = [a for a, _ in await select_next_assets(db, "dev-change", 5)]
+        assert shown[0] not in upcoming
+
+        # One queued asset leaves the album and a new one arrives, mid-pass
+        removed = upcoming[0]
+        album = [a for a in album if a["id"] != removed] + [{"id": "chg-new"}]
+        shown += [await _show_next(db, "dev-change") for _ in range(5)]
+        assert removed not in shown
+        assert "chg-new" in shown
+        assert len(set(shown)) == 6
+
+
+@pytest.mark.asyncio
+async def test_rotation_moves_past_an_asset_behind_a_gap(
+    client: AsyncClient, monkeypatch, test_sessionmaker
+):
+    album = [{"id": f"gap-{i}"} for i in range(6)]
+
+    async def fake_list(album_id: str):
+        return album
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    await client.post("/devices/register", json={"device_id": "dev-gap"})
+
+    async with test_sessionmaker() as db:
+        upcoming = [a for a, _ in await select_next_assets(db, "dev-gap", 4)]
+        dev = await get_device_by_device_id(db, "dev-gap")
+        # The second leaves the album, so a batch delivers the first and the third
+        album = [a for a in album if a["id"] != upcoming[1]]
+        await mark_image_download(db, dev, upcoming[0])
+        await mark_image_download(db, dev, upcoming[2])
+        assert (await select_next_assets(db, "dev-gap"))[0][0] == upcoming[3]
+
+
+@pytest.mark.asyncio
+async def test_delivery_recorded_when_a_body_is_sent(
+    client: AsyncClient, monkeypatch, test_sessionmaker
+):
+    async def fake_list(album_id: str):
+        return [{"id": "dlv-1"}, {"id": "dlv-2"}]
+
+    async def fake_get(asset_id: str):
+        buf = BytesIO()
+        Image.new("L", (1600, 1200), color=int(asset_id[-1]) * 100).save(buf, format="PNG")
+        return buf.getvalue()
+
+    monkeypatch.setattr(immich_mod.immich, "list_album_assets", fake_list)
+    monkeypatch.setattr(immich_mod.immich, "get_asset_bytes", fake_get)
+    await client.post("/devices/register", json={"device_id": "dev-dlv"})
+    params = {"device_id": "dev-dlv"}
+
+    async def delivered() -> set[str]:
+        async with test_sessionmaker() as db:
+            return await get_recent_asset_ids(db, await get_device_by_device_id(db, "dev-dlv"))
+
+    # Asking for the manifest or getting a 304 delivers nothing
+    r = await client.get("/images/next/manifest", params=params)
+    etag = r.headers["ETag"]
+    r = await client.get("/images/next", params=params, headers={"If-None-Match": etag})
+    assert r.status_code == 304
+    assert await delivered() == set()
+
+    # The first range with a body records the frame, later ranges of the session do not again
+    for start in (0, 102400):
+        r = await client.get(
+            "/images/next", params=params, headers={"Range": f"bytes={start}-{start + 102399}"}
+        )
+        assert r.status_code == 206
+    first = await delivered()
+    assert len(first) == 1
+
+    frame_cache.end_session("dev-dlv")
+    r = await client.get("/images/next", params=params, headers={"Range": "bytes=0-102399"})
+    assert r.status_code == 206
+    assert len(await delivered() - first) == 1
@@ -0,0 +1,69 @@
+import pytest
+from httpx import AsyncClient
+
+from app.config import settings
+from app.wake_scheduler import WakeScheduler, wake_scheduler
+
+NOMINAL = 1_700_017_200  # a 03:00 UTC wake
+FLEET = 1000
+
+
+def peak_concurrent(starts: list[int], seconds: float) -> int:
+    # Most wakes whose render (start .. start + seconds) overlaps at one instant
+    events = sorted([(t, 1) for t in starts] + [(t + seconds, -1) for t in starts])
+    peak = running = 0
+    for _, step in events:
+        running += step
+        peak = max(peak, running)
+    return peak
+
+
+def test_fleet_simulation_caps_concurrent_renders():
+    cost = settings.wake_cost_seconds
+    ids = [f"esp32-{i:04x}" for i in range(FLEET)]
+    sched = WakeScheduler()
+    wakes = [sched.assign(d, NOMINAL, NOMINAL - 3600) for d in ids]
+
+    unscheduled = peak_concurrent([NOMINAL] * FLEET, cost)
+    scheduled = peak_concurrent(wakes, cost)
+    capacity = sched.slot_capacity(None, None)
+    last = (max(wakes) - NOMINAL) / 60
+    print(
+        f"\n{FLEET} devices at 03:00: peak concurrent renders {unscheduled} -> {scheduled} "
+        f"(slot capacity {capacity}), last wake +{last:.0f} min"
+    )
+    assert unscheduled == FLEET
+    assert all(w >= NOMINAL for w in wakes)
+    assert max(sched.slot_counts().values()) <= capacity
+    # A render may still overlap the end of the previous slot's last one
+    assert scheduled <= 2 * capacity
+
+
+def test_measured_cost_sizes_slots():
+    sched = WakeScheduler()
+    assert sched.slot_capacity(1.0, 2.0) > sched.slot_capacity(10.0, 20.0) >= 1
+
+
+def test_assignment_is_stable_and_moves_with_schedule():
+    sched = WakeScheduler()
+    first = sched.assign("dev-a", NOMINAL, NOMINAL - 3600)
+    assert sched.assign("dev-a", NOMINAL, NOMINAL - 3000) == first
+    # A new nominal time gives up the old booking
+    later = sched.assign("dev-a", NOMINAL + 7200, NOMINAL - 3000)
+    assert later >= NOMINAL + 7200
+    assert sum(sched.slot_counts().values()) == 1
+
+
+@pytest.mark.asyncio
+async def test_config_spreads_default_wake(client: AsyncClient):
+    epochs = []
+    for dev in ("spread-1", "spread-2"):
+        r = await client.post("/devices/register", json={"device_id": dev})
+        assert r.status_code == 200
+        r = await client.get(f"/devices/{dev}/config")
+        epochs.append(r.json()["next_wake_epoch"])
+        # Fetching the config again does not book another slot
+        r = await client.get(f"/devices/{dev}/config")
+        assert r.json()["next_wake_epoch"] == epochs[-1]
+    assert epochs[0] != epochs[1]
+    assert sum(wake_scheduler.slot_counts().values()) == 2